@@ -0,0 +1,258 @@
+/* fifo_bench - check and benchmark the SPSC byte ring of fifo.c
+ *
+ * First a randomized single threaded run compares fifo.c against a
+ * trivial model (contents and watermark events).  Then a producer and a
+ * consumer thread stream a byte sequence through the ring, once with
+ * the copying and once with the zero-copy interface, verifying every
+ * byte on the consumer side.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <os/fifo.h>
+
+#define CHECK_OPS	2000000
+#define STREAM_BYTES	(256UL * 1024 * 1024)
+
+static unsigned long rnd_state = 1;
+
+static unsigned int rnd(unsigned int max)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return (rnd_state >> 8) % max;
+}
+
+static unsigned int events[8];
+
+static void count_event(struct fifo *fifo, uint8_t event, void *data)
+{
+	events[event]++;
+}
+
+static int check(uint16_t size)
+{
+	static struct fifo fifo;
+	uint8_t buf[FIFO_SIZE], *span;
+	unsigned long wr = 0, rd = 0;
+	unsigned int exp_lo = 0, exp_hi = 0, exp_oflow = 0;
+	uint16_t lo = size / 4, hi = size * 3 / 4;
+	unsigned int i, j;
+
+	if (fifo_init(&fifo, size, count_event, NULL) < 0)
+		return -1;
+	fifo_set_water(&fifo, lo, hi, FIFO_IRQ_LO|FIFO_IRQ_HI|FIFO_IRQ_OFLOW);
+	memset(events, 0, sizeof(events));
+
+	for (i = 0; i < CHECK_OPS; i++) {
+		unsigned int fill = wr - rd, len, done;
+
+		switch (rnd(4)) {
+		case 0:		/* fifo_data_put */
+			len = rnd(size / 2 + 1);
+			for (j = 0; j < len; j++)
+				buf[j] = wr + j;
+			done = fifo_data_put(&fifo, len, buf);
+			if (done != (len < size - fill ? len : size - fill))
+				goto fail;
+			if (done < len)
+				exp_oflow++;
+			wr += done;
+			break;
+		case 1:		/* fifo_data_get */
+			len = rnd(size / 2 + 1);
+			done = fifo_data_get(&fifo, len, buf);
+			if (done != (len < fill ? len : fill))
+				goto fail;
+			for (j = 0; j < done; j++) {
+				if (buf[j] != (uint8_t)(rd + j))
+					goto fail;
+			}
+			rd += done;
+			break;
+		case 2:		/* zero-copy write */
+			len = fifo_write_peek(&fifo, &span);
+			if (len > size - fill ||
+			    (len == 0 && fill < size))
+				goto fail;
+			len = len ? rnd(len) + 1 : 0;
+			for (j = 0; j < len; j++)
+				span[j] = wr + j;
+			fifo_write_commit(&fifo, len);
+			wr += len;
+			break;
+		case 3:		/* zero-copy read */
+			len = fifo_read_peek(&fifo, &span);
+			if (len > fill || (len == 0 && fill))
+				goto fail;
+			len = len ? rnd(len) + 1 : 0;
+			for (j = 0; j < len; j++) {
+				if (span[j] != (uint8_t)(rd + j))
+					goto fail;
+			}
+			fifo_read_commit(&fifo, len);
+			rd += len;
+			break;
+		}
+
+		/* watermark crossings of the model */
+		if (fill < hi && wr - rd >= hi)
+			exp_hi++;
+		if (fill > lo && wr - rd <= lo)
+			exp_lo++;
+		if (fifo_available(&fifo) != wr - rd)
+			goto fail;
+	}
+
+	if (events[FIFO_IRQ_LO] != exp_lo || events[FIFO_IRQ_HI] != exp_hi ||
+	    events[FIFO_IRQ_OFLOW] != exp_oflow) {
+		printf("size %u: events lo %u/%u hi %u/%u oflow %u/%u\n", size,
+		       events[FIFO_IRQ_LO], exp_lo, events[FIFO_IRQ_HI],
+		       exp_hi, events[FIFO_IRQ_OFLOW], exp_oflow);
+		return -1;
+	}
+	printf("size %4u: %u ops ok, %u lo / %u hi / %u oflow events\n",
+	       size, CHECK_OPS, exp_lo, exp_hi, exp_oflow);
+	return 0;
+
+fail:
+	printf("size %u: mismatch after %u ops (wr=%lu rd=%lu avail=%u)\n",
+	       size, i, wr, rd, fifo_available(&fifo));
+	return -1;
+}
+
+/* threaded streaming */
+
+static struct fifo stream_fifo;
+static unsigned int chunk_len;
+static int zero_copy;
+static volatile int stream_error;
+
+static void *producer(void *arg)
+{
+	uint8_t buf[FIFO_SIZE], *span;
+	unsigned long sent = 0;
+	unsigned int j, len;
+
+	while (sent < STREAM_BYTES) {
+		if (zero_copy) {
+			len = fifo_write_peek(&stream_fifo, &span);
+			if (len > chunk_len)
+				len = chunk_len;
+			for (j = 0; j < len; j++)
+				span[j] = sent + j;
+			fifo_write_commit(&stream_fifo, len);
+		} else {
+			for (j = 0; j < chunk_len; j++)
+				buf[j] = sent + j;
+			len = fifo_data_put(&stream_fifo, chunk_len, buf);
+		}
+		if (!len)
+			sched_yield();
+		sent += len;
+	}
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	uint8_t buf[FIFO_SIZE], *span;
+	unsigned long rcvd = 0;
+	unsigned int j, len;
+
+	while (rcvd < STREAM_BYTES) {
+		if (zero_copy) {
+			len = fifo_read_peek(&stream_fifo, &span);
+			if (len > chunk_len)
+				len = chunk_len;
+		} else {
+			len = fifo_data_get(&stream_fifo, chunk_len, buf);
+			span = buf;
+		}
+		for (j = 0; j < len; j++) {
+			if (span[j] != (uint8_t)(rcvd + j))
+				stream_error = 1;
+		}
+		if (zero_copy)
+			fifo_read_commit(&stream_fifo, len);
+		if (!len)
+			sched_yield();
+		rcvd += len;
+	}
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int stream(unsigned int chunk, int zc)
+{
+	pthread_t p, c;
+	double t;
+
+	fifo_init(&stream_fifo, FIFO_SIZE, NULL, NULL);
+	chunk_len = chunk;
+	zero_copy = zc;
+	stream_error = 0;
+
+	t = now();
+	pthread_create(&c, NULL, consumer, NULL);
+	pthread_create(&p, NULL, producer, NULL);
+	pthread_join(p, NULL);
+	pthread_join(c, NULL);
+	t = now() - t;
+
+	printf("%-9s chunk %4u: %8.1f MB/s%s\n", zc ? "zero-copy" : "copy",
+	       chunk, STREAM_BYTES / t / 1e6,
+	       stream_error ? "  DATA ERROR" : "");
+	return stream_error ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned int chunks[] = { 16, 64, 256 };
+	struct fifo f;
+	int ret = 0;
+	unsigned int i;
+
+	if (fifo_init(&f, 100, NULL, NULL) == 0 ||
+	    fifo_init(&f, 2 * FIFO_SIZE, NULL, NULL) == 0) {
+		printf("fifo_init accepted an invalid size\n");
+		ret = 1;
+	}
+
+	ret |= check(64) < 0;
+	ret |= check(256) < 0;
+	ret |= check(FIFO_SIZE) < 0;
+
+	for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+		ret |= stream(chunks[i], 0) < 0;
+		ret |= stream(chunks[i], 1) < 0;
+	}
+
+	return ret;
+}
@@ -0,0 +1,174 @@
+/* insn_bench - instructions per call of firmware modules under qemu-arm
+ *
+ * Cross compiled for ARM Linux with the firmware's own compiler flags
+ * (ARMv4T, ARM state, lib/ string functions) and run by insn_bench.py,
+ * which counts the executed instructions with the libinsn plugin of
+ * qemu-arm.  'insn_bench <test> <reps>' runs the setup of a test once,
+ * then the test 'reps' times.  The script runs every test with two
+ * repetition counts, so the startup cost drops out of the difference,
+ * and subtracts the 'empty' test for the loop and the indirect call.
+ *
+ * All inputs are fixed, the counts are exact and the same on every
+ * host.  They are instructions, not cycles: they don't include the wait
+ * states of the flash or the extra cycles of loads, stores and taken
+ * branches.  pit_ticks() and sched_post() are stubs.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <os/fifo.h>
+#include <os/req_ctx.h>
+#include <os/sched.h>
+#include <picc/decoder.h>
+
+#define FIFO_CHUNK	64
+#define DECODE_CHARS	32
+
+extern void req_ctx_init(void);
+extern unsigned int iso_bench_bytes(void);
+extern void iso_bench_trace(void);
+
+static unsigned long sched_pending;
+
+uint32_t pit_ticks(void)
+{
+	return 0;
+}
+
+void sched_post(enum sched_task task)
+{
+	sched_pending |= 1 << task;
+}
+
+static struct fifo fifo;
+static uint8_t fifo_buf[FIFO_CHUNK];
+
+/* samples for DECODE_CHARS characters and the result */
+static uint32_t samples[DECODE_CHARS + 1];
+static char decoded[DECODE_CHARS + 1];
+
+static void empty(void)
+{
+}
+
+static void fifo_setup(void)
+{
+	fifo_init(&fifo, 256, NULL, NULL);
+	memset(fifo_buf, 0x5a, sizeof(fifo_buf));
+}
+
+static void fifo_put_get(void)
+{
+	fifo_data_put(&fifo, FIFO_CHUNK, fifo_buf);
+	fifo_data_get(&fifo, FIFO_CHUNK, fifo_buf);
+}
+
+static void rctx_cycle(void)
+{
+	struct req_ctx *rctx;
+
+	rctx = req_ctx_find_get(0, RCTX_STATE_FREE,
+				RCTX_STATE_MAIN_PROCESSING);
+	req_ctx_set_state(rctx, RCTX_STATE_UDP_EP2_PENDING);
+	req_ctx_put(rctx);
+}
+
+static void miller_setup(void)
+{
+	unsigned int i;
+
+	decoder_init();
+	/* REQA, quad-sampled, see decoder_miller.c */
+	for (i = 0; i < DECODE_CHARS + 1; i++)
+		samples[i] = 0x10410441;
+}
+
+static void nrzl_setup(void)
+{
+	decoder_init();
+	/* every even bit set: each 10 bit window at an even offset has its
+	 * start bit set and its stop bit clear */
+	memset(samples, 0x55, sizeof(samples));
+}
+
+static void miller_decode(void)
+{
+	decoder_decode(DECODER_MILLER, (const char *) samples,
+		       DECODE_CHARS * miller_decoder.bits_per_sampled_char / 8,
+		       decoded);
+}
+
+static void nrzl_decode(void)
+{
+	decoder_decode(DECODER_NRZL, (const char *) samples,
+		       DECODE_CHARS * nrzl_decoder.bits_per_sampled_char / 8,
+		       decoded);
+}
+
+static struct test {
+	const char *name;
+	void (*setup)(void);
+	void (*run)(void);
+	const char *unit;
+	unsigned int per_call;		/* units per call, 0: see main() */
+} tests[] = {
+	{ "empty",	NULL,		&empty,		"call",	1 },
+	{ "fifo",	&fifo_setup,	&fifo_put_get,	"byte",	FIFO_CHUNK },
+	{ "req_ctx",	&req_ctx_init,	&rctx_cycle,	"ctx",	1 },
+	{ "miller",	&miller_setup,	&miller_decode,	"char",	DECODE_CHARS },
+	{ "nrzl",	&nrzl_setup,	&nrzl_decode,	"char",	DECODE_CHARS },
+	{ "iso7816",	&req_ctx_init,	&iso_bench_trace, "byte", 0 },
+};
+
+#define NUM_TESTS	(sizeof(tests) / sizeof(tests[0]))
+
+int main(int argc, char **argv)
+{
+	void (* volatile run)(void);
+	unsigned long i, reps;
+	struct test *t;
+
+	tests[NUM_TESTS - 1].per_call = iso_bench_bytes();
+
+	if (argc < 3) {
+		/* the list for insn_bench.py */
+		for (t = tests; t < tests + NUM_TESTS; t++)
+			printf("%s %s %u\n", t->name, t->unit, t->per_call);
+		return 0;
+	}
+
+	for (t = tests; t < tests + NUM_TESTS; t++) {
+		if (!strcmp(t->name, argv[1]))
+			break;
+	}
+	if (t == tests + NUM_TESTS) {
+		fprintf(stderr, "unknown test %s\n", argv[1]);
+		return 1;
+	}
+	reps = strtoul(argv[2], NULL, 0);
+
+	if (t->setup)
+		t->setup();
+	run = t->run;
+	for (i = 0; i < reps; i++)
+		run();
+
+	return 0;
+}
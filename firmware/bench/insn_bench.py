@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+#
+# insn_bench.py - instructions per call of firmware modules, see insn_bench.c
+#
+# Runs every test of the ARM insn_bench binary under qemu-arm with the
+# libinsn plugin, which counts the executed guest instructions.  Each test
+# is run with N and 2N repetitions, the difference divided by N is the
+# cost of one call, less that of the 'empty' test.
+#
+# usage: insn_bench.py [-p libinsn.so] [-n reps] [-c old.txt] [test ...]
+#
+#	make insn_bench CROSS_COMPILE=arm-linux-gnueabi-
+#	./insn_bench.py -p ~/qemu/build/tests/tcg/plugins/libinsn.so > old.txt
+#	... change the code, rebuild ...
+#	./insn_bench.py -p ... -c old.txt
+#
+# libinsn.so is built with QEMU (tests/tcg/plugins/ since 8.0, before in
+# tests/plugin/), the plugin path can also be given in $QEMU_PLUGIN.
+#
+# (C) 2026 by the OpenPCD developers
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License version 2
+#  as published by the Free Software Foundation
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+
+def count(args, test, reps):
+    """guest instructions of 'insn_bench test reps'"""
+    with tempfile.NamedTemporaryFile(mode='r', suffix='.log') as log:
+        subprocess.run([args.qemu, '-plugin', args.plugin, '-d', 'plugin',
+                        '-D', log.name, args.binary, test, str(reps)],
+                       check=True)
+        found = re.findall(r'insns: (\d+)', log.read())
+    if not found:
+        sys.exit('no instruction count from %s, is it libinsn.so?' %
+                 args.plugin)
+    return int(found[-1])
+
+
+def per_call(args, test):
+    return (count(args, test, 2 * args.reps) -
+            count(args, test, args.reps)) / args.reps
+
+
+def read_old(fname):
+    old = {}
+    with open(fname) as f:
+        for line in f:
+            if line.startswith('#'):
+                continue
+            fields = line.split()
+            old[fields[0]] = float(fields[1])
+    return old
+
+
+def main():
+    ap = argparse.ArgumentParser(description='instructions per call')
+    ap.add_argument('-q', '--qemu', default='qemu-arm')
+    ap.add_argument('-p', '--plugin', default=os.environ.get('QEMU_PLUGIN'),
+                    help='path of libinsn.so')
+    ap.add_argument('-b', '--binary', default='./insn_bench')
+    ap.add_argument('-n', '--reps', type=int, default=1000)
+    ap.add_argument('-c', '--compare', metavar='OLD',
+                    help='output of an earlier run to compare with')
+    ap.add_argument('tests', nargs='*')
+    args = ap.parse_args()
+    if not args.plugin:
+        sys.exit('need the path of libinsn.so (-p or $QEMU_PLUGIN)')
+
+    tests = []
+    out = subprocess.run([args.qemu, args.binary], check=True,
+                         capture_output=True, text=True).stdout
+    for line in out.splitlines():
+        name, unit, per = line.split()
+        tests.append((name, unit, int(per)))
+
+    old = read_old(args.compare) if args.compare else {}
+    base = per_call(args, 'empty')
+
+    print('# %-10s %12s %10s %12s%s' % ('test', 'insns/call', 'per call',
+                                        'insns/unit',
+                                        '  change' if old else ''))
+    for name, unit, per in tests:
+        if name == 'empty' or (args.tests and name not in args.tests):
+            continue
+        insns = per_call(args, name) - base
+        line = '%-12s %12.1f %4u %-5s %12.2f' % (name, insns, per, unit,
+                                                  insns / per)
+        if name in old and old[name]:
+            line += '  %+6.1f%%' % (100.0 * (insns - old[name]) / old[name])
+        print(line)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,108 @@
+/* insn_iso7816 - the SIMtrace ISO 7816-3 receiver for insn_bench
+ *
+ * Built as a SIMTRACE translation unit of its own and includes
+ * iso7816_uart.c, so the static process_byte() can be called directly.
+ * USART0 is replaced by a struct in RAM, the few register writes on
+ * F/D changes land there.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <AT91SAM7.h>
+#include <simtrace/tc_etu.h>
+
+static AT91S_USART bench_us0;
+#undef AT91C_BASE_US0
+#define AT91C_BASE_US0	(&bench_us0)
+
+#include "../src/simtrace/iso7816_uart.c"
+
+/* SIM ATR (T=0, 15 historical bytes and TCK), then SELECT MF and three
+ * READ BINARY with their responses, like a phone talking to its SIM */
+static const uint8_t atr[] = {
+	0x3b, 0x9f, 0x96, 0x80, 0x1f, 0xc7, 0x80, 0x31, 0xe0, 0x73, 0xfe,
+	0x21, 0x1b, 0x63, 0x3a, 0x20, 0x4e, 0x83, 0x00, 0x90, 0x00, 0x5e,
+};
+
+static const uint8_t apdus[][16] = {
+	{ 0xa0, 0xa4, 0x00, 0x00, 0x02, 0xa4, 0x3f, 0x00, 0x9f, 0x16 },
+	{ 0xa0, 0xb0, 0x00, 0x00, 0x04, 0xb0, 0x11, 0x22, 0x33, 0x44,
+	  0x90, 0x00 },
+	{ 0xa0, 0xb0, 0x00, 0x04, 0x04, 0xb0, 0x55, 0x66, 0x77, 0x88,
+	  0x90, 0x00 },
+	{ 0xa0, 0xb0, 0x00, 0x08, 0x04, 0xb0, 0x99, 0xaa, 0xbb, 0xcc,
+	  0x90, 0x00 },
+};
+static const uint8_t apdu_len[] = { 10, 12, 12, 12 };
+
+void tc_etu_set_etu(uint16_t etu)
+{
+}
+
+void tc_etu_set_wtime(uint16_t wtime)
+{
+}
+
+/* only referenced by iso_uart_init() */
+unsigned int AT91F_AIC_ConfigureIt(AT91PS_AIC pAic, unsigned int irq_id,
+				   unsigned int priority,
+				   unsigned int src_type,
+				   void (*newHandler) ())
+{
+	return 0;
+}
+
+void pio_irq_enable(uint32_t pio)
+{
+}
+
+int pio_irq_register(uint32_t pio, irq_handler_t *func)
+{
+	return 0;
+}
+
+/* bytes of one iso_bench_trace() */
+unsigned int iso_bench_bytes(void)
+{
+	unsigned int i, n = sizeof(atr);
+
+	for (i = 0; i < sizeof(apdu_len); i++)
+		n += apdu_len[i];
+	return n;
+}
+
+/* card reset, ATR and APDUs, each ended by the waiting time expiring.
+ * The USB side hands the sent req_ctx back like udp_refill_ep() would. */
+void iso_bench_trace(void)
+{
+	struct req_ctx *rctx;
+	unsigned int i, j;
+
+	set_state(&isoh, ISO7816_S_WAIT_ATR);
+	for (i = 0; i < sizeof(atr); i++)
+		process_byte(&isoh, atr[i]);
+	iso7816_wtime_expired();
+
+	for (i = 0; i < sizeof(apdu_len); i++) {
+		for (j = 0; j < apdu_len[i]; j++)
+			process_byte(&isoh, apdus[i][j]);
+		iso7816_wtime_expired();
+	}
+
+	while ((rctx = req_ctx_find_get(0, RCTX_STATE_UDP_EP2_PENDING,
+					RCTX_STATE_UDP_EP2_BUSY)))
+		req_ctx_put(rctx);
+}
@@ -0,0 +1,229 @@
+/* string_bench - check and benchmark the ARM string functions of lib/
+ *
+ * Cross compiled for ARM Linux and run under qemu-arm (user mode), see
+ * the Makefile.  lib/memcpy.S, memset.S and memmove.S are assembled with
+ * an fw_ prefix, so they don't clash with the C library.  Lengths up to
+ * 1024 bytes are checked for all source and destination alignments
+ * against a byte loop (every length up to 300, then in steps of 31),
+ * including the bytes around the destination and the return value,
+ * memmove also for overlaps in both directions.
+ * __raw_readsb() and __raw_writesb() are run against a RAM word.
+ *
+ * The times are those of the emulator and only good for comparing the
+ * implementations with each other, the firmware measures real cycles for
+ * OPENPCD_CMD_USBTEST_MEM (host/opcd_bench -t mem).
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <asm/io.h>
+
+#define MAX_LEN		1024
+#define GUARD		8
+#define BENCH_BYTES	(4 * 1024 * 1024)
+
+extern void *fw_memcpy(void *dest, const void *src, size_t n);
+extern void *fw_memmove(void *dest, const void *src, size_t n);
+extern void *fw_memset(void *s, int c, size_t n);
+
+static uint8_t src[MAX_LEN + 3 * GUARD] __attribute__ ((aligned (4)));
+static uint8_t dst[MAX_LEN + 3 * GUARD] __attribute__ ((aligned (4)));
+static uint8_t ref[MAX_LEN + 3 * GUARD] __attribute__ ((aligned (4)));
+static unsigned long errors;
+
+static void byte_copy(uint8_t *d, const uint8_t *s, size_t len)
+{
+	while (len--) {
+		*d++ = *s++;
+		/* keep gcc from turning the loop into a memcpy() call */
+		asm volatile("" : : : "memory");
+	}
+}
+
+static void fail(const char *fn, size_t len, int a, int b)
+{
+	if (errors++ < 10)
+		fprintf(stderr, "%s: len %zu, %d/%d wrong\n", fn, len, a, b);
+}
+
+static void fill(uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = rand();
+}
+
+static void check_memcpy(size_t len, int sa, int da)
+{
+	uint8_t *d = dst + GUARD + da;
+
+	fill(dst, sizeof(dst));
+	memcpy(ref, dst, sizeof(ref));
+	byte_copy(ref + GUARD + da, src + GUARD + sa, len);
+	if (fw_memcpy(d, src + GUARD + sa, len) != d ||
+	    memcmp(dst, ref, sizeof(dst)))
+		fail("memcpy", len, sa, da);
+}
+
+static void check_memmove(size_t len, int sa, int off)
+{
+	uint8_t *s = dst + GUARD + sa, *d = s + off;
+	size_t i;
+
+	fill(dst, sizeof(dst));
+	memcpy(ref, dst, sizeof(ref));
+	if (off > 0) {
+		for (i = len; i > 0; i--)
+			ref[GUARD + sa + off + i - 1] = ref[GUARD + sa + i - 1];
+	} else
+		byte_copy(ref + GUARD + sa + off, ref + GUARD + sa, len);
+	if (fw_memmove(d, s, len) != d || memcmp(dst, ref, sizeof(dst)))
+		fail("memmove", len, sa, off);
+}
+
+static void check_memset(size_t len, int da)
+{
+	uint8_t *d = dst + GUARD + da;
+	int c = rand();
+
+	fill(dst, sizeof(dst));
+	memcpy(ref, dst, sizeof(ref));
+	memset(ref + GUARD + da, c & 0xff, len);
+	if (fw_memset(d, c, len) != d || memcmp(dst, ref, sizeof(dst)))
+		fail("memset", len, da, c);
+}
+
+static void check_fifo(size_t len, int da)
+{
+	volatile uint32_t fifo = 0xa5;
+	uint8_t *d = dst + GUARD + da;
+
+	fill(dst, sizeof(dst));
+	memcpy(ref, dst, sizeof(ref));
+	memset(ref + GUARD + da, 0xa5, len);
+	__raw_readsb(&fifo, d, len);
+	if (memcmp(dst, ref, sizeof(dst)))
+		fail("readsb", len, da, 0);
+
+	fill(d, len);
+	__raw_writesb(&fifo, d, len);
+	if (len && (fifo & 0xff) != d[len - 1])
+		fail("writesb", len, da, 0);
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+enum fn {
+	FN_BYTE_LOOP, FN_LIBC_MEMCPY, FN_MEMCPY, FN_MEMCPY_UNALIGNED,
+	FN_MEMMOVE, FN_MEMSET, FN_WRITESB, FN_READSB, FN_NUM
+};
+
+static const char *fn_names[FN_NUM] = {
+	"byte loop", "libc memcpy", "memcpy", "memcpy +1", "memmove",
+	"memset", "writesb", "readsb",
+};
+
+/* nanoseconds per call on 'len' bytes */
+static double bench(enum fn fn, size_t len)
+{
+	unsigned long i, reps = BENCH_BYTES / (len + 16);
+	volatile uint32_t fifo = 0;
+	double t0 = now_ns();
+
+	for (i = 0; i < reps; i++) {
+		switch (fn) {
+		case FN_BYTE_LOOP:
+			byte_copy(dst, src, len);
+			break;
+		case FN_LIBC_MEMCPY:
+			memcpy(dst, src, len);
+			break;
+		case FN_MEMCPY:
+			fw_memcpy(dst, src, len);
+			break;
+		case FN_MEMCPY_UNALIGNED:
+			fw_memcpy(dst, src + 1, len);
+			break;
+		case FN_MEMMOVE:
+			fw_memmove(src + 4, src, len);
+			break;
+		case FN_MEMSET:
+			fw_memset(dst, i, len);
+			break;
+		case FN_WRITESB:
+			__raw_writesb(&fifo, src, len);
+			break;
+		case FN_READSB:
+			__raw_readsb(&fifo, dst, len);
+			break;
+		default:
+			break;
+		}
+	}
+
+	return (now_ns() - t0) / reps;
+}
+
+int main(int argc, char **argv)
+{
+	static const size_t lens[] = { 4, 16, 64, 256, 960 };
+	size_t len;
+	unsigned int i;
+	int a, b;
+
+	srand(1);
+	fill(src, sizeof(src));
+
+	for (len = 0; len <= MAX_LEN; len += len < 300 ? 1 : 31) {
+		for (a = 0; a < 4; a++) {
+			for (b = 0; b < 4; b++)
+				check_memcpy(len, a, b);
+			for (b = -GUARD; b <= GUARD; b++)
+				check_memmove(len, a, b);
+			check_memset(len, a);
+			check_fifo(len, a);
+		}
+	}
+	printf("checked lengths 0..%u: %lu errors\n", MAX_LEN, errors);
+
+	printf("%-8s", "ns/call");
+	for (i = 0; i < FN_NUM; i++)
+		printf(" %12s", fn_names[i]);
+	printf("\n");
+	for (i = 0; i < sizeof(lens)/sizeof(lens[0]); i++) {
+		enum fn fn;
+
+		printf("%-8zu", lens[i]);
+		for (fn = 0; fn < FN_NUM; fn++)
+			printf(" %12.1f", bench(fn, lens[i]));
+		printf("\n");
+	}
+
+	return errors ? 1 : 0;
+}
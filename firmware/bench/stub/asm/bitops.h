@@ -0,0 +1,8 @@
+#ifndef __ASM_ARM_BITOPS_H
+#define __ASM_ARM_BITOPS_H
+
+/* Host build of firmware modules: nothing from here is used natively */
+
+#include <asm/system.h>
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __ASM_ARM_SYSTEM_H
+#define __ASM_ARM_SYSTEM_H
+
+/* Host build of firmware modules: there are no interrupts to lock out */
+
+#define local_irq_save(x)	do { (x) = 0; } while (0)
+#define local_irq_restore(x)	do { (void) (x); } while (0)
+#define local_irq_enable()	do { } while (0)
+#define local_irq_disable()	do { } while (0)
+#define local_fiq_enable()	do { } while (0)
+#define local_fiq_disable()	do { } while (0)
+#define local_save_flags(x)	do { (x) = 0; } while (0)
+#define irqs_disabled()		0
+
+#endif
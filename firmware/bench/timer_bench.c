@@ -0,0 +1,220 @@
+/* timer_bench - check and benchmark the software timers of pit.c
+ *
+ * Builds the timer wheel of pit.c natively and drives it from a virtual
+ * jiffies counter with hundreds of armed timers.  Callbacks re-arm their
+ * timer, and on every tick some timers are cancelled or moved, like
+ * protocol timeouts being restarted.  Every timer has to fire exactly at
+ * its expiry.  The same workload is run through the sorted list that
+ * pit.c used before (with its insertion fixed to stop at the right spot
+ * and to append at the tail), reporting the time per tick and per
+ * add/del.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <os/pit.h>
+#include <os/system_irq.h>
+
+#define TICKS		200000
+#define MAX_TIMERS	1000
+#define OPS_PER_TICK	4
+
+/* pit.c registers its interrupt handler, which is never called here */
+void sysirq_register(enum sysirqs irq, sysirq_hdlr *hdlr)
+{
+}
+
+/* the sorted list of the old pit.c */
+static struct timer_list *timers;
+
+static void list_insert(struct timer_list *new)
+{
+	struct timer_list *tl, **prev = &timers;
+
+	for (tl = timers; tl && tl->expires <= new->expires; tl = tl->next)
+		prev = &tl->next;
+	new->next = tl;
+	*prev = new;
+}
+
+static int list_remove(struct timer_list *old)
+{
+	struct timer_list *tl, **prev = &timers;
+
+	for (tl = timers; tl; tl = tl->next) {
+		if (tl == old) {
+			*prev = tl->next;
+			return 1;
+		}
+		prev = &tl->next;
+	}
+	return 0;
+}
+
+static void list_add(struct timer_list *tl)
+{
+	list_remove(tl);
+	list_insert(tl);
+}
+
+static void list_run(void)
+{
+	struct timer_list *tl;
+
+	while ((tl = timers) && tl->expires <= jiffies) {
+		timers = tl->next;
+		tl->function(tl->data);
+	}
+}
+
+static const struct impl {
+	const char *name;
+	void (*add)(struct timer_list *tl);
+	int (*del)(struct timer_list *tl);
+	void (*run)(void);
+} impls[] = {
+	{ "sorted list", list_add, list_remove, list_run },
+	{ "timer wheel", timer_add, timer_del, timer_run },
+};
+
+static const struct impl *impl;
+static struct timer_list tl[MAX_TIMERS];
+static unsigned long fired, errors;
+static unsigned long rnd_state;
+static double t_add, t_run;
+static unsigned long n_add;
+
+static unsigned int rnd(unsigned int max)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return (rnd_state >> 8) % max;
+}
+
+/* mostly short timeouts, some beyond the reach of the wheel */
+static unsigned long rnd_delay(void)
+{
+	switch (rnd(8)) {
+	case 0:
+		return 1 + rnd(100000);
+	case 1:
+	case 2:
+		return 1 + rnd(2000);
+	default:
+		return 1 + rnd(50);
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void arm(struct timer_list *t)
+{
+	double t0 = now_ns();
+
+	t->expires = jiffies + rnd_delay();
+	impl->add(t);
+	t_add += now_ns() - t0;
+	n_add++;
+}
+
+static void expired(void *data)
+{
+	struct timer_list *t = data;
+
+	fired++;
+	if (t->expires != jiffies) {
+		if (errors++ < 10)
+			fprintf(stderr, "%s: timer %u for %lu fired at %lu\n",
+				impl->name, (unsigned int) (t - tl),
+				t->expires, jiffies);
+	}
+	arm(t);
+}
+
+static int run(const struct impl *i, unsigned int num)
+{
+	unsigned long tick;
+	unsigned int j;
+
+	impl = i;
+	fired = errors = n_add = 0;
+	t_add = t_run = 0;
+	rnd_state = num;
+
+	for (j = 0; j < num; j++) {
+		memset(&tl[j], 0, sizeof(tl[j]));
+		tl[j].function = expired;
+		tl[j].data = &tl[j];
+		arm(&tl[j]);
+	}
+
+	for (tick = 0; tick < TICKS; tick++) {
+		double t0;
+
+		for (j = 0; j < OPS_PER_TICK; j++) {
+			struct timer_list *t = &tl[rnd(num)];
+
+			if (rnd(4)) {
+				arm(t);
+			} else {
+				impl->del(t);
+				arm(t);
+			}
+		}
+
+		jiffies++;
+		t0 = now_ns();
+		impl->run();
+		t_run += now_ns() - t0;
+	}
+
+	for (j = 0; j < num; j++)
+		impl->del(&tl[j]);
+
+	printf("  %-12s %6u %10lu %10.1f %10.1f %8lu\n", impl->name, num,
+	       fired, t_run / TICKS, t_add / n_add, errors);
+
+	return errors ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned int nums[] = { 10, 100, 300, 1000 };
+	unsigned int i, j;
+	int ret = 0;
+
+	printf("%u ticks, %u re-arms per tick\n", TICKS, OPS_PER_TICK);
+	printf("  %-12s %6s %10s %10s %10s %8s\n", "impl", "timers", "fired",
+	       "ns/tick", "ns/add", "errors");
+	for (i = 0; i < sizeof(nums)/sizeof(nums[0]); i++) {
+		for (j = 0; j < sizeof(impls)/sizeof(impls[0]); j++) {
+			if (run(&impls[j], nums[i]) < 0)
+				ret = 1;
+		}
+	}
+
+	return ret;
+}
@@ -0,0 +1,336 @@
+/* usb_prio_sim - host simulation of the USB command dispatcher
+ *
+ * Builds the real usb_handler.c and req_ctx.c natively and feeds them a
+ * synthetic mix of requests on a virtual time base.  Handlers burn
+ * virtual time instead of talking to hardware.  The same workload is run
+ * once with FIFO dispatch and synchronous flash writes (the old
+ * behaviour) and once with class priorities and deferred completion,
+ * reporting the command latency per class.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openpcd.h>
+#include <os/req_ctx.h>
+#include <os/usb_handler.h>
+#include <os/sched.h>
+#include <os/boot.h>
+
+extern void req_ctx_init(void);
+
+/* all times in microseconds */
+#define SIM_DURATION	(20 * 1000 * 1000)
+#define COST_CONTROL	30
+#define COST_TRANSCEIVE	4000
+#define COST_BULK	1500
+#define COST_SETENV	100
+#define COST_FLASH	8000	/* page programming */
+#define COST_POLL	2
+#define COST_MAINLOOP	5
+
+enum sim_type {
+	SIM_CONTROL,
+	SIM_TRANSCEIVE,
+	SIM_BULK,
+	SIM_SETENV,
+	SIM_TYPES
+};
+
+static const struct {
+	const char *name;
+	uint8_t cmd;
+	unsigned int interval;		/* mean time between requests */
+} sim_types[SIM_TYPES] = {
+	[SIM_CONTROL]	 = { "control", OPENPCD_CMD_GET_API_VERSION, 2000 },
+	[SIM_TRANSCEIVE] = { "transceive", OPENPCD_CMD_READ_FIFO, 10000 },
+	[SIM_BULK]	 = { "bulk", OPENPCD_CMD_USBTEST_IN, 5000 },
+	[SIM_SETENV]	 = { "setenv", OPENPCD_CMD_SET_ENVIRONMENT, 200000 },
+};
+
+static unsigned long long now;
+static unsigned long long flash_ready;
+static int use_defer;
+
+/* requests the host wants to send, the device NAKs while out of req_ctx */
+#define HOST_QUEUE	4096
+static struct {
+	unsigned long long t;
+	enum sim_type type;
+} host_q[HOST_QUEUE];
+static unsigned int host_head, host_tail;
+static unsigned long long next_arrival[SIM_TYPES];
+static int arrivals_stopped;
+
+static unsigned long long rctx_arrival[256];
+
+static struct {
+	unsigned long long *lat;
+	unsigned int num, alloc;
+} stats[SIM_TYPES];
+
+/* one stream per type, so both runs see the same arrivals */
+static unsigned long rnd_state[SIM_TYPES];
+
+static unsigned int rnd_interval(enum sim_type type)
+{
+	unsigned int mean = sim_types[type].interval;
+
+	/* uniform in [mean/2, 3*mean/2), good enough for a mix */
+	rnd_state[type] = rnd_state[type] * 1103515245 + 12345;
+	return mean / 2 + ((rnd_state[type] >> 8) % mean);
+}
+
+static enum sim_type cmd2type(uint8_t cmd)
+{
+	int i;
+
+	for (i = 0; i < SIM_TYPES; i++) {
+		if (sim_types[i].cmd == cmd)
+			return i;
+	}
+	return SIM_CONTROL;
+}
+
+/* generate host requests up to 'now' and hand them to free req_ctx,
+ * this is what the UDP endpoint 1 interrupt would do */
+static void sim_deliver(void)
+{
+	struct req_ctx *rctx;
+	int i;
+
+	for (i = 0; i < SIM_TYPES && !arrivals_stopped; i++) {
+		while (next_arrival[i] <= now) {
+			host_q[host_head % HOST_QUEUE].t = next_arrival[i];
+			host_q[host_head % HOST_QUEUE].type = i;
+			host_head++;
+			next_arrival[i] += rnd_interval(i);
+		}
+	}
+
+	while (host_tail != host_head) {
+		struct openpcd_hdr *poh;
+
+		rctx = req_ctx_find_get(0, RCTX_STATE_FREE,
+					RCTX_STATE_UDP_RCV_BUSY);
+		if (!rctx)
+			break;
+
+		poh = (struct openpcd_hdr *) rctx->data;
+		poh->cmd = sim_types[host_q[host_tail % HOST_QUEUE].type].cmd;
+		poh->flags = OPENPCD_FLAG_RESPOND;
+		poh->reg = poh->val = 0;
+		rctx->tot_len = sizeof(*poh) + 16;
+		rctx_arrival[req_ctx_num(rctx)] =
+				host_q[host_tail % HOST_QUEUE].t;
+		host_tail++;
+		req_ctx_set_state(rctx, RCTX_STATE_UDP_RCV_DONE);
+	}
+}
+
+static void sim_busy(unsigned int usec)
+{
+	now += usec;
+	sim_deliver();
+}
+
+static unsigned long long sim_next_arrival(void)
+{
+	unsigned long long t = ~0ULL;
+	int i;
+
+	for (i = 0; i < SIM_TYPES; i++) {
+		if (next_arrival[i] < t)
+			t = next_arrival[i];
+	}
+	return t;
+}
+
+/* stubs for pcd_enumerate.c: responses are complete once queued */
+void udp_refill_ep(int ep)
+{
+	struct req_ctx *rctx;
+
+	while ((rctx = req_ctx_find_get(0, RCTX_STATE_UDP_EP2_PENDING,
+					RCTX_STATE_UDP_EP2_BUSY))) {
+		struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+		enum sim_type type = cmd2type(poh->cmd);
+
+		if (stats[type].num == stats[type].alloc) {
+			stats[type].alloc = stats[type].alloc * 2 + 1024;
+			stats[type].lat = realloc(stats[type].lat,
+					stats[type].alloc * sizeof(*stats[type].lat));
+			if (!stats[type].lat)
+				exit(1);
+		}
+		stats[type].lat[stats[type].num++] =
+				now - rctx_arrival[req_ctx_num(rctx)];
+		req_ctx_put(rctx);
+	}
+}
+
+void udp_unthrottle(void)
+{
+}
+
+/* req_ctx statistics use the virtual time base */
+uint32_t pit_ticks(void)
+{
+	return now;
+}
+
+void frec_log_at(uint32_t stamp, uint8_t type, uint8_t arg8, uint16_t arg16)
+{
+}
+
+/* the simulation loop calls usb_in_process() itself */
+void sched_post(enum sched_task task)
+{
+}
+
+void boot_mark(enum openpcd_boot_phase phase)
+{
+}
+
+static int setenv_cont(struct req_ctx *rctx)
+{
+	if (now < flash_ready) {
+		sim_busy(COST_POLL);
+		return usb_defer(rctx, &setenv_cont);
+	}
+	sim_busy(COST_SETENV);
+	flash_ready = now + COST_FLASH;
+	return USB_RET_RESPOND;
+}
+
+static int sim_generic_rx(struct req_ctx *rctx)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+
+	if (poh->cmd != OPENPCD_CMD_SET_ENVIRONMENT) {
+		sim_busy(COST_CONTROL);
+		return USB_RET_RESPOND;
+	}
+
+	if (use_defer)
+		return usb_defer(rctx, &setenv_cont);
+
+	/* old behaviour: busy wait for the flash controller */
+	if (now < flash_ready)
+		sim_busy(flash_ready - now);
+	sim_busy(COST_SETENV);
+	flash_ready = now + COST_FLASH;
+	return USB_RET_RESPOND;
+}
+
+static int sim_rc632_rx(struct req_ctx *rctx)
+{
+	sim_busy(COST_TRANSCEIVE);
+	return USB_RET_RESPOND;
+}
+
+static int sim_usbtest_rx(struct req_ctx *rctx)
+{
+	sim_busy(COST_BULK);
+	return USB_RET_RESPOND;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	const unsigned long long *x = a, *y = b;
+
+	if (*x < *y)
+		return -1;
+	return *x > *y;
+}
+
+static void sim_run(const char *name, int prio)
+{
+	int i;
+
+	memset(stats, 0, sizeof(stats));
+	now = flash_ready = 0;
+	host_head = host_tail = 0;
+	arrivals_stopped = 0;
+	use_defer = prio;
+	for (i = 0; i < SIM_TYPES; i++) {
+		rnd_state[i] = i + 1;
+		next_arrival[i] = rnd_interval(i);
+	}
+
+	req_ctx_init();
+	usb_hdlr_register(&sim_generic_rx, OPENPCD_CMD_CLS_GENERIC);
+	usb_hdlr_register(&sim_rc632_rx, OPENPCD_CMD_CLS_RC632);
+	usb_hdlr_register(&sim_usbtest_rx, OPENPCD_CMD_CLS_USBTEST);
+	usb_hdlr_set_prio(OPENPCD_CMD_CLS_GENERIC,
+			  prio ? USB_PRIO_HIGH : USB_PRIO_NORMAL);
+	usb_hdlr_set_prio(OPENPCD_CMD_CLS_RC632, USB_PRIO_NORMAL);
+	usb_hdlr_set_prio(OPENPCD_CMD_CLS_USBTEST,
+			  prio ? USB_PRIO_BULK : USB_PRIO_NORMAL);
+
+	/* main loop, until all requests are answered */
+	while (1) {
+		if (now >= SIM_DURATION)
+			arrivals_stopped = 1;
+
+		sim_deliver();
+		usb_in_process();
+
+		if (arrivals_stopped && host_tail == host_head &&
+		    !req_ctx_count(RCTX_STATE_UDP_RCV_DONE) &&
+		    !req_ctx_count(RCTX_STATE_MAIN_PROCESSING))
+			break;
+
+		/* idle main loop: skip ahead to the next request */
+		if (!arrivals_stopped && host_tail == host_head &&
+		    !req_ctx_count(RCTX_STATE_MAIN_PROCESSING) &&
+		    sim_next_arrival() > now)
+			now = sim_next_arrival();
+		else
+			sim_busy(COST_MAINLOOP);
+	}
+
+	printf("%s:\n", name);
+	printf("  %-12s %8s %10s %10s %10s %10s\n", "class", "count",
+	       "mean_us", "p99_us", "p999_us", "max_us");
+	for (i = 0; i < SIM_TYPES; i++) {
+		unsigned long long sum = 0;
+		unsigned int j, n = stats[i].num;
+
+		if (!n)
+			continue;
+		qsort(stats[i].lat, n, sizeof(*stats[i].lat), cmp_ull);
+		for (j = 0; j < n; j++)
+			sum += stats[i].lat[j];
+		printf("  %-12s %8u %10llu %10llu %10llu %10llu\n",
+		       sim_types[i].name, n, sum / n,
+		       stats[i].lat[(n - 1) * 99 / 100],
+		       stats[i].lat[(n - 1) * 999 / 1000],
+		       stats[i].lat[n - 1]);
+		free(stats[i].lat);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	sim_run("fifo dispatch, synchronous flash writes", 0);
+	sim_run("class priorities, deferred flash writes", 1);
+
+	return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef __ASM_ARM_IO_H
+#define __ASM_ARM_IO_H
+
+/* Copy between memory and a byte wide FIFO register, such as UDP_FDR.
+ * The buffer side is accessed a word at a time, see lib/io-*sb.S */
+extern void __raw_readsb(const volatile void *reg, void *buf, int len);
+extern void __raw_writesb(volatile void *reg, const void *buf, int len);
+
+#endif
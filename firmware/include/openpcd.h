@@ -36,6 +36,9 @@ enum openpcd_cmd_class {
         OPENPCD_CMD_CLS_PRESENCE        = 0x7,
 	/* SIM SCAN */
 	OPENPCD_CMD_CLS_SIM		= 0x8,
+	/* firmware debug log */
+	OPENPCD_CMD_CLS_DEBUG		= 0x9,
+	OPENPCD_CMD_CLS_PROFILE		= 0xa,
 	/* PICC (transponder) side */
 	OPENPCD_CMD_CLS_PICC		= 0xe,
 
@@ -54,9 +57,144 @@ enum openpcd_cmd_class {
 #define OPENPCD_CMD_SET_LED		(0x2|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
 #define OPENPCD_CMD_GET_SERIAL		(0x3|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
 #define OPENPCD_CMD_GET_API_VERSION	(0x4|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
+/* The environment is kept in the last flash page (128 bytes on the
+ * SAM7S64, 256 on the SAM7S256).  GET_ENVIRONMENT and SET_ENVIRONMENT
+ * reach all of it but the last 32bit word, which holds the default
+ * application of main_multi firmware (OPENPCD_CMD_APP). */
 #define OPENPCD_CMD_GET_ENVIRONMENT	(0x5|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
 #define OPENPCD_CMD_SET_ENVIRONMENT	(0x6|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
 #define OPENPCD_CMD_RESET		(0x7|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
+#define OPENPCD_CMD_BATCH		(0x8|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
+
+/* OPENPCD_CMD_BATCH: the payload is a sequence of records, each one a
+ * 16 bit little endian length followed by a complete openpcd_hdr
+ * (+ payload) of that length.  A zero length, or less than two bytes
+ * left (padding), terminates the sequence.  The commands are executed
+ * in order until the first error.  Responses are returned the same way
+ * in one or more BATCH replies, where 'val' is the number of commands
+ * executed so far and 'reg' is set to OPENPCD_BATCH_MORE if another
+ * reply follows.  Commands that complete later (SET_ENVIRONMENT, APP,
+ * ADC_READ) and BATCH itself are not executed inside a batch, they get
+ * a header-only response with USB_ERR_NO_BATCH and end the batch. */
+#define OPENPCD_BATCH_MORE		0x01
+
+/* OPENPCD_CMD_RCTX_STATS: 'reg' is the req_ctx state, set 'val' to
+ * OPENPCD_RCTX_STATS_CLEAR to restart the statistics after reading.
+ * The reply carries struct openpcd_rctx_stats, 'val' is the number
+ * of states.  hist[0] counts visits shorter than 2us, hist[i] those of
+ * 2^i to 2^(i+1)-1 us and the last bucket everything longer */
+#define OPENPCD_CMD_RCTX_STATS		(0x9|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
+#define OPENPCD_RCTX_STATS_CLEAR	0x01
+
+#define OPENPCD_RCTX_HIST_LEN		16
+struct openpcd_rctx_stats {
+	uint8_t count;			/* contexts in this state now */
+	uint8_t max;			/* high watermark of count */
+	uint16_t res;
+	uint32_t enter;			/* transitions into this state */
+	uint32_t hist[OPENPCD_RCTX_HIST_LEN];	/* time in state */
+} __attribute__ ((packed));
+
+/* OPENPCD_CMD_EVENTS: asynchronous events on the interrupt endpoint.
+ * 'val' is the number of records, 'reg' the number of events lost since
+ * the previous packet (saturating at 255).  Each record is a length
+ * byte, a count byte and an openpcd_hdr (+ payload) of that length.
+ * 'count' is the number of identical events merged into the record,
+ * their 'val' (and payload) have been ORed together. */
+#define OPENPCD_CMD_EVENTS		(0xa|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
+
+/* OPENPCD_CMD_FREC_READ: read page 'reg' of the flight recorder, oldest
+ * entries first.  The reply carries struct openpcd_frec_hdr followed by
+ * 'val' entries.  'val' of the request holds OPENPCD_FREC_* flags: FREEZE
+ * stops recording before the page is read, RESUME restarts it and CLEAR
+ * discards all entries afterwards.  Recording is frozen after a watchdog
+ * reset until the host resumes it. */
+#define OPENPCD_CMD_FREC_READ		(0xb|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
+#define OPENPCD_FREC_FREEZE		0x01
+#define OPENPCD_FREC_RESUME		0x02
+#define OPENPCD_FREC_CLEAR		0x04
+#define OPENPCD_FREC_PAGE		32	/* entries per page */
+
+struct openpcd_frec_hdr {
+	uint16_t num;			/* valid entries in the recorder */
+	uint8_t flags;			/* OPENPCD_FREC_FREEZE if frozen */
+	uint8_t reset;			/* RSTC reset type of the last boot */
+	uint32_t boots;			/* since the recorder was cleared */
+} __attribute__ ((packed));
+
+/* entry types and their arguments */
+enum openpcd_frec_type {
+	OPENPCD_FREC_BOOT = 1,		/* reset type, boots */
+	OPENPCD_FREC_IRQ_ENTER,		/* AIC source, cause */
+	OPENPCD_FREC_IRQ_EXIT,		/* AIC source */
+	OPENPCD_FREC_RCTX,		/* new state, rctx << 8 | old state */
+	OPENPCD_FREC_USB_EP,		/* endpoint, transfer length */
+	OPENPCD_FREC_USB_STATE,		/* device state (enum usb_device_state) */
+	OPENPCD_FREC_STATE,		/* OPENPCD_FREC_SM_*, new state */
+	OPENPCD_FREC_WDT,		/* watchdog status */
+};
+
+/* OPENPCD_FREC_USB_EP: req_ctx exhausted, packet left in the FIFO */
+#define OPENPCD_FREC_EP_NO_RCTX		0x40
+
+/* state machines for OPENPCD_FREC_STATE */
+#define OPENPCD_FREC_SM_ISO7816		0x01
+
+struct openpcd_frec_entry {
+	uint32_t stamp;			/* microseconds, see pit_ticks() */
+	uint8_t type;
+	uint8_t arg8;
+	uint16_t arg16;
+} __attribute__ ((packed));
+
+/* OPENPCD_CMD_LA_CTRL: start capturing edges on the PIOA lines of the
+ * 32bit mask in the payload, or stop without payload (or a zero mask).
+ * The edges arrive on the bulk IN pipe as OPENPCD_CMD_LA_DATA: 'val'
+ * struct openpcd_pio_edge follow the header, 'reg' is the number of edges
+ * lost before them (saturating at 255).  The first record has 'pio' 0 and
+ * the levels at the start of the capture.  A record is sent every 50ms,
+ * possibly with no edges, and all data before the reply to stop. */
+#define OPENPCD_CMD_LA_CTRL		(0xc|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
+#define OPENPCD_CMD_LA_DATA		(0xd|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
+
+/* OPENPCD_CMD_GET_BOOT_TIMES: the reply carries struct
+ * openpcd_boot_times, microseconds since main() started the timebase at
+ * which each phase of the boot was first reached.  The clock setup and
+ * the copy of .data before main() take about 2ms and aren't included. */
+#define OPENPCD_CMD_GET_BOOT_TIMES	(0xe|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
+
+enum openpcd_boot_phase {
+	OPENPCD_BOOT_MAIN,		/* main() entered */
+	OPENPCD_BOOT_DBGU,		/* debug unit set up */
+	OPENPCD_BOOT_SYS,		/* PIT, watchdog, flight recorder */
+	OPENPCD_BOOT_USB_OPEN,		/* pull-up on, host may enumerate */
+	OPENPCD_BOOT_APP_INIT,		/* _init_func() returned */
+	OPENPCD_BOOT_SCHED,		/* main loop entered */
+	OPENPCD_BOOT_USB_RESET,		/* first bus reset */
+	OPENPCD_BOOT_USB_ADDRESS,	/* SET_ADDRESS */
+	OPENPCD_BOOT_USB_CONFIGURED,	/* SET_CONFIGURATION */
+	OPENPCD_BOOT_LATE_INIT,		/* deferred init done (FASTBOOT) */
+	OPENPCD_BOOT_FIRST_REQ,		/* first request dispatched */
+	OPENPCD_BOOT_NUM
+};
+
+#define OPENPCD_BOOT_FAST		0x01	/* built with FASTBOOT=1 */
+
+struct openpcd_boot_times {
+	uint32_t reached;		/* bit mask of the phases reached */
+	uint32_t flags;			/* OPENPCD_BOOT_FAST */
+	uint32_t stamp[OPENPCD_BOOT_NUM];
+} __attribute__ ((packed));
+
+/* OPENPCD_CMD_APP: applications of an image built with TARGET=main_multi.
+ * The reply lists their names, each terminated by a NUL, 'val' is the
+ * running application and 'reg' the default one.  OPENPCD_APP_DEFAULT in
+ * 'reg' of the request makes application 'val' the default, it is kept
+ * in the last word of the environment.  OPENPCD_APP_SELECT resets the
+ * device into application 'val' shortly after the reply, once. */
+#define OPENPCD_CMD_APP			(0xf|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_GENERIC))
+#define OPENPCD_APP_SELECT		0x01
+#define OPENPCD_APP_DEFAULT		0x02
 
 /* CMD_CLS_RC632 */
 #define OPENPCD_CMD_WRITE_REG		(0x1|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_RC632))
@@ -71,6 +209,9 @@ enum openpcd_cmd_class {
 #define OPENPCD_CMD_IRQ			(0xa|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_RC632))
 #define OPENPCD_CMD_WRITE_REG_SET	(0xb|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_RC632))
 
+/* READ_VFIFO response: 'val' is the number of bytes returned, 'reg' flags */
+#define OPENPCD_VFIFO_OFLOW		0x01	/* received bytes were dropped */
+
 /* CMD_CLS_SSC */
 #define OPENPCD_CMD_SSC_READ		(0x1|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_SSC))
 #define OPENPCD_CMD_SSC_WRITE		(0x2|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_SSC))
@@ -95,13 +236,97 @@ enum openpcd_cmd_class {
 /* CMD_CLS_LIBRFID */
 #define OPENPCD_CMD_PRESENCE_UID_GET    (0x1|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_PRESENCE))
 
+/* CMD_CLS_DEBUG */
+/* Read the next chunk of the debug log.  The payload is the same byte
+ * stream that goes to the DBGU serial port (text, or binary records with
+ * DEBUG_BINLOG), it may end in the middle of a message.  'reg' in the
+ * response is the number of messages dropped since the last read, 'val'
+ * the number of pad bytes after the log data. */
+#define OPENPCD_CMD_DEBUG_LOG_READ	(0x1|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_DEBUG))
+/* with 'reg' != 0 set the log routing to 'val', the response always has
+ * the previous setting */
+#define OPENPCD_CMD_DEBUG_LOG_CTRL	(0x2|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_DEBUG))
+
+#define OPENPCD_DEBUG_LOG_USB		0x01	/* keep a copy for USB */
+#define OPENPCD_DEBUG_LOG_NOSERIAL	0x02	/* don't send to DBGU */
+
+/* log level mask of module 'reg' (enum debug_module in the firmware),
+ * set to the low bits of 'val' if OPENPCD_DEBUG_MASK_SET is given.  The
+ * response has the previous mask. */
+#define OPENPCD_CMD_DEBUG_MASK		(0x3|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_DEBUG))
+
+#define OPENPCD_DEBUG_MASK_SET		0x80
+
+/* CMD_CLS_PROFILE, firmware built with PROFILE=1 */
+/* Read page 'reg' of the function profile.  The reply carries struct
+ * openpcd_prof_hdr and 'val' struct openpcd_prof_entry.  'val' of the
+ * request holds OPENPCD_PROF_CLEAR to start over after reading. */
+#define OPENPCD_CMD_PROF_READ		(0x1|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_PROFILE))
+#define OPENPCD_PROF_CLEAR		0x01
+#define OPENPCD_PROF_PAGE		32	/* entries per page */
+
+struct openpcd_prof_hdr {
+	uint16_t num;			/* functions recorded */
+	uint16_t lost;			/* calls not recorded, table full */
+	uint32_t tick_cycles;		/* MCK cycles per tick */
+} __attribute__ ((packed));
+
+/* 'self' leaves out the functions called and the interrupts taken */
+struct openpcd_prof_entry {
+	uint32_t addr;
+	uint32_t calls;
+	uint32_t self;			/* ticks */
+	uint32_t incl;			/* ticks */
+} __attribute__ ((packed));
+
 /* CMD_CLS_USBTEST */
 #define OPENPCD_CMD_USBTEST_IN		(0x1|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_USBTEST))
 #define OPENPCD_CMD_USBTEST_OUT		(0x2|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_USBTEST))
+#define OPENPCD_CMD_USBTEST_INT		(0x4|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_USBTEST))
+
+/* OPENPCD_CMD_USBTEST_MEM: check the string functions of the firmware
+ * and time them on the number of bytes in the 16bit payload (or in 'val'
+ * without payload), at most OPENPCD_MEMTEST_MAX_LEN, which is also used
+ * for 0.  The response carries a struct openpcd_memtest. */
+#define OPENPCD_CMD_USBTEST_MEM		(0x5|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_USBTEST))
+
+#define OPENPCD_MEMTEST_MAX_LEN		512
+
+enum openpcd_memtest_fn {
+	OPENPCD_MEMTEST_MEMCPY,		/* source and destination aligned */
+	OPENPCD_MEMTEST_MEMCPY_UNALIGNED, /* source one byte off */
+	OPENPCD_MEMTEST_MEMMOVE,	/* overlapping, backward */
+	OPENPCD_MEMTEST_MEMSET,
+	OPENPCD_MEMTEST_BYTE_LOOP,	/* C byte loop, for reference */
+	OPENPCD_MEMTEST_WRITESB,	/* to a RAM word, no wait states */
+	OPENPCD_MEMTEST_READSB,
+	OPENPCD_MEMTEST_NUM
+};
 
-/* FIXME */
+struct openpcd_memtest {
+	uint32_t errors;		/* failed self checks */
+	uint32_t len;
+	uint32_t cycles[OPENPCD_MEMTEST_NUM];	/* MCK cycles per call */
+} __attribute__ ((packed));
+
+/* OPENPCD_CMD_PIO_IRQ: report edges on the PIOA lines of the 32bit mask
+ * in the payload (or of 'val' without payload) on the interrupt endpoint,
+ * a zero mask stops reporting.  Edges are sent in batches: 'val' is the
+ * number of struct openpcd_pio_edge that follow the header, 'reg' the
+ * number of edges lost since the previous batch (saturating at 255).
+ * A report may end in one pad byte.  Without a free req_ctx the edges
+ * are merged into a record of OPENPCD_CMD_EVENTS that only has the mask
+ * of lines. */
 #define OPENPCD_CMD_PIO_IRQ		(0x3|OPENPCD_CLS2CMD(OPENPCD_CMD_CLS_USBTEST))
 
+#define OPENPCD_PIO_EDGE_HZ		1497600	/* MCK/32 */
+
+struct openpcd_pio_edge {
+	uint32_t stamp;			/* in 1/OPENPCD_PIO_EDGE_HZ */
+	uint32_t pio;			/* lines that changed (PIO_ISR) */
+	uint32_t level;			/* all lines right after (PIO_PDSR) */
+} __attribute__ ((packed));
+
 
 #define OPENPCD_VENDOR_ID	0x16c0
 #define SIMTRACE_PRODUCT_ID	0x0762
@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+#
+# dbglog.py - decode the binary debug log of a DEBUG_BINLOG firmware
+#
+# The firmware only sends the address of each format string plus the raw
+# arguments (see debugp() in src/os/dbgu.c), the strings are looked up in
+# the ELF image the firmware was built from.  Any bytes outside of log
+# records are passed through unchanged.
+#
+# usage: dbglog.py main_foo.elf [/dev/ttyUSB0 | capture file | -]
+#
+# A serial port has to be configured beforehand, e.g.
+#	stty -F /dev/ttyUSB0 115200 raw
+#
+# (C) 2026 by the OpenPCD developers
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License version 2
+#  as published by the Free Software Foundation
+
+import struct
+import sys
+
+BINLOG_MARK = 0x1b
+BINLOG_STR_REF = 0xff
+
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+
+
+class Elf:
+    """just enough of ELF32 little endian to read constant data"""
+
+    def __init__(self, fname):
+        with open(fname, 'rb') as f:
+            self.image = f.read()
+        if self.image[:4] != b'\x7fELF' or self.image[4] != 1:
+            raise ValueError('%s: not an ELF32 file' % fname)
+        shoff, = struct.unpack_from('<I', self.image, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', self.image, 0x2e)
+        self.sections = []
+        for i in range(shnum):
+            (name, stype, flags, addr, offset,
+             size) = struct.unpack_from('<IIIIII', self.image,
+                                        shoff + i * shentsize)
+            if flags & SHF_ALLOC and stype != SHT_NOBITS and size:
+                self.sections.append((addr, offset, size))
+
+    def string(self, addr):
+        for base, offset, size in self.sections:
+            if base <= addr < base + size:
+                start = offset + addr - base
+                end = self.image.find(b'\0', start, offset + size)
+                if end < 0:
+                    end = offset + size
+                return self.image[start:end].decode('latin-1')
+        return '<unknown string 0x%08x>' % addr
+
+
+def to_signed(val, bits):
+    if val & (1 << (bits - 1)):
+        val -= 1 << bits
+    return val
+
+
+def decode(elf, rec):
+    """format one record, following the argument walk of debugp()"""
+    seq, fmt_addr = struct.unpack_from('<HI', rec)
+    fmt = elf.string(fmt_addr)
+    pos = 6
+    out = []
+
+    def u32():
+        nonlocal pos
+        if pos + 4 > len(rec):
+            raise IndexError
+        val, = struct.unpack_from('<I', rec, pos)
+        pos += 4
+        return val
+
+    i = 0
+    try:
+        while i < len(fmt):
+            c = fmt[i]
+            i += 1
+            if c != '%':
+                out.append(c)
+                continue
+
+            spec = ''
+            while i < len(fmt) and fmt[i] in '0123456789-+ #.*':
+                if fmt[i] == '*':
+                    spec += str(to_signed(u32(), 32))
+                else:
+                    spec += fmt[i]
+                i += 1
+            longs = 0
+            while i < len(fmt) and fmt[i] in 'lhz':
+                if fmt[i] == 'l':
+                    longs += 1
+                i += 1
+            if i >= len(fmt):
+                break
+            conv = fmt[i]
+            i += 1
+
+            if conv == '%':
+                out.append('%')
+            elif conv == 's':
+                if pos >= len(rec):
+                    raise IndexError
+                slen = rec[pos]
+                pos += 1
+                if slen == BINLOG_STR_REF:
+                    val = elf.string(u32())
+                else:
+                    val = rec[pos:pos + slen].decode('latin-1')
+                    pos += slen
+                out.append(('%' + spec + 's') % val)
+            else:
+                bits = 32
+                val = u32()
+                if longs >= 2:
+                    val |= u32() << 32
+                    bits = 64
+                if conv in 'di':
+                    out.append(('%' + spec + 'd') % to_signed(val, bits))
+                elif conv == 'u':
+                    out.append(('%' + spec + 'd') % val)
+                elif conv == 'p':
+                    out.append('0x%08x' % val)
+                elif conv == 'c':
+                    out.append(('%' + spec + 'c') % (val & 0xff))
+                elif conv in 'xXo':
+                    out.append(('%' + spec + conv) % val)
+                else:
+                    out.append('<%%%s%s?>' % (spec, conv))
+    except IndexError:
+        # debugp() truncates records that don't fit
+        out.append('<truncated>\n')
+
+    return '[%04X] %s' % (seq, ''.join(out))
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write('usage: %s firmware.elf [input]\n' % sys.argv[0])
+        return 1
+
+    elf = Elf(sys.argv[1])
+    if len(sys.argv) < 3 or sys.argv[2] == '-':
+        inp = sys.stdin.buffer
+    else:
+        inp = open(sys.argv[2], 'rb', buffering=0)
+
+    out = sys.stdout
+    buf = b''
+    while True:
+        data = inp.read1(256) if hasattr(inp, 'read1') else inp.read(256)
+        if not data:
+            break
+        buf += data
+        while buf:
+            mark = buf.find(bytes([BINLOG_MARK]))
+            if mark < 0:
+                out.write(buf.decode('latin-1'))
+                buf = b''
+                break
+            if mark:
+                out.write(buf[:mark].decode('latin-1'))
+                buf = buf[mark:]
+            if len(buf) < 2 or len(buf) < 2 + buf[1]:
+                break
+            out.write(decode(elf, buf[2:2 + buf[1]]).replace('\r', ''))
+            buf = buf[2 + buf[1]:]
+        out.flush()
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+#
+# ramfunc.py - pick the functions to run from RAM, from a measured profile
+#
+# Flash is read with wait states at full MCK (3 after flash_init(), see
+# src/os/flash.c), code in RAM runs without.  'select' reads a profile of
+# a PROFILE=1 firmware (host/opcd_prof) together with the ELF image it
+# was taken from and fills a RAM budget with the functions that spend
+# the most self cycles per byte of code.  The result is a list of names
+# for the RAMFUNCS= build, which moves their .text.<name> sections to
+# .fastrun.  'compare' reports the savings measured with a second profile
+# of the RAMFUNCS= build.
+#
+# usage: ramfunc.py select [-b bytes] [-w wait states] main_foo.elf \
+#		main_foo.prof > main_foo.ramfuncs
+#	 ramfunc.py compare before.elf before.prof after.elf after.prof
+#
+#	make BOARD=... TARGET=main_foo PROFILE=1
+#	opcd_prof > main_foo.prof
+#	ramfunc.py select main_foo.elf main_foo.prof > main_foo.ramfuncs
+#	make BOARD=... TARGET=main_foo PROFILE=1 RAMFUNCS=main_foo.ramfuncs
+#
+# Both profiles should come from the same workload, and the second build
+# keeps PROFILE=1 so the hooks cost the same in both.
+#
+# (C) 2026 by the OpenPCD developers
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License version 2
+#  as published by the Free Software Foundation
+
+import argparse
+import struct
+import sys
+
+SHT_SYMTAB = 2
+STT_FUNC = 2
+RAM_BASE = 0x00200000
+RAM_END = 0x00300000
+
+
+class Elf:
+    """the function symbols of an ELF32 little endian image"""
+
+    def __init__(self, fname):
+        with open(fname, 'rb') as f:
+            image = f.read()
+        if image[:4] != b'\x7fELF' or image[4] != 1:
+            raise ValueError('%s: not an ELF32 file' % fname)
+        shoff, = struct.unpack_from('<I', image, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', image, 0x2e)
+        sections = [struct.unpack_from('<IIIIIIIIII', image,
+                                       shoff + i * shentsize)
+                    for i in range(shnum)]
+
+        self.by_addr = {}
+        self.by_name = {}
+        for sh in sections:
+            if sh[1] != SHT_SYMTAB:
+                continue
+            strtab = sections[sh[6]]
+            for ofs in range(sh[4], sh[4] + sh[5], 16):
+                (name, value, size, info, other,
+                 shndx) = struct.unpack_from('<IIIBBH', image, ofs)
+                if info & 0xf != STT_FUNC or not size:
+                    continue
+                start = strtab[4] + name
+                name = image[start:image.index(b'\0', start)].decode()
+                self.by_addr[value] = (name, size)
+                self.by_name.setdefault(name, []).append((value, size))
+
+    def in_ram(self, name):
+        return any(RAM_BASE <= addr < RAM_END
+                   for addr, size in self.by_name[name])
+
+    def size(self, name):
+        # static functions of the same name all move together
+        return sum(size for addr, size in self.by_name[name])
+
+
+def read_profile(elf, fname):
+    """name -> [calls, self cycles, inclusive cycles]"""
+    prof = {}
+    with open(fname) as f:
+        for line in f:
+            if line.startswith('#') or not line.strip():
+                continue
+            addr, calls, self_cyc, incl = line.split()
+            addr = int(addr, 0)
+            if addr not in elf.by_addr and addr | 1 in elf.by_addr:
+                addr |= 1  # thumb
+            if addr not in elf.by_addr:
+                print('unknown function at 0x%08x, wrong ELF?' % addr,
+                      file=sys.stderr)
+                continue
+            name = elf.by_addr[addr][0]
+            p = prof.setdefault(name, [0, 0, 0])
+            p[0] += int(calls)
+            p[1] += int(self_cyc)
+            p[2] += int(incl)
+    return prof
+
+
+def select(args):
+    elf = Elf(args.elf)
+    prof = read_profile(elf, args.profile)
+    total = sum(p[1] for p in prof.values())
+
+    cand = [(p[1] / elf.size(name), name) for name, p in prof.items()
+            if p[1] and not elf.in_ram(name)]
+    cand.sort(reverse=True)
+
+    used = est = 0
+    print('%-28s %6s %10s %12s %8s' % ('function', 'bytes', 'calls',
+                                        'self_cyc', 'cyc/byte'),
+          file=sys.stderr)
+    for density, name in cand:
+        size = elf.size(name)
+        if used + size > args.budget:
+            continue
+        used += size
+        calls, self_cyc, incl = prof[name]
+        # an upper bound: every cycle a fetch from flash
+        est += self_cyc * args.wait_states // (args.wait_states + 1)
+        print('%-28s %6u %10u %12u %8.1f' % (name, size, calls, self_cyc,
+                                             density), file=sys.stderr)
+        print(name)
+
+    print('%u of %u bytes of RAM, at most %u of %u cycles (%.1f%%) saved'
+          % (used, args.budget, est, total, 100.0 * est / max(total, 1)),
+          file=sys.stderr)
+
+
+def compare(args):
+    before = read_profile(Elf(args.elf_before), args.prof_before)
+    after_elf = Elf(args.elf_after)
+    after = read_profile(after_elf, args.prof_after)
+
+    print('%-28s %4s %12s %12s %8s' % ('function', 'ram', 'cyc/call',
+                                        'now', 'saved'))
+    tot_before = tot_after = 0
+    for name in sorted(after, key=lambda n: -after[n][1]):
+        if name not in before or not before[name][0] or not after[name][0]:
+            continue
+        b = before[name][1] / before[name][0]
+        a = after[name][1] / after[name][0]
+        tot_before += b * after[name][0]
+        tot_after += after[name][1]
+        if after_elf.in_ram(name) or args.all:
+            print('%-28s %4s %12.1f %12.1f %7.1f%%' %
+                  (name, 'yes' if after_elf.in_ram(name) else '', b, a,
+                   100.0 * (b - a) / b if b else 0))
+    print('all functions, same number of calls: %u -> %u cycles '
+          '(%.1f%% saved)' % (tot_before, tot_after,
+                              100.0 * (tot_before - tot_after) /
+                              max(tot_before, 1)))
+
+
+def main():
+    ap = argparse.ArgumentParser(description='profile guided .fastrun')
+    sub = ap.add_subparsers(dest='cmd', required=True)
+
+    p = sub.add_parser('select')
+    p.add_argument('-b', '--budget', type=int, default=2048,
+                   help='bytes of RAM for code (default 2048)')
+    p.add_argument('-w', '--wait-states', type=int, default=3,
+                   help='flash wait states (default 3)')
+    p.add_argument('elf')
+    p.add_argument('profile')
+
+    p = sub.add_parser('compare')
+    p.add_argument('-a', '--all', action='store_true',
+                   help='list the functions left in flash as well')
+    p.add_argument('elf_before')
+    p.add_argument('prof_before')
+    p.add_argument('elf_after')
+    p.add_argument('prof_after')
+
+    args = ap.parse_args()
+    if args.cmd == 'select':
+        select(args)
+    else:
+        compare(args)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,123 @@
+/* Boot phase timestamps and deferred initialization
+ *
+ * main() and the USB code mark the phases of the boot with the TC1
+ * timebase, OPENPCD_CMD_GET_BOOT_TIMES reports them to the host.
+ *
+ * Init code hands work that the host doesn't need for enumeration to
+ * boot_defer().  Normally it runs right away.  With FASTBOOT=1 it is
+ * queued and run from the SCHED_BOOT task once the host configured the
+ * device, or BOOT_LATE_TIMEOUT after the main loop started when no host
+ * shows up.  SCHED_BOOT is more urgent than the USB tasks, so requests
+ * only ever see a fully initialized device.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/types.h>
+#include <string.h>
+#include <asm/system.h>
+#include <os/boot.h>
+#include <os/sched.h>
+#include <os/pit.h>
+#include <os/tc_tb.h>
+#include <os/dbgu.h>
+
+#include "../openpcd.h"
+
+#define BOOT_MAX_DEFERRED	4
+#define BOOT_LATE_TIMEOUT	(HZ / 2)
+
+static struct openpcd_boot_times boot_times = {
+#ifdef CONFIG_FASTBOOT
+	.flags = OPENPCD_BOOT_FAST,
+#endif
+};
+
+/* record the first time 'phase' is reached, safe from IRQ context */
+void boot_mark(enum openpcd_boot_phase phase)
+{
+	unsigned long flags;
+
+	/* bits are only ever set, this keeps the hot paths cheap */
+	if (boot_times.reached & (1 << phase))
+		return;
+
+	local_irq_save(flags);
+	if (!(boot_times.reached & (1 << phase))) {
+		boot_times.stamp[phase] = tc_tb_to_us(tc_tb_now());
+		boot_times.reached |= 1 << phase;
+	}
+	local_irq_restore(flags);
+}
+
+void boot_get_times(struct openpcd_boot_times *bt)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	memcpy(bt, &boot_times, sizeof(*bt));
+	local_irq_restore(flags);
+}
+
+#ifdef CONFIG_FASTBOOT
+static sched_fn *deferred[BOOT_MAX_DEFERRED];
+static unsigned int num_deferred;
+static int late_done;
+
+void boot_defer(sched_fn *fn)
+{
+	if (late_done || num_deferred >= BOOT_MAX_DEFERRED) {
+		fn();
+		return;
+	}
+	deferred[num_deferred++] = fn;
+}
+
+/* SCHED_BOOT task */
+void boot_late_init(void)
+{
+	static int armed;
+	unsigned int i;
+
+	if (late_done)
+		return;
+
+	/* the first run comes from sched_run(), wait for the host */
+	if (!armed) {
+		armed = 1;
+		if (!(boot_times.reached & (1 << OPENPCD_BOOT_USB_CONFIGURED))) {
+			sched_post_in(SCHED_BOOT, BOOT_LATE_TIMEOUT);
+			return;
+		}
+	}
+
+	late_done = 1;
+	for (i = 0; i < num_deferred; i++)
+		deferred[i]();
+	boot_mark(OPENPCD_BOOT_LATE_INIT);
+	DEBUGPCR("late init done after %u us",
+		 boot_times.stamp[OPENPCD_BOOT_LATE_INIT]);
+}
+#else
+void boot_defer(sched_fn *fn)
+{
+	fn();
+}
+
+void boot_late_init(void)
+{
+}
+#endif
@@ -0,0 +1,13 @@
+#ifndef _BOOT_H
+#define _BOOT_H
+
+#include <sys/types.h>
+#include <os/sched.h>
+#include "openpcd.h"
+
+extern void boot_mark(enum openpcd_boot_phase phase);
+extern void boot_defer(sched_fn *fn);
+extern void boot_late_init(void);
+extern void boot_get_times(struct openpcd_boot_times *bt);
+
+#endif /* _BOOT_H */
@@ -42,6 +42,7 @@
 #include <os/main.h>
 #include <os/system_irq.h>
 #include <os/pcd_enumerate.h>
+#include <os/usb_log.h>
 #include <asm/system.h>
 #include <compile.h>
 
@@ -73,6 +74,59 @@ static void Send_reset(void)
 	pfct();
 }
 
+#ifdef DEBUG
+uint8_t debug_masks[DEBUG_MOD_COUNT] = {
+	[0 ... DEBUG_MOD_COUNT-1] = DEBUG_LVL_DEFAULT,
+};
+
+static const char *debug_mod_names[DEBUG_MOD_COUNT] = {
+	[DEBUG_MOD_RC632]	= "rc632",
+	[DEBUG_MOD_REQ_CTX]	= "req_ctx",
+	[DEBUG_MOD_USB]		= "usb",
+	[DEBUG_MOD_ISO7816]	= "iso7816",
+	[DEBUG_MOD_SSC]		= "ssc",
+	[DEBUG_MOD_PIT]		= "pit",
+};
+
+/* console command 'M' <module digit> <mask digit> sets a log mask, 'M'
+ * followed by anything else lists them.  No _main_dbgu() uses 'M'.
+ * Returns 1 if the key was consumed, any other key after 'M' is handled
+ * as usual. */
+static int dbgu_mask_key(char key)
+{
+	static uint8_t state, mod;
+	int ret = 0;
+	int i;
+
+	switch (state) {
+	case 0:
+		if (key != 'M')
+			return 0;
+		state = 1;
+		return 1;
+	case 1:
+		if (key >= '0' && key < '0' + DEBUG_MOD_COUNT) {
+			mod = key - '0';
+			state = 2;
+			return 1;
+		}
+		break;
+	case 2:
+		if (key >= '0' && key <= '7') {
+			debug_masks[mod] = key - '0';
+			ret = 1;
+		}
+		break;
+	}
+
+	state = 0;
+	for (i = 0; i < DEBUG_MOD_COUNT; i++)
+		DEBUGPCR("%u) %-8s 0x%x", i, debug_mod_names[i],
+			 debug_masks[i]);
+	return ret;
+}
+#endif
+
 //*----------------------------------------------------------------------------
 //* Function Name       : DBGU_irq_handler
 //* Object              : C handler interrupt function called by the sysirq
@@ -83,6 +137,10 @@ static void DBGU_irq_handler(uint32_t sr)
 	static char value;
 
 	AT91F_DBGU_Get(&value);
+#ifdef DEBUG
+	if (dbgu_mask_key(value))
+		return;
+#endif
 	switch (value) {
 	case '0':		//* info
 		AT91F_DBGU_Frame("Clear Pull up\n\r");
@@ -116,13 +174,16 @@ static void DBGU_irq_handler(uint32_t sr)
 }
 
 void dbgu_rb_init(void);
+
+static unsigned int rst_status;
+
 //*----------------------------------------------------------------------------
 //* \fn    AT91F_DBGU_Init
 //* \brief This function is used to send a string through the DBGU channel (Very low level debugging)
 //*----------------------------------------------------------------------------
 void AT91F_DBGU_Init(void)
 {
-	unsigned int rst_status = AT91F_RSTGetStatus(AT91C_BASE_RSTC);
+	rst_status = AT91F_RSTGetStatus(AT91C_BASE_RSTC);
 
 	dbgu_rb_init();
 
@@ -146,7 +207,13 @@ void AT91F_DBGU_Init(void)
 
 	//* open interrupt
 	sysirq_register(AT91SAM7_SYSIRQ_DBGU, &DBGU_irq_handler);
+}
 
+/* Version and help, main() prints it through boot_defer().  At 115200
+ * baud it keeps the DBGU busy for some 30ms, a USB IRQ that logs meanwhile
+ * would have to wait for room in the ring. */
+void dbgu_banner(void)
+{
 	debugp("\n\r");
 	debugp("(C) 2006-2011 by Harald Welte <hwelte@hmw-consulting.de>\n\r"
 			  "This software is FREE SOFTWARE licensed under GNU GPL\n\r");
@@ -155,7 +222,9 @@ void AT91F_DBGU_Init(void)
 			  " by " COMPILE_BY "\n\r\n\r");
 	debugp("\n\rDEBUG Interface:\n\r"
 			  "0) Set Pull-up 1) Clear Pull-up 2) Toggle LED1 3) "
-			  "Toggle LED2\r\n9) Reset\n\r");
+			  "Toggle LED2\r\n9) Reset\n\r"
+			  "M) Log masks: M<module><mask>, mask 1=err 2=info "
+			  "4=trace\n\r");
 
 	debugp("RSTC_SR=0x%08x\n\r", rst_status);
 }
@@ -228,17 +297,20 @@ int AT91F_DBGU_Get(char *val)
 const char *
 hexdump(const void *data, unsigned int len)
 {
+	static const char hex[] = "0123456789abcdef";
 	static char string[256];
 	unsigned char *d = (unsigned char *) data;
-	unsigned int i, left;
+	unsigned int i;
 
-	string[0] = '\0';
-	left = sizeof(string);
+	/* no snprintf() here, this is called for every FIFO access */
 	for (i = 0; len--; i += 3) {
 		if (i >= sizeof(string) -4)
 			break;
-		snprintf(string+i, 4, " %02x", *d++);
+		string[i] = ' ';
+		string[i+1] = hex[*d >> 4];
+		string[i+2] = hex[*d++ & 0xf];
 	}
+	string[i] = '\0';
 	return string;
 }
 
@@ -408,6 +480,105 @@ void dbgu_rb_append(char *data, int len)
 		dbgu_rb_flush();
 }
 
+#ifdef DEBUG_BINLOG
+/* Binary log: debugp() doesn't format on the target, it only stores the
+ * address of the format string and the raw arguments.  The host decodes
+ * the records using the strings of the ELF image (scripts/dbglog.py).
+ *
+ * A record is BINLOG_MARK, the length of the rest, a 16bit sequence
+ * number, the 32bit format address and the arguments, little endian.
+ * Every argument is one 32bit word (two for %ll).  Strings below _etext
+ * are constant and passed by address as BINLOG_STR_REF + 32bit, other
+ * strings are copied as a length byte followed by the characters. */
+#define BINLOG_MARK	0x1b
+#define BINLOG_STR_REF	0xff
+#define BINLOG_STR_MAX	96
+#define BINLOG_REC_MAX	160
+
+extern char _etext[];
+
+static uint16_t line_num;
+
+static uint8_t *binlog_u32(uint8_t *p, uint32_t val)
+{
+	p[0] = val;
+	p[1] = val >> 8;
+	p[2] = val >> 16;
+	p[3] = val >> 24;
+	return p + 4;
+}
+
+void debugp(const char *format, ...)
+{
+	uint8_t rec[BINLOG_REC_MAX];
+	uint8_t *p = rec + 2, *end = rec + sizeof(rec);
+	const char *f = format;
+	va_list ap;
+
+	*p++ = line_num;
+	*p++ = line_num >> 8;
+	line_num++;
+	p = binlog_u32(p, (uint32_t) format);
+
+	va_start(ap, format);
+	while (*f) {
+		uint8_t longs = 0;
+
+		if (*f++ != '%')
+			continue;
+
+		/* the longest argument has to fit, otherwise truncate */
+		if (end - p < 1 + BINLOG_STR_MAX)
+			break;
+
+		/* flags, width and precision */
+		while ((*f >= '0' && *f <= '9') || *f == '-' || *f == '+' ||
+		       *f == ' ' || *f == '#' || *f == '.' || *f == '*') {
+			if (*f == '*')
+				p = binlog_u32(p, va_arg(ap, int));
+			f++;
+		}
+		/* length modifiers */
+		while (*f == 'l' || *f == 'h' || *f == 'z') {
+			if (*f == 'l')
+				longs++;
+			f++;
+		}
+
+		if (*f == '\0')
+			break;
+		else if (*f == '%')
+			;
+		else if (*f == 's') {
+			const char *str = va_arg(ap, const char *);
+
+			if (str < _etext) {
+				*p++ = BINLOG_STR_REF;
+				p = binlog_u32(p, (uint32_t) str);
+			} else {
+				uint8_t *len = p++;
+
+				while (*str && p < len + 1 + BINLOG_STR_MAX)
+					*p++ = *str++;
+				*len = p - len - 1;
+			}
+		} else if (longs >= 2) {
+			uint64_t val = va_arg(ap, uint64_t);
+
+			p = binlog_u32(p, val);
+			p = binlog_u32(p, val >> 32);
+		} else
+			p = binlog_u32(p, va_arg(ap, uint32_t));
+		f++;
+	}
+	va_end(ap);
+
+	rec[0] = BINLOG_MARK;
+	rec[1] = p - rec - 2;
+	if (usb_log_append((char *) rec, p - rec))
+		dbgu_rb_append((char *) rec, p - rec);
+}
+#else
 static char dbg_buf[256];
 static int line_num = 0;
 void debugp(const char *format, ...)
@@ -420,6 +591,8 @@ void debugp(const char *format, ...)
 	va_end(ap);
 
 	dbg_buf[sizeof(dbg_buf)-1] = '\0';			
+	if (!usb_log_append(dbg_buf, strlen(dbg_buf)))
+		return;
 	//AT91F_DBGU_Frame(dbg_buf);
 #ifdef DEBUG_UNBUFFERED
 	AT91F_DBGU_Printk(dbg_buf);
@@ -427,6 +600,7 @@ void debugp(const char *format, ...)
 	dbgu_rb_append(dbg_buf, strlen(dbg_buf));
 #endif
 }
+#endif /* DEBUG_BINLOG */
 #else
 void dbgu_rb_flush(void) {}
 void dbgu_rb_init(void) {}
@@ -15,6 +15,8 @@
 #ifndef dbgu_h
 #define dbgu_h
 
+#include <sys/types.h>
+
 #define AT91C_DBGU_BAUD 115200
 
 //* ----------------------- External Function Prototype -----------------------
@@ -22,6 +24,7 @@
 extern const char *hexdump(const void *data, unsigned int len);
 void AT91F_DBGU_Init(void);
 void AT91F_DBGU_Fini(void);
+void dbgu_banner(void);
 void AT91F_DBGU_Frame(char *buffer);
 #define AT91F_DBGU_Printk(x) AT91F_DBGU_Frame(x)
 int AT91F_DBGU_Get( char *val);
@@ -29,12 +32,42 @@ int AT91F_DBGU_Get( char *val);
 void AT91F_DBGU_scanf(char * type,unsigned int * val);
 #endif
 
+/* Runtime log masks.  A file belonging to one of the modules below
+ * defines DEBUG_MODULE before its first #include, its messages are then
+ * only printed if their level is set in debug_masks[DEBUG_MODULE].  The
+ * masks can be changed over USB (OPENPCD_CMD_DEBUG_MASK) and with the
+ * 'M' command of the DBGU console. */
+enum debug_module {
+	DEBUG_MOD_RC632,
+	DEBUG_MOD_REQ_CTX,
+	DEBUG_MOD_USB,
+	DEBUG_MOD_ISO7816,
+	DEBUG_MOD_SSC,
+	DEBUG_MOD_PIT,
+	DEBUG_MOD_COUNT
+};
+
+#define DEBUG_LVL_ERR		0x01
+#define DEBUG_LVL_INFO		0x02	/* DEBUGP() */
+#define DEBUG_LVL_TRACE		0x04	/* per transfer / register access */
+#define DEBUG_LVL_DEFAULT	(DEBUG_LVL_ERR|DEBUG_LVL_INFO)
+
 #ifdef DEBUG
 extern void debugp(const char *format, ...);
-#define DEBUGP(x, args ...) debugp(x, ## args)
+extern uint8_t debug_masks[DEBUG_MOD_COUNT];
+#ifdef DEBUG_MODULE
+#define DEBUGPL(lvl, x, args ...) do {					\
+		if (debug_masks[DEBUG_MODULE] & (lvl))			\
+			debugp(x, ## args);				\
+	} while (0)
 #else
-#define	DEBUGP(x, args ...) do {} while(0)
+#define DEBUGPL(lvl, x, args ...) debugp(x, ## args)
 #endif
+#else
+#define DEBUGPL(lvl, x, args ...) do {} while(0)
+#endif
+
+#define DEBUGP(x, args ...) DEBUGPL(DEBUG_LVL_INFO, x, ## args)
 
 #define DEBUGPCR(x, args ...) DEBUGP(x "\r\n", ## args)
 #define DEBUGPCRF(x, args ...) DEBUGPCR("%s(%d): " x, __FUNCTION__, __LINE__, ## args)
@@ -23,104 +23,133 @@
 #include <errno.h>
 #include <string.h>
 
-#define FIFO_IRQ_LO	0x01
-#define FIFO_IRQ_HI	0x02
-#define FIFO_IRQ_OFLOW	0x04
+/* data accesses must not be moved across an index update */
+#define fifo_barrier()	__asm__ __volatile__("" : : : "memory")
 
-/* returns number of data bytes present in the fifo */
-int fifo_available(struct fifo *fifo)
+static inline void fifo_raise(struct fifo *fifo, uint8_t event)
 {
-	if (fifo->producer > fifo->consumer)
-		return fifo->producer - fifo->consumer;
-	else
-		return (fifo->size - fifo->consumer) + fifo->producer;
+	if ((fifo->irq_en & event) && fifo->callback)
+		fifo->callback(fifo, event, fifo->cb_data);
 }
 
-void fifo_check_water(struct fifo *fifo)
+/* consumer side */
+
+uint16_t fifo_read_peek(struct fifo *fifo, uint8_t **data)
 {
-	int avail = fifo_available(fifo);
+	uint16_t avail = fifo_available(fifo);
+	uint16_t ofs = fifo->consumer & (fifo->size - 1);
 
-	if (avail <= fifo->watermark)
-		fifo->irq |= FIFO_IRQ_LO;
-	else
-		fifo->irq &= FIFO_IRQ_LO;
+	fifo_barrier();
+	*data = &fifo->data[ofs];
+	if (avail > fifo->size - ofs)
+		avail = fifo->size - ofs;
 
-	if (fifo->size - avail >= fifo->watermark)
-		fifo->irq |= FIFO_IRQ_HI;
-	else
-		fifo->irq &= FIFO_IRQ_HI;
+	return avail;
 }
 
-void fifo_check_raise_int(struct fifo *fifo)
+void fifo_read_commit(struct fifo *fifo, uint16_t len)
 {
-	if (fifo->irq & fifo->irq_en)
-		fifo->callback(fifo, fifo->irq, fifo->cb_data);
-}
+	uint16_t before = fifo_available(fifo);
 
+	fifo_barrier();
+	fifo->consumer += len;
+
+	if (before > fifo->lo_water && before - len <= fifo->lo_water)
+		fifo_raise(fifo, FIFO_IRQ_LO);
+}
 
-uint16_t fifo_data_put(struct fifo *fifo, uint16_t len, uint8_t *data)
+uint16_t fifo_data_get(struct fifo *fifo, uint16_t len, uint8_t *data)
 {
-	if (len > fifo_available(fifo)) {
-		len = fifo_available(fifo);
-		fifo->irq |= FIFO_IRQ_OFLOW;
+	uint16_t done = 0;
+
+	/* at most two spans: up to the end of the buffer and from its start */
+	while (done < len) {
+		uint8_t *src;
+		uint16_t chunk = fifo_read_peek(fifo, &src);
+
+		if (!chunk)
+			break;
+		if (chunk > len - done)
+			chunk = len - done;
+		memcpy(data + done, src, chunk);
+		fifo_read_commit(fifo, chunk);
+		done += chunk;
 	}
 
-	if (len + fifo->producer <= fifo->size) {
-		/* easy case */
-		memcpy(&fifo->data[fifo->producer], data, len);
-		fifo->producer += len;
-	} else {
-		/* difficult: wrap around */
-		uint16_t chunk_len;
+	return done;
+}
 
-		chunk_len = fifo->size - fifo->producer;
-		memcpy(&fifo->data[fifo->producer], data, chunk_len);
+/* producer side */
 
-		memcpy(&fifo->data[0], data + chunk_len, len - chunk_len);
-		fifo->producer = len - chunk_len;
-	}
+uint16_t fifo_write_peek(struct fifo *fifo, uint8_t **data)
+{
+	uint16_t space = fifo_space(fifo);
+	uint16_t ofs = fifo->producer & (fifo->size - 1);
 
-	fifo_check_water(fifo);
+	fifo_barrier();
+	*data = &fifo->data[ofs];
+	if (space > fifo->size - ofs)
+		space = fifo->size - ofs;
 
-	return len;
+	return space;
 }
 
-
-uint16_t fifo_data_get(struct fifo *fifo, uint16_t len, uint8_t *data)
+void fifo_write_commit(struct fifo *fifo, uint16_t len)
 {
-	uint16_t avail = fifo_available(fifo);
+	uint16_t before = fifo_available(fifo);
+
+	fifo_barrier();
+	fifo->producer += len;
+
+	if (before < fifo->hi_water && before + len >= fifo->hi_water)
+		fifo_raise(fifo, FIFO_IRQ_HI);
+}
 
-	if (avail < len)
-		len = avail;
-
-	if (fifo->producer > fifo->consumer) {
-		/* easy case */
-		memcpy(data, &fifo->data[fifo->consumer], len);
-	} else {
-		/* difficult case: wrap */
-		uint16_t chunk_len = fifo->size - fifo->consumer;
-		memcpy(data, &fifo->data[fifo->consumer], chunk_len);
-		memcpy(data+chunk_len, &fifo->data[0], len - chunk_len);
+uint16_t fifo_data_put(struct fifo *fifo, uint16_t len, const uint8_t *data)
+{
+	uint16_t done = 0;
+
+	while (done < len) {
+		uint8_t *dst;
+		uint16_t chunk = fifo_write_peek(fifo, &dst);
+
+		if (!chunk)
+			break;
+		if (chunk > len - done)
+			chunk = len - done;
+		memcpy(dst, data + done, chunk);
+		fifo_write_commit(fifo, chunk);
+		done += chunk;
 	}
 
-	fifo_check_water(fifo);
+	if (done < len)
+		fifo_raise(fifo, FIFO_IRQ_OFLOW);
 
-	return len;
+	return done;
+}
+
+void fifo_set_water(struct fifo *fifo, uint16_t lo, uint16_t hi,
+		    uint8_t irq_en)
+{
+	fifo->lo_water = lo;
+	fifo->hi_water = hi;
+	fifo->irq_en = irq_en;
 }
 
 int fifo_init(struct fifo *fifo, uint16_t size, 
 	      void (*cb)(struct fifo *fifo, uint8_t event, void *data), void *cb_data)
 {
-	if (size > sizeof(fifo->data))
+	/* the free running indices wrap at 65536, a multiple of size */
+	if (size == 0 || size > sizeof(fifo->data) || (size & (size - 1)))
 		return -EINVAL;
 
-	memset(fifo->data, 0, sizeof(fifo->data));
 	fifo->size = size;
 	fifo->producer = fifo->consumer = 0;
-	fifo->watermark = 0;
+	fifo->lo_water = 0;
+	fifo->hi_water = size;
+	fifo->irq_en = 0;
 	fifo->callback = cb;
 	fifo->cb_data = cb_data;
 
 	return 0;
 }
-
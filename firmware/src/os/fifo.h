@@ -5,24 +5,52 @@
 
 #define FIFO_SIZE	1024
 
+/* events passed to the callback */
+#define FIFO_IRQ_LO	0x01	/* fill level dropped to the low watermark */
+#define FIFO_IRQ_HI	0x02	/* fill level reached the high watermark */
+#define FIFO_IRQ_OFLOW	0x04	/* data was dropped by fifo_data_put() */
+
+/* Byte ring for exactly one producer and one consumer, which may run in
+ * different contexts (IRQ / main loop) without locking.  The indices run
+ * freely and are only masked on access, so a full FIFO holds 'size'
+ * bytes.  LO events are raised by the consumer, HI and OFLOW events by
+ * the producer, each in the context of the side that caused them. */
 struct fifo {
-	uint16_t size;		/* actual FIFO size, can be smaller than 'data' */
-	uint16_t producer;	/* index of producer */
-	uint16_t consumer;	/* index of consumer */
-	uint16_t watermark;
-	uint8_t irq;
+	uint16_t size;		/* power of two, can be smaller than 'data' */
+	volatile uint16_t producer;	/* only written by the producer */
+	volatile uint16_t consumer;	/* only written by the consumer */
+	uint16_t lo_water;
+	uint16_t hi_water;
 	uint8_t irq_en;
-	uint8_t status;
 	void (*callback)(struct fifo *fifo, uint8_t event, void *data);
 	void *cb_data;
 	uint8_t data[FIFO_SIZE];
 };
 
-
 extern int fifo_init(struct fifo *fifo, uint16_t size, 
 		     void (*callback)(struct fifo *fifo, uint8_t event, void *data), void *cb_data);
+extern void fifo_set_water(struct fifo *fifo, uint16_t lo, uint16_t hi,
+			   uint8_t irq_en);
+
+/* copying interface */
 extern uint16_t fifo_data_get(struct fifo *fifo, uint16_t len, uint8_t *data);
-extern uint16_t fifo_data_put(struct fifo *fifo, uint16_t len, uint8_t *data);
-extern int fifo_available(struct fifo *fifo);
+extern uint16_t fifo_data_put(struct fifo *fifo, uint16_t len, const uint8_t *data);
+
+/* zero-copy interface: peek returns the largest contiguous span (which
+ * is shorter than the total at the wrap), commit hands it over */
+extern uint16_t fifo_read_peek(struct fifo *fifo, uint8_t **data);
+extern void fifo_read_commit(struct fifo *fifo, uint16_t len);
+extern uint16_t fifo_write_peek(struct fifo *fifo, uint8_t **data);
+extern void fifo_write_commit(struct fifo *fifo, uint16_t len);
+
+static inline uint16_t fifo_available(struct fifo *fifo)
+{
+	return (uint16_t)(fifo->producer - fifo->consumer);
+}
+
+static inline uint16_t fifo_space(struct fifo *fifo)
+{
+	return fifo->size - fifo_available(fifo);
+}
 
 #endif
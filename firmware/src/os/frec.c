@@ -0,0 +1,126 @@
+/* Flight recorder
+ *
+ * A small ring of timestamped events (IRQs, req_ctx transitions, USB
+ * transfers, state machine changes) that lives in the .noinit section.
+ * It is neither loaded nor cleared by the startup code, so after a
+ * watchdog reset the events leading up to it are still there.  Recording
+ * then stays frozen until the host has fetched them with
+ * OPENPCD_CMD_FREC_READ (see host/opcd_frec.c).
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by 
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <string.h>
+#include <sys/types.h>
+#include <asm/system.h>
+#include <lib_AT91SAM7.h>
+#include <openpcd.h>
+
+#include <os/frec.h>
+
+#define FREC_NUM	128	/* power of two, 8 bytes each */
+#define FREC_MAGIC	0x46524543	/* "FREC" */
+
+static struct {
+	uint32_t magic;
+	uint32_t boots;
+	uint16_t head;			/* free running */
+	uint16_t num;			/* valid entries */
+	uint8_t flags;			/* OPENPCD_FREC_FREEZE */
+	uint8_t reset;
+	struct openpcd_frec_entry ent[FREC_NUM];
+} frec __attribute__ ((section (".noinit")));
+
+void frec_log_at(uint32_t stamp, uint8_t type, uint8_t arg8,
+		 uint16_t arg16)
+{
+	struct openpcd_frec_entry *e;
+	unsigned long flags;
+
+	if (frec.flags & OPENPCD_FREC_FREEZE)
+		return;
+
+	/* __pio_irq_demux() logs from the FIQ as well */
+	local_irq_save(flags);
+	local_fiq_disable();
+	e = &frec.ent[frec.head++ % FREC_NUM];
+	e->stamp = stamp;
+	e->type = type;
+	e->arg8 = arg8;
+	e->arg16 = arg16;
+	if (frec.num < FREC_NUM)
+		frec.num++;
+	local_irq_restore(flags);
+}
+
+/* fill buf with struct openpcd_frec_hdr and one page of entries, oldest
+ * first.  Returns the number of entries. */
+int frec_read(uint8_t *buf, unsigned int page, uint8_t flags)
+{
+	struct openpcd_frec_hdr *hdr = (struct openpcd_frec_hdr *) buf;
+	struct openpcd_frec_entry *ent = (struct openpcd_frec_entry *)
+								(hdr + 1);
+	unsigned long irqflags;
+	unsigned int i, first, num = 0;
+
+	local_irq_save(irqflags);
+	local_fiq_disable();
+
+	if (flags & OPENPCD_FREC_FREEZE)
+		frec.flags |= OPENPCD_FREC_FREEZE;
+
+	hdr->num = frec.num;
+	hdr->flags = frec.flags;
+	hdr->reset = frec.reset;
+	hdr->boots = frec.boots;
+
+	first = page * OPENPCD_FREC_PAGE;
+	for (i = first; i < frec.num && num < OPENPCD_FREC_PAGE; i++, num++)
+		memcpy(&ent[num], &frec.ent[(frec.head - frec.num + i) %
+					    FREC_NUM], sizeof(*ent));
+
+	if (flags & OPENPCD_FREC_CLEAR)
+		frec.num = 0;
+	if (flags & OPENPCD_FREC_RESUME)
+		frec.flags &= ~OPENPCD_FREC_FREEZE;
+
+	local_irq_restore(irqflags);
+
+	return num;
+}
+
+void frec_init(void)
+{
+	uint32_t reset = (AT91F_RSTGetStatus(AT91C_BASE_RSTC) &
+			  AT91C_RSTC_RSTTYP) >> 8;
+
+	if (frec.magic != FREC_MAGIC || frec.num > FREC_NUM) {
+		/* power up, or the RAM has been used by someone else */
+		memset(&frec, 0, sizeof(frec));
+		frec.magic = FREC_MAGIC;
+	} else
+		frec.boots++;
+
+	frec.reset = reset;
+	frec.flags &= ~OPENPCD_FREC_FREEZE;
+	frec_log(OPENPCD_FREC_BOOT, reset, frec.boots);
+
+	/* keep what led to the reset until the host has seen it */
+	if (reset == (AT91C_RSTC_RSTTYP_WATCHDOG >> 8))
+		frec.flags |= OPENPCD_FREC_FREEZE;
+}
@@ -0,0 +1,18 @@
+#ifndef _FREC_H
+#define _FREC_H
+
+#include <sys/types.h>
+#include <openpcd.h>
+#include <os/pit.h>
+
+extern void frec_init(void);
+extern void frec_log_at(uint32_t stamp, uint8_t type, uint8_t arg8,
+			uint16_t arg16);
+extern int frec_read(uint8_t *buf, unsigned int page, uint8_t flags);
+
+static inline void frec_log(uint8_t type, uint8_t arg8, uint16_t arg16)
+{
+	frec_log_at(pit_ticks(), type, arg8, arg16);
+}
+
+#endif /* _FREC_H */
@@ -0,0 +1,162 @@
+/* Logic analyzer capture of PIOA lines for OpenPCD / OpenPICC
+ *
+ * Every edge on the selected lines is time stamped by __pio_irq_demux()
+ * and streamed to the host as OPENPCD_CMD_LA_DATA on the bulk IN pipe,
+ * up to 79 edges per req_ctx.  A partly filled (or empty) context is
+ * sent every LA_FLUSH.
+ *
+ * The PIO controller has no PDC channel, so there is no sampling at a
+ * fixed rate: the edge list together with the initial levels describes
+ * the waveform completely, as long as no edges are lost.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <lib_AT91SAM7.h>
+#include <asm/system.h>
+#include <openpcd.h>
+#include <os/la.h>
+#include <os/pio_irq.h>
+#include <os/pit.h>
+#include <os/req_ctx.h>
+#include <os/tc_tb.h>
+#include <os/dbgu.h>
+#include <os/usb_handler.h>
+
+#define LA_FLUSH	(HZ/20)
+
+static struct {
+	uint32_t mask;
+	struct req_ctx *rctx;
+	unsigned int num;
+	unsigned int lost;
+	struct timer_list timer;
+} la;
+
+/* called with IRQs disabled */
+static void la_flush(void)
+{
+	struct req_ctx *rctx = la.rctx;
+	struct openpcd_hdr *poh;
+
+	if (!rctx)
+		return;
+
+	poh = (struct openpcd_hdr *) rctx->data;
+	poh->cmd = OPENPCD_CMD_LA_DATA;
+	poh->flags = 0;
+	poh->reg = la.lost > 0xff ? 0xff : la.lost;
+	poh->val = la.num;
+	rctx->tot_len = sizeof(*poh) +
+			la.num * sizeof(struct openpcd_pio_edge);
+	usb_in_pad(rctx);
+
+	la.rctx = NULL;
+	la.num = 0;
+	la.lost = 0;
+	req_ctx_set_state(rctx, RCTX_STATE_UDP_EP2_PENDING);
+}
+
+/* also without edges, so the host can stop the capture in time */
+static void la_timer(void *data)
+{
+	if (!la.rctx)
+		la.rctx = req_ctx_find_get(1, RCTX_STATE_FREE,
+					   RCTX_STATE_PIOIRQ_BUSY);
+	la_flush();
+	la.timer.expires = jiffies + LA_FLUSH;
+	timer_add(&la.timer);
+}
+
+static void la_edge(const struct openpcd_pio_edge *edge, unsigned int lost)
+{
+	struct openpcd_pio_edge *e;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	la.lost += lost;
+	if (!la.rctx) {
+		la.rctx = req_ctx_find_get(1, RCTX_STATE_FREE,
+					   RCTX_STATE_PIOIRQ_BUSY);
+		if (!la.rctx) {
+			la.lost++;
+			goto out;
+		}
+	}
+
+	e = (struct openpcd_pio_edge *) (la.rctx->data +
+					 sizeof(struct openpcd_hdr));
+	memcpy(&e[la.num], edge, sizeof(*e));
+	e[la.num].pio &= la.mask;
+	/* keep room for the padding byte */
+	if (++la.num == (la.rctx->size - sizeof(struct openpcd_hdr) - 1) /
+			sizeof(*e))
+		la_flush();
+out:
+	local_irq_restore(flags);
+}
+
+/* start capturing the lines of 'mask'.  The first record has no lines
+ * in 'pio', only the levels at the start. */
+int la_start(uint32_t mask)
+{
+	struct openpcd_pio_edge first;
+
+	if (!mask)
+		return -EINVAL;
+	la_stop();
+
+	DEBUGPCRF("capturing PIOA 0x%08x", mask);
+	pio_irq_init();
+	la.mask = mask;
+
+	first.stamp = tc_tb_now();
+	first.pio = 0;
+	first.level = AT91F_PIO_GetInput(AT91C_BASE_PIOA);
+	la_edge(&first, 0);
+
+	pio_irq_set_capture(mask, &la_edge);
+
+	la.timer.function = &la_timer;
+	la.timer.data = NULL;
+	la.timer.expires = jiffies + LA_FLUSH;
+	timer_add(&la.timer);
+
+	return 0;
+}
+
+/* send everything captured so far and stop */
+void la_stop(void)
+{
+	unsigned long flags;
+
+	if (!la.mask)
+		return;
+
+	pio_irq_process();
+	pio_irq_set_capture(0, NULL);
+	timer_del(&la.timer);
+
+	local_irq_save(flags);
+	la_flush();
+	local_irq_restore(flags);
+
+	la.mask = 0;
+	DEBUGPCRF("capture stopped");
+}
@@ -0,0 +1,9 @@
+#ifndef _LA_H
+#define _LA_H
+
+#include <sys/types.h>
+
+extern int la_start(uint32_t mask);
+extern void la_stop(void);
+
+#endif /* _LA_H */
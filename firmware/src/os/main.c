@@ -28,9 +28,18 @@
 #include <os/power.h>
 #include <os/system_irq.h>
 #include <os/pit.h>
+#include <os/tc_tb.h>
+#include <os/req_ctx.h>
 #include <os/wdt.h>
 #include <os/usbcmd_generic.h>
+#include <os/usb_log.h>
+#include <os/frec.h>
+#include <os/pio_irq.h>
 #include <os/pcd_enumerate.h>
+#include <os/usb_handler.h>
+#include <os/sched.h>
+#include <os/boot.h>
+#include <os/profile.h>
 #include "../openpcd.h"
 
 #include <compile.h>
@@ -43,23 +52,42 @@ const struct openpcd_compile_version opcd_version = {
 
 int main(void)
 {
+	/* the timebase first, it stamps the boot phases */
+	tc_tb_init();
+	boot_mark(OPENPCD_BOOT_MAIN);
+
 	/* initialize LED and debug unit */
 	led_init();
 	sysirq_init();
 	AT91F_DBGU_Init();
+	boot_defer(&dbgu_banner);
+	boot_mark(OPENPCD_BOOT_DBGU);
 
 	AT91F_PIOA_CfgPMC();
 	wdt_init();
 	pit_init();
+	frec_init();
 	blinkcode_init();
+	boot_mark(OPENPCD_BOOT_SYS);
 
 	/* initialize USB */
 	req_ctx_init();
 	usbcmd_gen_init();
+	usb_log_init();
+	profile_init();
 	udp_open();
+	boot_mark(OPENPCD_BOOT_USB_OPEN);
+
+	sched_register(SCHED_BOOT, &boot_late_init);
+	sched_register(SCHED_USB_OUT, &usb_out_process);
+	sched_register(SCHED_USB_IN, &usb_in_process);
+	sched_register(SCHED_UNTHROTTLE, &udp_unthrottle);
+	sched_register(SCHED_PIO, &pio_irq_process);
+	sched_register(SCHED_APP, &_main_func);
 
 	/* call application specific init function */
 	_init_func();
+	boot_mark(OPENPCD_BOOT_APP_INIT);
 
 	// Enable User Reset and set its minimal assertion to 960 us
 	AT91C_BASE_RSTC->RSTC_RMR =
@@ -74,14 +102,6 @@ int main(void)
 	led_switch(2, 1);
 
 	DEBUGPCRF("entering main (idle) loop");
-	while (1) {
-		/* Call application specific main idle function */
-		_main_func();
-		
-		/* restart watchdog timer */
-		wdt_restart();
-#ifdef CONFIG_IDLE
-		//cpu_idle();
-#endif
-	}
+	boot_mark(OPENPCD_BOOT_SCHED);
+	sched_run();
 }
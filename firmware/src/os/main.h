@@ -5,5 +5,10 @@ extern void _init_func(void);
 extern int _main_dbgu(char key);
 extern void _main_func(void);
 
+#ifdef CONFIG_MULTIAPP
+struct req_ctx;
+extern int app_usb_rx(struct req_ctx *rctx);
+#endif
+
 extern const struct openpcd_compile_version opcd_version;
 #endif
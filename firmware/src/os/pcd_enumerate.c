@@ -27,10 +27,13 @@
  *----------------------------------------------------------------------------
  */
 
+#define DEBUG_MODULE	DEBUG_MOD_USB
+
 #include <errno.h>
 #include <usb_ch9.h>
 #include <sys/types.h>
 #include <asm/atomic.h>
+#include <asm/io.h>
 #include <lib_AT91SAM7.h>
 #include <openpcd.h>
 
@@ -38,40 +41,21 @@
 
 #include <os/pcd_enumerate.h>
 #include <os/req_ctx.h>
+#include <os/usb_event.h>
+#include <os/frec.h>
+#include <os/boot.h>
+#include <os/sched.h>
 #include <dfu/dfu.h>
 #include "../openpcd.h"
 #include <os/dbgu.h>
 
 #include "../config.h"
 
-//#define DEBUG_UDP_IRQ
-//#define DEBUG_UDP_IRQ_IN
-//#define DEBUG_UDP_IRQ_OUT
-//#define DEBUG_UDP_EP0
-
-#ifdef DEBUG_UDP_IRQ
-#define DEBUGI(x, args ...)	DEBUGP(x, ## args)
-#else
-#define DEBUGI(x, args ...)	do { } while (0)
-#endif
-
-#ifdef DEBUG_UDP_IRQ_IN
-#define DEBUGII(x, args ...)	DEBUGP(x, ## args)
-#else
-#define DEBUGII(x, args ...)	do { } while (0)
-#endif
-
-#ifdef DEBUG_UDP_IRQ_OUT
-#define DEBUGIO(x, args ...)	DEBUGP(x, ## args)
-#else
-#define DEBUGIO(x, args ...)	do { } while (0)
-#endif
-
-#ifdef DEBUG_UDP_EP0
-#define DEBUGE(x, args ...)	DEBUGP(x, ## args)
-#else
-#define DEBUGE(x, args ...)	do { } while (0)
-#endif
+/* per-transfer tracing, enabled at runtime with DEBUG_LVL_TRACE */
+#define DEBUGI(x, args ...)	DEBUGPL(DEBUG_LVL_TRACE, x, ## args)
+#define DEBUGII(x, args ...)	DEBUGPL(DEBUG_LVL_TRACE, x, ## args)
+#define DEBUGIO(x, args ...)	DEBUGPL(DEBUG_LVL_TRACE, x, ## args)
+#define DEBUGE(x, args ...)	DEBUGPL(DEBUG_LVL_TRACE, x, ## args)
 
 #define CONFIG_DFU
 
@@ -93,6 +77,12 @@ static const struct dfuapi *dfu = DFU_API_LOCATION;
 
 static struct udp_pcd upcd;
 
+static inline void udp_set_state(enum usb_device_state state)
+{
+	upcd.state = state;
+	frec_log(OPENPCD_FREC_USB_STATE, state, 0);
+}
+
 struct epstate {
 	uint32_t state_busy;
 	uint32_t state_pending;
@@ -138,9 +128,28 @@ void udp_unthrottle(void)
 	pUDP->UDP_IER = AT91C_UDP_EPINT1;
 }
 
+/* send queued events if there is no req_ctx for the interrupt endpoint.
+ * Called with the endpoint interrupt disabled */
+static int udp_refill_events(int ep)
+{
+	AT91PS_UDP pUDP = upcd.pUdp;
+	uint8_t buf[AT91C_EP_IN_SIZE];
+	int len;
+
+	len = usb_event_fill(buf, sizeof(buf));
+	__raw_writesb(&pUDP->UDP_FDR[ep], buf, len);
+
+	if (len && atomic_inc_return(&upcd.ep[ep].pkts_in_transit) == 1)
+		pUDP->UDP_CSR[ep] |= AT91C_UDP_TXPKTRDY;
+
+	/* re-enable endpoint interrupt */
+	pUDP->UDP_IER |= 1 << ep;
+
+	return len ? 1 : 0;
+}
+
 int udp_refill_ep(int ep)
 {
-	uint16_t i;
 	AT91PS_UDP pUDP = upcd.pUdp;
 	struct req_ctx *rctx;
 	unsigned int start, end;
@@ -168,6 +177,8 @@ int udp_refill_ep(int ep)
 		/* get pending rctx and start transmitting from zero */
 		rctx = req_ctx_find_get(0, epstate[ep].state_pending, 
 					epstate[ep].state_busy);
+		if (!rctx && ep == AT91C_EP_INT)
+			return udp_refill_events(ep);
 		if (!rctx) {
 			/* re-enable endpoint interrupt */
 			pUDP->UDP_IER |= 1 << ep;
@@ -185,6 +196,7 @@ int udp_refill_ep(int ep)
 			 rctx->data[rctx->tot_len - 4], rctx->data[rctx->tot_len - 3],
 			 rctx->data[rctx->tot_len - 2], rctx->data[rctx->tot_len - 1]);
 
+		frec_log(OPENPCD_FREC_USB_EP, ep, rctx->tot_len);
 		start = 0;
 
 		upcd.ep[ep].incomplete.bytes_sent = 0;
@@ -196,8 +208,7 @@ int udp_refill_ep(int ep)
 		end = start + AT91C_EP_IN_SIZE;
 
 	/* fill FIFO/DPR */
-	for (i = start; i < end; i++) 
-		pUDP->UDP_FDR[ep] = rctx->data[i];
+	__raw_writesb(&pUDP->UDP_FDR[ep], rctx->data + start, end - start);
 
 	if (atomic_inc_return(&upcd.ep[ep].pkts_in_transit) == 1) {
 		/* not been transmitting before, start transmit */
@@ -235,6 +246,7 @@ static void udp_irq(void)
 	AT91PS_UDP pUDP = upcd.pUdp;
 	AT91_REG isr = pUDP->UDP_ISR;
 
+	frec_log(OPENPCD_FREC_IRQ_ENTER, AT91C_ID_UDP, isr);
 	DEBUGI("udp_irq(imr=0x%04x, isr=0x%04x, state=%d): ", 
 		pUDP->UDP_IMR, isr, upcd.state);
 
@@ -253,7 +265,8 @@ static void udp_irq(void)
 		/* Configure endpoint 0 */
 		pUDP->UDP_CSR[0] = (AT91C_UDP_EPEDS | AT91C_UDP_EPTYPE_CTRL);
 		upcd.cur_config = 0;
-		upcd.state = USB_STATE_DEFAULT;
+		udp_set_state(USB_STATE_DEFAULT);
+		boot_mark(OPENPCD_BOOT_USB_RESET);
 		
 #ifdef CONFIG_DFU
 		if (*dfu->dfu_state == DFU_STATE_appDETACH) {
@@ -271,7 +284,7 @@ static void udp_irq(void)
 	}
 	if (isr & AT91C_UDP_EPINT1) {
 		uint32_t cur_rcv_bank = upcd.cur_rcv_bank;
-		uint16_t i, pkt_size;
+		uint16_t pkt_size;
 		struct req_ctx *rctx;
 
 		csr = pUDP->UDP_CSR[1];
@@ -312,6 +325,8 @@ static void udp_irq(void)
 				/* disable interrupts for now */
 				pUDP->UDP_IDR = AT91C_UDP_EPINT1;
 				DEBUGP("NO_RCTX_AVAIL! ");
+				frec_log(OPENPCD_FREC_USB_EP,
+					 1 | OPENPCD_FREC_EP_NO_RCTX, pkt_size);
 				goto cont_ep2;
 			}
 			rctx->tot_len = 0;
@@ -323,8 +338,9 @@ static void udp_irq(void)
 			pkt_size = rctx->size - rctx->tot_len;
 		}
 
-		for (i = 0; i < pkt_size; i++)
-			rctx->data[rctx->tot_len++] = pUDP->UDP_FDR[1];
+		__raw_readsb(&pUDP->UDP_FDR[1], rctx->data + rctx->tot_len,
+			     pkt_size);
+		rctx->tot_len += pkt_size;
 
 		pUDP->UDP_CSR[1] &= ~cur_rcv_bank;
 
@@ -341,6 +357,7 @@ static void udp_irq(void)
 		 * stack */
 		if (pkt_size < AT91C_EP_IN_SIZE) {
 			DEBUGIO("RCTX_rx_done ");
+			frec_log(OPENPCD_FREC_USB_EP, 1, rctx->tot_len);
 			req_ctx_set_state(rctx, RCTX_STATE_UDP_RCV_DONE);
 			upcd.ep[1].incomplete.rctx = NULL;
 		} else {
@@ -384,7 +401,7 @@ cont_ep2:
 		pUDP->UDP_ICR = AT91C_UDP_RXSUSP;
 		DEBUGI("RXSUSP ");
 #ifdef CONFIG_USB_SUSPEND
-		upcd.state = USB_STATE_SUSPENDED;
+		udp_set_state(USB_STATE_SUSPENDED);
 		/* FIXME: implement suspend/resume correctly. This
 		 * involves saving the pre-suspend state, and calling back
 		 * into the main application program to ask it to power down
@@ -396,7 +413,7 @@ cont_ep2:
 		DEBUGI("RXRSM ");
 #ifdef CONFIG_USB_SUSPEND
 		if (upcd.state == USB_STATE_SUSPENDED)
-			upcd.state = USB_STATE_CONFIGURED;
+			udp_set_state(USB_STATE_CONFIGURED);
 		/* FIXME: implement suspend/resume */
 #endif
 	}
@@ -415,6 +432,7 @@ cont_ep2:
 	}
 out:
 	DEBUGI("END\r\n");
+	frec_log(OPENPCD_FREC_IRQ_EXIT, AT91C_ID_UDP, 0);
 	AT91F_AIC_ClearIt(AT91C_BASE_AIC, AT91C_ID_UDP);
 }
 
@@ -444,7 +462,7 @@ void udp_open(void)
 	upcd.cur_rcv_bank = AT91C_UDP_RX_DATA_BK0;
 	/* This should start with USB_STATE_NOTATTACHED, but we're a pure
 	 * bus powered device and thus start with powered */
-	upcd.state = USB_STATE_POWERED;
+	udp_set_state(USB_STATE_POWERED);
 
 	AT91F_AIC_ConfigureIt(AT91C_BASE_AIC, AT91C_ID_UDP,
 			      OPENPCD_IRQ_PRIO_UDP,
@@ -627,13 +645,14 @@ static void udp_ep0_handler(void)
 			} else {
 				pUDP->UDP_FADDR = (AT91C_UDP_FEN | wValue);
 				pUDP->UDP_GLBSTATE = AT91C_UDP_FADDEN;
-				upcd.state = USB_STATE_ADDRESS;
+				udp_set_state(USB_STATE_ADDRESS);
+				boot_mark(OPENPCD_BOOT_USB_ADDRESS);
 			}
 			break;
 		case USB_STATE_ADDRESS:
 			udp_ep0_send_zlp();
 			if (wValue == 0) {
-				upcd.state = USB_STATE_DEFAULT;
+				udp_set_state(USB_STATE_DEFAULT);
 			} else {
 				pUDP->UDP_FADDR = (AT91C_UDP_FEN | wValue);
 			}
@@ -651,7 +670,7 @@ static void udp_ep0_handler(void)
 		}
 		if ((wValue & 0xff) == 0) {
 			DEBUGE("VALUE==0 ");
-			upcd.state = USB_STATE_ADDRESS;
+			udp_set_state(USB_STATE_ADDRESS);
 			pUDP->UDP_GLBSTATE = AT91C_UDP_FADDEN;
 			pUDP->UDP_CSR[1] = 0;
 			pUDP->UDP_CSR[2] = 0;
@@ -659,7 +678,7 @@ static void udp_ep0_handler(void)
 		} else if ((wValue & 0xff) <=
 					dev_descriptor.bNumConfigurations) {
 			DEBUGE("VALUE!=0 ");
-			upcd.state = USB_STATE_CONFIGURED;
+			udp_set_state(USB_STATE_CONFIGURED);
 			pUDP->UDP_GLBSTATE = AT91C_UDP_CONFG;
 			pUDP->UDP_CSR[1] = AT91C_UDP_EPEDS |
 					   AT91C_UDP_EPTYPE_BULK_OUT;
@@ -667,6 +686,9 @@ static void udp_ep0_handler(void)
 					   AT91C_UDP_EPTYPE_BULK_IN;
 			pUDP->UDP_CSR[3] = AT91C_UDP_EPEDS |
 					   AT91C_UDP_EPTYPE_INT_IN;
+			/* run the deferred init before the first request */
+			boot_mark(OPENPCD_BOOT_USB_CONFIGURED);
+			sched_post(SCHED_BOOT);
 		} else {
 			/* invalid configuration */
 			goto out_stall;
@@ -18,60 +18,98 @@
  */
 
 #include <errno.h>
+#include <string.h>
 #include <sys/types.h>
 #include <lib_AT91SAM7.h>
+#include <asm/system.h>
 #include <os/pio_irq.h>
 #include <os/dbgu.h>
 #include <os/req_ctx.h>
+#include <os/usb_event.h>
+#include <os/usb_handler.h>
+#include <os/frec.h>
+#include <os/tc_tb.h>
+#include <os/sched.h>
 #include <openpcd.h>
 
+/* edges between two runs of pio_irq_process(), power of two */
+#define PIO_EDGE_RING	32
+#define PIO_EDGE_MASK	(PIO_EDGE_RING - 1)
+
+/* edges per report on the interrupt endpoint */
+#define PIO_EDGE_BATCH	16
+
 struct pioirq_state {
 	irq_handler_t *handlers[NR_PIO];
 	uint32_t usbmask;
-	uint32_t usb_throttled; /* atomic? */
+	uint32_t deferred;
+	/* lines with a handler that is called from the interrupt */
+	uint32_t immediate;
+	uint32_t handled;
+	uint32_t capture;
+	pio_edge_handler_t *capture_cb;
+	unsigned int capture_lost;
+	int initialized;
+
+	/* written by the interrupt (head) and the main loop (tail) */
+	struct openpcd_pio_edge ring[PIO_EDGE_RING];
+	volatile uint8_t head;
+	volatile uint8_t tail;
+	volatile uint8_t lost;
+	/* edges the main loop has not been able to send yet */
+	uint8_t usb_lost;
+	const struct openpcd_pio_edge *cur;
 };
 
 static struct pioirq_state pirqs;
 
+/* position of the lowest set bit.  ARMv4T has no clz, multiplying the
+ * isolated bit with a de Bruijn sequence puts a unique pattern into the
+ * top five bits. */
+static const uint8_t debruijn_pos[32] = {
+	0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+	31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9,
+};
+
+static inline unsigned int lowest_bit(uint32_t x)
+{
+	return debruijn_pos[((x & -x) * 0x077CB531U) >> 27];
+}
+
 /* low-level handler, used by Cstartup_app.S PIOA fast forcing and
  * by regular interrupt handler below */
 void __ramfunc __pio_irq_demux(uint32_t pio)
 {
-	uint8_t send_usb = 0;
-	int i;
+	uint32_t todo;
 
 	//DEBUGPCRF("PIO_ISR_STATUS = 0x%08x", pio);
+	frec_log(OPENPCD_FREC_IRQ_ENTER, AT91C_ID_PIOA, pio);
 
-	for (i = 0; i < NR_PIO; i++) {
-		if (pio & (1 << i) && pirqs.handlers[i])
-			pirqs.handlers[i](i);
-		if (pirqs.usbmask & (1 << i))
-			send_usb = 1;
+	/* visit only the lines that changed and have a handler */
+	for (todo = pio & pirqs.immediate; todo; todo &= todo - 1) {
+		unsigned int i = lowest_bit(todo);
+		pirqs.handlers[i](i);
 	}
 
-	if (send_usb && !pirqs.usb_throttled) {
-		struct req_ctx *irq_rctx;
-		irq_rctx = req_ctx_find_get(0, RCTX_STATE_FREE,
-					    RCTX_STATE_PIOIRQ_BUSY);
-		if (!irq_rctx) {
-			/* we cannot disable the interrupt, since we have
-			 * non-usb listeners */
-			pirqs.usb_throttled = 1;
+	/* everything else is queued for pio_irq_process() */
+	if (pio & (pirqs.deferred | pirqs.usbmask | pirqs.capture)) {
+		uint8_t head = pirqs.head;
+
+		if (((head + 1) & PIO_EDGE_MASK) == pirqs.tail) {
+			if (pirqs.lost < 0xff)
+				pirqs.lost++;
 		} else {
-			struct openpcd_hdr *opcdh;
-			uint32_t *regmask;
-			opcdh = (struct openpcd_hdr *) irq_rctx->data;
-			regmask = (uint32_t *) (irq_rctx->data + sizeof(*opcdh));
-			opcdh->cmd = OPENPCD_CMD_PIO_IRQ;
-			opcdh->reg = 0x00;
-			opcdh->flags = 0x00;
-			opcdh->val = 0x00;
-
-			irq_rctx->tot_len = sizeof(*opcdh) + sizeof(uint32_t);
-			req_ctx_set_state(irq_rctx, RCTX_STATE_UDP_EP3_PENDING);
+			struct openpcd_pio_edge *e = &pirqs.ring[head];
+
+			e->stamp = tc_tb_now();
+			e->pio = pio;
+			e->level = AT91C_BASE_PIOA->PIO_PDSR;
+			pirqs.head = (head + 1) & PIO_EDGE_MASK;
 		}
+		sched_post(SCHED_PIO);
 	}
 
+	frec_log(OPENPCD_FREC_IRQ_EXIT, AT91C_ID_PIOA, 0);
 	AT91F_AIC_ClearIt(AT91C_BASE_AIC, AT91C_ID_PIOA);
 }
 
@@ -82,6 +120,153 @@ static void pio_irq_demux(void)
 	__pio_irq_demux(pio);
 }
 
+/* both masks are read by the FIQ */
+static void pio_irq_update(void)
+{
+	unsigned long flags;
+	uint32_t handled = 0;
+	int i;
+
+	for (i = 0; i < NR_PIO; i++) {
+		if (pirqs.handlers[i])
+			handled |= 1 << i;
+	}
+
+	local_irq_save(flags);
+	local_fiq_disable();
+	pirqs.handled = handled;
+	pirqs.immediate = handled & ~pirqs.deferred;
+	local_irq_restore(flags);
+}
+
+static void pio_irq_usb_lost(unsigned int num)
+{
+	num += pirqs.usb_lost;
+	pirqs.usb_lost = num > 0xff ? 0xff : num;
+}
+
+/* start a report with the edges of the ring from 'tail' on.  Without a
+ * req_ctx the lines are merged into a single event instead. */
+static uint8_t pio_irq_report(uint8_t tail, uint8_t head)
+{
+	struct req_ctx *rctx;
+	struct openpcd_hdr *poh;
+	struct openpcd_pio_edge *e;
+	unsigned int num = 0;
+
+	rctx = req_ctx_find_get(0, RCTX_STATE_FREE, RCTX_STATE_PIOIRQ_BUSY);
+	if (!rctx) {
+		uint32_t pio = 0;
+
+		/* only the time stamps are lost */
+		for (; tail != head; tail = (tail + 1) & PIO_EDGE_MASK) {
+			if (pirqs.ring[tail].pio & pirqs.usbmask) {
+				pio |= pirqs.ring[tail].pio & pirqs.usbmask;
+				num++;
+			}
+		}
+		if (pio && usb_event_post(OPENPCD_CMD_PIO_IRQ, 0x00, 0x00,
+					  &pio, sizeof(pio),
+					  USB_EVENT_F_COALESCE) < 0)
+			pio_irq_usb_lost(num);
+		return tail;
+	}
+
+	poh = (struct openpcd_hdr *) rctx->data;
+	e = (struct openpcd_pio_edge *) poh->data;
+	for (; tail != head && num < PIO_EDGE_BATCH;
+	     tail = (tail + 1) & PIO_EDGE_MASK) {
+		if (!(pirqs.ring[tail].pio & pirqs.usbmask))
+			continue;
+		memcpy(&e[num], &pirqs.ring[tail], sizeof(*e));
+		e[num].pio &= pirqs.usbmask;
+		num++;
+	}
+
+	if (!num) {
+		req_ctx_put(rctx);
+		return tail;
+	}
+
+	poh->cmd = OPENPCD_CMD_PIO_IRQ;
+	poh->flags = 0;
+	poh->reg = pirqs.usb_lost;
+	poh->val = num;
+	pirqs.usb_lost = 0;
+	rctx->tot_len = sizeof(*poh) + num * sizeof(*e);
+	usb_in_pad(rctx);
+	req_ctx_set_state(rctx, RCTX_STATE_UDP_EP3_PENDING);
+
+	return tail;
+}
+
+/* SCHED_PIO task: run the deferred handlers and send the
+ * queued edges to the host */
+void pio_irq_process(void)
+{
+	uint8_t tail = pirqs.tail, head = pirqs.head;
+	uint8_t lost;
+	unsigned long flags;
+
+	if (pirqs.lost) {
+		local_irq_save(flags);
+		local_fiq_disable();
+		lost = pirqs.lost;
+		pirqs.lost = 0;
+		local_irq_restore(flags);
+
+		if (pirqs.usbmask)
+			pio_irq_usb_lost(lost);
+		if (pirqs.capture)
+			pirqs.capture_lost += lost;
+		DEBUGPCRF("%u edges lost", lost);
+	}
+
+	if (tail == head)
+		return;
+
+	if (pirqs.deferred) {
+		uint8_t t;
+
+		for (t = tail; t != head; t = (t + 1) & PIO_EDGE_MASK) {
+			uint32_t todo;
+
+			pirqs.cur = &pirqs.ring[t];
+			todo = pirqs.cur->pio & pirqs.deferred;
+			for (; todo; todo &= todo - 1) {
+				unsigned int i = lowest_bit(todo);
+				if (pirqs.handlers[i])
+					pirqs.handlers[i](i);
+			}
+		}
+		pirqs.cur = NULL;
+	}
+
+	if (pirqs.capture) {
+		uint8_t t;
+
+		for (t = tail; t != head; t = (t + 1) & PIO_EDGE_MASK) {
+			if (!(pirqs.ring[t].pio & pirqs.capture))
+				continue;
+			pirqs.capture_cb(&pirqs.ring[t], pirqs.capture_lost);
+			pirqs.capture_lost = 0;
+		}
+	}
+
+	if (pirqs.usbmask) {
+		while (tail != head)
+			tail = pio_irq_report(tail, head);
+	}
+
+	pirqs.tail = head;
+}
+
+/* the edge a deferred handler is called for, NULL in interrupt context */
+const struct openpcd_pio_edge *pio_irq_edge(void)
+{
+	return pirqs.cur;
+}
+
 void pio_irq_enable(uint32_t pio)
 {
 	AT91F_PIO_InterruptEnable(AT91C_BASE_PIOA, pio);
@@ -106,6 +291,7 @@ int pio_irq_register(uint32_t pio, irq_handler_t *handler)
 	pio_irq_disable(pio);
 	AT91F_PIO_CfgInput(AT91C_BASE_PIOA, pio);
 	pirqs.handlers[num] = handler;
+	pio_irq_update();
 	DEBUGPCRF("registering handler %p for PIOA %u", handler, num);
 
 	return 0;
@@ -121,26 +307,49 @@ void pio_irq_unregister(uint32_t pio)
 
 	pio_irq_disable(pio);
 	pirqs.handlers[num] = NULL;
+	pio_irq_update();
 }
 
-static int pio_irq_usb_in(struct req_ctx *rctx)
+/* call the handlers of these lines from pio_irq_process() instead of
+ * the interrupt, with the time stamp of the edge in pio_irq_edge() */
+void pio_irq_set_deferred(uint32_t pio, int deferred)
 {
-	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+	if (deferred)
+		pirqs.deferred |= pio;
+	else
+		pirqs.deferred &= ~pio;
+	pio_irq_update();
+}
 
-	switch (poh->cmd) {
-	case OPENPCD_CMD_PIO_IRQ:
-		pirqs.usbmask = poh->val;
-		break;
-	default:
-		DEBUGP("UNKNOWN ");
-		return -EINVAL;
-	}
+/* pass all edges of these lines to 'cb' in pio_irq_process(), together
+ * with the number of edges lost in between.  Unlike
+ * handlers this doesn't change the configuration of the lines, so also
+ * lines driven by a peripheral can be watched. */
+void pio_irq_set_capture(uint32_t pio, pio_edge_handler_t *cb)
+{
+	uint32_t old = pirqs.capture;
 
-	return 0;
+	pirqs.capture_cb = cb;
+	pirqs.capture = pio;
+	pirqs.capture_lost = 0;
+	AT91F_PIO_InterruptEnable(AT91C_BASE_PIOA, pio);
+	AT91F_PIO_InterruptDisable(AT91C_BASE_PIOA,
+				   old & ~pio & ~pirqs.handled);
+}
+
+/* lines whose edges are reported on the interrupt endpoint */
+void pio_irq_set_usbmask(uint32_t pio)
+{
+	pirqs.usbmask = pio;
+	pirqs.usb_lost = 0;
 }
 
 void pio_irq_init(void)
 {
+	if (pirqs.initialized)
+		return;
+	pirqs.initialized = 1;
+
 	AT91F_PIOA_CfgPMC();
 	AT91F_AIC_ConfigureIt(AT91C_BASE_AIC, AT91C_ID_PIOA,
 			      AT91C_AIC_PRIOR_LOWEST,
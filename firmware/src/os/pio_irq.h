@@ -10,4 +10,14 @@ extern int pio_irq_register(uint32_t pio, irq_handler_t *func);
 extern void pio_irq_unregister(uint32_t pio);
 extern void pio_irq_init(void);
 
+/* deferred handlers and edge reports, see pio_irq.c */
+struct openpcd_pio_edge;
+typedef void pio_edge_handler_t(const struct openpcd_pio_edge *edge,
+				unsigned int lost);
+extern void pio_irq_set_deferred(uint32_t pio, int deferred);
+extern void pio_irq_set_usbmask(uint32_t pio);
+extern void pio_irq_process(void);
+extern const struct openpcd_pio_edge *pio_irq_edge(void);
+extern void pio_irq_set_capture(uint32_t pio, pio_edge_handler_t *cb);
+
 #endif
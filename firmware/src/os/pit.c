@@ -14,12 +14,12 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program; if not, write to the Free Software
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
- *
- *
- * TODO: handle jiffies wrap correctly!
  */
 
+#define DEBUG_MODULE	DEBUG_MOD_PIT
+
 #include <errno.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <asm/system.h>
 
@@ -33,53 +33,74 @@
 
 /* PIT runs at MCK/16 (= 3MHz) */
 #define PIV_MS(x)		(x * 3000)
+#define PIT_JIFFY		(3000000 / HZ)
+
+/* longest PIT period, PIV has 20 bits */
+#define PIT_MAX_PERIOD		((1 << 20) / PIT_JIFFY - 1)
+/* don't move the end of a PIT period closer than this (100us) */
+#define PIT_MARGIN		300
 
-static struct timer_list *timers;
+/* Software timers live in a hierarchical timer wheel, as in the Linux
+ * kernel: level 0 has one slot per jiffy for the next TVR_SIZE jiffies,
+ * every slot of a higher level covers a whole turn of the level below.
+ * Adding and removing a timer is O(1); a tick only looks at one slot and
+ * every TVR_SIZE ticks moves one slot of the next level down.  Timers
+ * further out than the wheel reaches are parked in the last level and
+ * re-filed as it cascades. */
+#define TVR_BITS	5
+#define TVN_BITS	5
+#define TVN_LEVELS	2
+#define TVR_SIZE	(1 << TVR_BITS)
+#define TVN_SIZE	(1 << TVN_BITS)
+#define TVR_MASK	(TVR_SIZE - 1)
+#define TVN_MASK	(TVN_SIZE - 1)
+#define TV_MAX		((1UL << (TVR_BITS + TVN_LEVELS * TVN_BITS)) - 1)
+
+static struct timer_list *tvr[TVR_SIZE];
+static struct timer_list *tvn[TVN_LEVELS][TVN_SIZE];
+
+/* next jiffy whose level 0 slot has to be run */
+static unsigned long timer_jiffies;
 
 volatile unsigned long jiffies;
 
 static void __timer_insert(struct timer_list *new)
 {
-	struct timer_list *tl, *tl_prev = NULL;
+	unsigned long expires = new->expires;
+	long delta = expires - timer_jiffies;
+	struct timer_list **slot;
 
-	if (!timers) {
-		/* optimize for the common, fast case */
-		new->next = NULL;
-		timers = new;
-		return;
+	if (delta < 0) {
+		/* already expired, run on the next tick */
+		slot = &tvr[timer_jiffies & TVR_MASK];
+	} else if (delta < TVR_SIZE) {
+		slot = &tvr[expires & TVR_MASK];
+	} else if (delta < 1 << (TVR_BITS + TVN_BITS)) {
+		slot = &tvn[0][(expires >> TVR_BITS) & TVN_MASK];
+	} else {
+		if (delta > TV_MAX)
+			expires = timer_jiffies + TV_MAX;
+		slot = &tvn[1][(expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK];
 	}
 
-	for (tl = timers; tl != NULL; tl = tl->next) {
-		if (tl->expires < new->expires) {
-			/* we need ot add just before this one */
-			if (!tl_prev) {
-				new->next = timers;
-				timers = new;
-			} else {
-				new->next = tl;
-				tl_prev->next = new;
-			}
-		}
-		tl_prev = tl;
-	}
+	new->next = *slot;
+	if (new->next)
+		new->next->pprev = &new->next;
+	new->pprev = slot;
+	*slot = new;
 }
 
 static int __timer_remove(struct timer_list *old)
 {
-	struct timer_list *tl, *tl_prev = NULL;
-
-	for (tl = timers; tl != NULL; tl = tl->next) {
-		if (tl == old) {
-			if (tl == timers)
-				timers = tl->next;
-			else
-				tl_prev->next = tl->next;
-			return 1;
-		}
-		tl_prev = tl;
-	}
+	if (!old->pprev)
+		return 0;
+
+	*old->pprev = old->next;
+	if (old->next)
+		old->next->pprev = old->pprev;
+	old->pprev = NULL;
 
-	return 0;
+	return 1;
 }
 
 int timer_del(struct timer_list *tl)
@@ -94,62 +115,171 @@ int timer_del(struct timer_list *tl)
 	return ret;
 }
 
+/* (re-)arm a timer, a pending one is moved to its new expiry time */
 void timer_add(struct timer_list *tl)
 {
 	unsigned long flags;
 
 	local_irq_save(flags);
+	__timer_remove(tl);
 	__timer_insert(tl);
 	local_irq_restore(flags);
 }
 
-static void pit_irq(uint32_t sr)
+/* move all timers of one slot down to the lower levels */
+static void cascade(struct timer_list **slot)
 {
-	struct timer_list *tl, *next;
+	struct timer_list *tl = *slot, *next;
 
-	if (!(sr & 0x1))
-		return;
+	*slot = NULL;
+	for (; tl; tl = next) {
+		next = tl->next;
+		__timer_insert(tl);
+	}
+}
 
-	jiffies += *AT91C_PITC_PIVR >> 20;
+/* number of jiffies until timer_run() has work to do: the next timer in
+ * level 0, or the next cascade */
+static unsigned int timer_next(void)
+{
+	unsigned long j = timer_jiffies;
 
-	/* this is the most simple/stupid algorithm one can come up with, but
-	 * hey, we're on a small embedded platform with only a hand ful
-	 * of timers, at all */
-	for (tl = timers; tl != NULL; tl = next) {
-		next = tl->next;
-		if (tl->expires <= jiffies) {
-			/* delete timer from list */
-			timer_del(tl);
+	while (!tvr[j & TVR_MASK] && (j & TVR_MASK))
+		j++;
+
+	/* overdue, pit_irq() hasn't caught up with jiffies yet */
+	if ((long)(j - jiffies) <= 0)
+		return 1;
+
+	return j - jiffies;
+}
+
+/* run all timers that expired up to jiffies, called from the PIT
+ * interrupt */
+void timer_run(void)
+{
+	struct timer_list *head, *tl;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	while ((long)(jiffies - timer_jiffies) >= 0) {
+		unsigned int idx = timer_jiffies & TVR_MASK;
+
+		if (!idx) {
+			unsigned int idx1 = (timer_jiffies >> TVR_BITS) &
+								TVN_MASK;
+			if (!idx1)
+				cascade(&tvn[1][(timer_jiffies >>
+					(TVR_BITS + TVN_BITS)) & TVN_MASK]);
+			cascade(&tvn[0][idx1]);
+		}
+
+		/* timers added by the callbacks go to later slots */
+		timer_jiffies++;
+		head = tvr[idx];
+		if (!head)
+			continue;
+		tvr[idx] = NULL;
+		head->pprev = &head;
+
+		while ((tl = head)) {
+			__timer_remove(tl);
+			local_irq_restore(flags);
 			tl->function(tl->data);
+			local_irq_save(flags);
 		}
 	}
+	local_irq_restore(flags);
 }
 
-void pit_mdelay(uint32_t ms)
+/* The PIT normally interrupts every jiffy.  Before the CPU goes idle,
+ * pit_tickless_enter() stretches the current PIT period up to the next
+ * timer expiry, and pit_tickless_exit() ends it at the next jiffy once
+ * something else woke us up.  Periods always last a whole number of
+ * jiffies and start at a jiffy boundary, pit_base. */
+static unsigned long pit_base;
+static unsigned int pit_period = 1;
+
+/* let the current PIT period last n jiffies, or as close to that as it
+ * safely can.  Called with IRQs disabled and PICNT == 0 */
+static void pit_set_period(unsigned int n)
 {
-	uint32_t end;
+	uint32_t cpiv = AT91F_PITGetPIIR(AT91C_BASE_PITC) & 0xfffff;
+	unsigned int min = (cpiv + PIT_MARGIN) / PIT_JIFFY + 1;
+
+	/* too late, the period might end before PIV is written */
+	if (cpiv + PIT_MARGIN > pit_period * PIT_JIFFY)
+		return;
 
-	end = (AT91F_PITGetPIIR(AT91C_BASE_PITC) + ms) % 20;
+	if (n > PIT_MAX_PERIOD)
+		n = PIT_MAX_PERIOD;
+	if (n < min)
+		n = min;
+	if (n == pit_period)
+		return;
 
-	while (end < AT91F_PITGetPIIR(AT91C_BASE_PITC)) { }
+	AT91C_BASE_PITC->PITC_PIMR = AT91C_PITC_PITEN | AT91C_PITC_PITIEN |
+				     (n * PIT_JIFFY - 1);
+	pit_period = n;
 }
 
-void mdelay(uint32_t ms)
+/* called with IRQs disabled, right before the CPU goes idle */
+void pit_tickless_enter(void)
 {
-	return pit_mdelay(ms);
+	if (AT91F_PITGetPIIR(AT91C_BASE_PITC) >> 20)
+		return;
+
+	pit_set_period(timer_next());
 }
 
-void usleep(uint32_t us)
+/* called with IRQs disabled, right after the CPU woke up */
+void pit_tickless_exit(void)
 {
-	return;
-	return pit_mdelay(us/1000);
+	uint32_t piir = AT91F_PITGetPIIR(AT91C_BASE_PITC);
+
+	/* if the period is over, pit_irq() takes care of everything */
+	if (pit_period == 1 || (piir >> 20))
+		return;
+
+	/* catch up with the jiffies that passed while we were idle, no
+	 * timers expired during them */
+	jiffies = pit_base + (piir & 0xfffff) / PIT_JIFFY;
+	pit_set_period(1);
+}
+
+static void pit_irq(uint32_t sr)
+{
+	if (!(sr & 0x1))
+		return;
+
+	pit_base += (*AT91C_PITC_PIVR >> 20) * pit_period;
+	jiffies = pit_base;
+	pit_set_period(1);
+
+	timer_run();
+}
+
+/* free running microsecond counter, wraps after ~71 minutes */
+uint32_t pit_ticks(void)
+{
+	unsigned long flags;
+	uint32_t piir, ticks;
+
+	local_irq_save(flags);
+	piir = AT91F_PITGetPIIR(AT91C_BASE_PITC);
+	/* PICNT counts periods not yet added to pit_base by pit_irq() */
+	ticks = (pit_base + (piir >> 20) * pit_period) * (1000000 / HZ) +
+		(piir & 0xfffff) / 3;
+	local_irq_restore(flags);
+
+	return ticks;
 }
 
 void pit_init(void)
 {
 	AT91F_PITC_CfgPMC();
 
-	AT91F_PITInit(AT91C_BASE_PITC, 1000000/HZ /* uS */, 48 /* MHz */);
+	AT91C_BASE_PITC->PITC_PIMR = AT91C_PITC_PITEN | (PIT_JIFFY - 1);
 
 	sysirq_register(AT91SAM7_SYSIRQ_PIT, &pit_irq);	
 
@@ -9,6 +9,7 @@
 
 struct timer_list {
 	struct timer_list *next;
+	struct timer_list **pprev;	/* NULL unless pending */
 	unsigned long expires;
 	void (*function)(void *data);
 	void *data;
@@ -18,8 +19,11 @@ extern volatile unsigned long jiffies;
 
 extern void timer_add(struct timer_list *timer);
 extern int timer_del(struct timer_list *timer);
+extern void timer_run(void);
 
 extern void pit_init(void);
-extern void pit_mdelay(uint32_t ms);
+extern uint32_t pit_ticks(void);
+extern void pit_tickless_enter(void);
+extern void pit_tickless_exit(void);
 
 #endif
@@ -0,0 +1,167 @@
+/* Function profile for PROFILE=1 builds
+ *
+ * The firmware is compiled with -finstrument-functions, so every
+ * function calls __cyg_profile_func_enter() and _exit().  These keep a
+ * shadow of the call stack with TC1 timebase stamps and add up, per
+ * function, the calls, the inclusive ticks and the self ticks, which
+ * leave out the callees.  Interrupts nest on the same stack, so their
+ * handlers show up as callees of whatever they interrupted and don't
+ * count against its self time.  The hooks themselves cost about a
+ * microsecond per call, which ends up in the callers.
+ *
+ * host/opcd_prof reads the table, scripts/ramfunc.py turns it into a list
+ * of functions for the RAMFUNCS= build.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <string.h>
+#include <sys/types.h>
+#include <asm/system.h>
+#include <openpcd.h>
+#include <os/profile.h>
+#include <os/tc_tb.h>
+#include <os/usb_handler.h>
+#include <os/req_ctx.h>
+
+#define PROF_FUNCS	256		/* power of two */
+#define PROF_DEPTH	32
+
+#define __noprof	__attribute__ ((no_instrument_function))
+
+static struct openpcd_prof_entry prof[PROF_FUNCS];
+static unsigned int prof_num, prof_lost;
+
+static struct {
+	void *fn;
+	uint32_t start;
+	uint32_t child;			/* inclusive ticks of the callees */
+} stack[PROF_DEPTH];
+static unsigned int depth;
+
+extern void __cyg_profile_func_enter(void *fn, void *call_site) __noprof;
+extern void __cyg_profile_func_exit(void *fn, void *call_site) __noprof;
+
+static void __noprof prof_account(void *fn, uint32_t incl, uint32_t self)
+{
+	uint32_t addr = (uint32_t) fn;
+	unsigned int i = (addr >> 2) & (PROF_FUNCS - 1);
+
+	/* open addressing, entries are never removed but by clearing all */
+	while (prof[i].addr != addr) {
+		if (!prof[i].addr) {
+			if (prof_num >= PROF_FUNCS - 1) {
+				prof_lost++;
+				return;
+			}
+			prof[i].addr = addr;
+			prof_num++;
+			break;
+		}
+		i = (i + 1) & (PROF_FUNCS - 1);
+	}
+	prof[i].calls++;
+	prof[i].incl += incl;
+	prof[i].self += self;
+}
+
+void __noprof __cyg_profile_func_enter(void *fn, void *call_site)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	local_fiq_disable();
+	if (depth < PROF_DEPTH) {
+		stack[depth].fn = fn;
+		stack[depth].child = 0;
+		stack[depth].start = tc_tb_now();
+	}
+	depth++;
+	local_irq_restore(flags);
+}
+
+void __noprof __cyg_profile_func_exit(void *fn, void *call_site)
+{
+	unsigned long flags;
+	uint32_t incl;
+
+	local_irq_save(flags);
+	local_fiq_disable();
+	if (depth && --depth < PROF_DEPTH && stack[depth].fn == fn) {
+		incl = tc_tb_now() - stack[depth].start;
+		if (depth)
+			stack[depth - 1].child += incl;
+		prof_account(fn, incl, incl - stack[depth].child);
+	}
+	local_irq_restore(flags);
+}
+
+/* copy page 'page' of the used entries to 'buf' */
+static int __noprof prof_read(void *buf, unsigned int page, int clear)
+{
+	struct openpcd_prof_hdr *hdr = buf;
+	struct openpcd_prof_entry *ent = (void *) (hdr + 1);
+	unsigned long flags;
+	unsigned int i, skip = page * OPENPCD_PROF_PAGE, num = 0;
+
+	local_irq_save(flags);
+	local_fiq_disable();
+	hdr->num = prof_num;
+	hdr->lost = prof_lost > 0xffff ? 0xffff : prof_lost;
+	hdr->tick_cycles = MCK / TC_TB_HZ;
+	for (i = 0; i < PROF_FUNCS && num < OPENPCD_PROF_PAGE; i++) {
+		if (!prof[i].addr)
+			continue;
+		if (skip) {
+			skip--;
+			continue;
+		}
+		memcpy(&ent[num++], &prof[i], sizeof(*ent));
+	}
+	if (clear) {
+		memset(prof, 0, sizeof(prof));
+		prof_num = prof_lost = 0;
+	}
+	local_irq_restore(flags);
+
+	return num;
+}
+
+static int __noprof prof_usb_rx(struct req_ctx *rctx)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+
+	rctx->tot_len = sizeof(*poh);
+
+	switch (poh->cmd) {
+	case OPENPCD_CMD_PROF_READ:
+		/* 12 + 16n bytes, never a multiple of the EP size */
+		poh->val = prof_read(poh->data, poh->reg,
+				     poh->val & OPENPCD_PROF_CLEAR);
+		rctx->tot_len += sizeof(struct openpcd_prof_hdr) +
+				 poh->val * sizeof(struct openpcd_prof_entry);
+		break;
+	default:
+		return USB_ERR(USB_ERR_CMD_UNKNOWN);
+	}
+
+	return USB_RET_RESPOND;
+}
+
+void __noprof profile_init(void)
+{
+	usb_hdlr_register(&prof_usb_rx, OPENPCD_CMD_CLS_PROFILE);
+}
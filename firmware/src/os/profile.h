@@ -0,0 +1,10 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#ifdef CONFIG_PROFILE
+extern void profile_init(void);
+#else
+static inline void profile_init(void) {}
+#endif
+
+#endif /* _PROFILE_H */
@@ -17,12 +17,19 @@
  *
  */
 
+#define DEBUG_MODULE	DEBUG_MOD_REQ_CTX
+
+#include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <asm/bitops.h>
 #include <os/dbgu.h>
+#include <os/pit.h>
 #include <os/req_ctx.h>
+#include <os/frec.h>
+#include <os/sched.h>
 
 #include "../openpcd.h"
 
@@ -47,6 +54,94 @@ static struct req_ctx req_ctx[NUM_REQ_CTX];
 static struct req_ctx *req_ctx_queues[RCTX_STATE_COUNT], *req_ctx_tails[RCTX_STATE_COUNT];
 static unsigned req_counts[RCTX_STATE_COUNT];
 
+static const uint8_t state_owner[RCTX_STATE_COUNT] = {
+	[RCTX_STATE_UDP_RCV_BUSY]	= RCTX_OWNER_USB_RX,
+	[RCTX_STATE_MAIN_PROCESSING]	= RCTX_OWNER_REPLY,
+	[RCTX_STATE_SSC_RX_BUSY]	= RCTX_OWNER_SSC,
+	[RCTX_STATE_LIBRFID_BUSY]	= RCTX_OWNER_CAPTURE,
+	[RCTX_STATE_PIOIRQ_BUSY]	= RCTX_OWNER_EDGES,
+};
+
+/* The reply path always finds a context, even while the host floods us
+ * with commands or a capture stream isn't drained.  Each stream has a
+ * cap of its own, so one that stalls leaves room for the others. */
+static struct {
+	uint8_t min;
+	uint8_t max;
+	uint8_t used;
+} quota[RCTX_OWNER_COUNT] = {
+	[RCTX_OWNER_OTHER]	= { .min = 0, .max = NUM_REQ_CTX },
+	[RCTX_OWNER_USB_RX]	= { .min = 2, .max = NUM_REQ_CTX - 2 },
+	[RCTX_OWNER_REPLY]	= { .min = 2, .max = NUM_REQ_CTX },
+	[RCTX_OWNER_SSC]	= { .min = 0, .max = NUM_REQ_CTX / 2 },
+	[RCTX_OWNER_CAPTURE]	= { .min = 0, .max = NUM_REQ_CTX / 2 },
+	[RCTX_OWNER_EDGES]	= { .min = 0, .max = NUM_REQ_CTX / 2 },
+};
+
+/* may 'owner' take a free context without eating into the reserves of
+ * the others?  Called with IRQs disabled */
+static inline int req_ctx_admit(unsigned int owner)
+{
+	unsigned int i, reserved = 0;
+
+	if (quota[owner].used >= quota[owner].max)
+		return 0;
+
+	for (i = 0; i < RCTX_OWNER_COUNT; i++) {
+		if (i != owner && quota[i].used < quota[i].min)
+			reserved += quota[i].min - quota[i].used;
+	}
+	return req_counts[RCTX_STATE_FREE] > reserved;
+}
+
+/* occupancy and time-in-state statistics, see OPENPCD_CMD_RCTX_STATS */
+static uint8_t req_max[RCTX_STATE_COUNT];
+static uint32_t req_enter[RCTX_STATE_COUNT];
+static uint32_t req_hist[RCTX_STATE_COUNT][OPENPCD_RCTX_HIST_LEN];
+
+/* called with IRQs disabled, after ctx has been moved to new_state */
+static inline void req_ctx_account(struct req_ctx *ctx, unsigned old_state,
+				   unsigned new_state)
+{
+	uint32_t now = pit_ticks();
+	uint32_t dt = now - ctx->stamp;
+	unsigned int bucket = 0;
+
+	while (dt > 1 && bucket < OPENPCD_RCTX_HIST_LEN - 1) {
+		dt >>= 1;
+		bucket++;
+	}
+	req_hist[old_state][bucket]++;
+	ctx->stamp = now;
+	frec_log_at(now, OPENPCD_FREC_RCTX, new_state,
+		    req_ctx_num(ctx) << 8 | old_state);
+
+	if (old_state == RCTX_STATE_FREE && new_state != RCTX_STATE_FREE) {
+		ctx->owner = state_owner[new_state];
+		quota[ctx->owner].used++;
+	} else if (old_state != RCTX_STATE_FREE &&
+		   new_state == RCTX_STATE_FREE)
+		quota[ctx->owner].used--;
+
+	req_enter[new_state]++;
+	if (req_counts[new_state] > req_max[new_state])
+		req_max[new_state] = req_counts[new_state];
+
+	/* wake up whoever works on the new state */
+	switch (new_state) {
+	case RCTX_STATE_UDP_RCV_DONE:
+		sched_post(SCHED_USB_IN);
+		break;
+	case RCTX_STATE_UDP_EP2_PENDING:
+	case RCTX_STATE_UDP_EP3_PENDING:
+		sched_post(SCHED_USB_OUT);
+		break;
+	case RCTX_STATE_FREE:
+		sched_post(SCHED_UNTHROTTLE);
+		break;
+	}
+}
+
 struct req_ctx __ramfunc *req_ctx_find_get(int large,
 				 unsigned long old_state, 
 				 unsigned long new_state)
@@ -55,11 +150,15 @@ struct req_ctx __ramfunc *req_ctx_find_get(int large,
 	unsigned long flags;
 
 	if (old_state >= RCTX_STATE_COUNT || new_state >= RCTX_STATE_COUNT) {
-		DEBUGPCR("Invalid parameters for req_ctx_find_get");
+		DEBUGPL(DEBUG_LVL_ERR,
+			"Invalid parameters for req_ctx_find_get\r\n");
 		return NULL;
 	}
 	local_irq_save(flags);
 	toReturn = req_ctx_queues[old_state];
+	if (toReturn && old_state == RCTX_STATE_FREE &&
+	    !req_ctx_admit(state_owner[new_state]))
+		toReturn = NULL;
 	if (toReturn) {
 		if ((req_ctx_queues[old_state] = toReturn->next))
 			toReturn->next->prev = NULL;
@@ -74,11 +173,40 @@ struct req_ctx __ramfunc *req_ctx_find_get(int large,
 		toReturn->state = new_state;
 		toReturn->next = NULL;
 		req_counts[new_state]++;
+		req_ctx_account(toReturn, old_state, new_state);
 	}
 	local_irq_restore(flags);
 	return toReturn;
 }
 
+/* like req_ctx_find_get(), but takes the first context in old_state for
+ * which match() returns true.  match() is called with IRQs disabled */
+struct req_ctx *req_ctx_find_get_match(unsigned long old_state,
+				       unsigned long new_state,
+				       int (*match)(struct req_ctx *ctx,
+						    void *data),
+				       void *data)
+{
+	struct req_ctx *ctx;
+	unsigned long flags;
+
+	if (old_state >= RCTX_STATE_COUNT || new_state >= RCTX_STATE_COUNT) {
+		DEBUGPL(DEBUG_LVL_ERR,
+			"Invalid parameters for req_ctx_find_get_match\r\n");
+		return NULL;
+	}
+	local_irq_save(flags);
+	for (ctx = req_ctx_queues[old_state]; ctx;
+	     ctx = (struct req_ctx *) ctx->next) {
+		if (match(ctx, data))
+			break;
+	}
+	if (ctx)
+		req_ctx_set_state(ctx, new_state);
+	local_irq_restore(flags);
+	return ctx;
+}
+
 uint8_t req_ctx_num(struct req_ctx *ctx)
 {
 	return ctx - req_ctx;
@@ -90,7 +218,8 @@ void req_ctx_set_state(struct req_ctx *ctx, unsigned long new_state)
 	unsigned old_state;
 
 	if (new_state >= RCTX_STATE_COUNT) {
-		DEBUGPCR("Invalid new_state for req_ctx_set_state");
+		DEBUGPL(DEBUG_LVL_ERR,
+			"Invalid new_state for req_ctx_set_state\r\n");
 		return;
 	}
 	local_irq_save(flags);
@@ -112,6 +241,7 @@ void req_ctx_set_state(struct req_ctx *ctx, unsigned long new_state)
 	ctx->state = new_state;
 	ctx->next = NULL;
 	req_counts[new_state]++;
+	req_ctx_account(ctx, old_state, new_state);
 	local_irq_restore(flags);
 }
 
@@ -167,6 +297,7 @@ void req_ctx_put(struct req_ctx *ctx)
 	ctx->state = RCTX_STATE_FREE;
 	ctx->next = NULL;
 	req_counts[RCTX_STATE_FREE]++;
+	req_ctx_account(ctx, old_state, RCTX_STATE_FREE);
 	local_irq_restore(intcFlags);
 }
 
@@ -177,6 +308,43 @@ unsigned int req_ctx_count(unsigned long state)
 	return req_counts[state];
 }
 
+void req_ctx_set_quota(enum rctx_owner owner, uint8_t min, uint8_t max)
+{
+	unsigned long flags;
+
+	if (owner >= RCTX_OWNER_COUNT)
+		return;
+
+	local_irq_save(flags);
+	quota[owner].min = min;
+	quota[owner].max = max;
+	local_irq_restore(flags);
+}
+
+int req_ctx_stats(unsigned long state, struct openpcd_rctx_stats *st,
+		  int clear)
+{
+	unsigned long flags;
+
+	if (state >= RCTX_STATE_COUNT)
+		return -EINVAL;
+
+	local_irq_save(flags);
+	st->count = req_counts[state];
+	st->max = req_max[state];
+	st->res = 0;
+	st->enter = req_enter[state];
+	memcpy(st->hist, req_hist[state], sizeof(st->hist));
+	if (clear) {
+		req_max[state] = req_counts[state];
+		req_enter[state] = 0;
+		memset(req_hist[state], 0, sizeof(req_hist[state]));
+	}
+	local_irq_restore(flags);
+
+	return 0;
+}
+
 void req_ctx_init(void)
 {
 	int i;
@@ -187,8 +355,7 @@ void req_ctx_init(void)
 		req_ctx[i].tot_len = 0;
 		req_ctx[i].data = rctx_data[i];
 		req_ctx[i].state = RCTX_STATE_FREE;
-		DEBUGPCR("SMALL req_ctx[%02i] initialized at %08X, Data: %08X => %08X",
-			i, req_ctx + i, req_ctx[i].data, req_ctx[i].data + RCTX_SIZE_SMALL);
+		req_ctx[i].stamp = pit_ticks();
 	}
 
 	for (; i < NUM_REQ_CTX; i++) {
@@ -198,8 +365,7 @@ void req_ctx_init(void)
 		req_ctx[i].tot_len = 0;
 		req_ctx[i].data = rctx_data_large[i];
 		req_ctx[i].state = RCTX_STATE_FREE;
-		DEBUGPCR("LARGE req_ctx[%02i] initialized at %08X, Data: %08X => %08X",
-			i, req_ctx + i, req_ctx[i].data, req_ctx[i].data + RCTX_SIZE_LARGE);
+		req_ctx[i].stamp = pit_ticks();
 	}
 	req_ctx[0].prev = NULL;
 	req_ctx[NUM_REQ_CTX - 1].next = NULL;
@@ -207,9 +373,20 @@ void req_ctx_init(void)
 	req_ctx_queues[RCTX_STATE_FREE] = req_ctx;
 	req_ctx_tails[RCTX_STATE_FREE] = req_ctx + NUM_REQ_CTX - 1;
 	req_counts[RCTX_STATE_FREE] = NUM_REQ_CTX;
+	req_max[RCTX_STATE_FREE] = NUM_REQ_CTX;
 
 	for (i = RCTX_STATE_FREE + 1; i < RCTX_STATE_COUNT; i++) {
 		req_ctx_queues[i] = req_ctx_tails[i] = NULL;
 		req_counts[i] = 0;
+		req_max[i] = 0;
 	}
+	for (i = 0; i < RCTX_OWNER_COUNT; i++)
+		quota[i].used = 0;
+	memset(req_enter, 0, sizeof(req_enter));
+	memset(req_hist, 0, sizeof(req_hist));
+
+	/* one line for all, this runs before USB is up */
+	DEBUGPL(DEBUG_LVL_TRACE, "req_ctx: %u small at %08X, %u large at "
+		"%08X\r\n", NUM_RCTX_SMALL, rctx_data, NUM_RCTX_LARGE,
+		rctx_data_large);
 }
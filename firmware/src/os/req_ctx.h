@@ -18,6 +18,8 @@ struct req_ctx {
 	uint16_t size;
 	uint16_t tot_len;
 	uint8_t *data;
+	uint32_t stamp;			/* pit_ticks() of last state change */
+	uint8_t owner;			/* RCTX_OWNER_* charged for it */
 };
 
 #define RCTX_STATE_FREE                 0
@@ -41,11 +43,35 @@ struct req_ctx {
 // Count of the number of STATES
 #define RCTX_STATE_COUNT               17
 
+/* Contexts are charged to an owner when they leave RCTX_STATE_FREE,
+ * derived from the state they are allocated into.  Each owner has a
+ * reserved minimum and a cap, see req_ctx_set_quota() */
+enum rctx_owner {
+	RCTX_OWNER_OTHER,
+	RCTX_OWNER_USB_RX,	/* commands received from the host */
+	RCTX_OWNER_REPLY,	/* replies and data created by handlers */
+	RCTX_OWNER_SSC,		/* SSC sampling */
+	RCTX_OWNER_CAPTURE,	/* SIMtrace capture */
+	RCTX_OWNER_EDGES,	/* PIO edge reports, logic analyzer */
+	RCTX_OWNER_COUNT
+};
+
 extern struct req_ctx __ramfunc *req_ctx_find_get(int large, unsigned long old_state, unsigned long new_state);
+extern struct req_ctx *req_ctx_find_get_match(unsigned long old_state,
+				unsigned long new_state,
+				int (*match)(struct req_ctx *ctx, void *data),
+				void *data);
 extern struct req_ctx *req_ctx_find_busy(void);
 extern void req_ctx_set_state(struct req_ctx *ctx, unsigned long new_state);
 extern void req_ctx_put(struct req_ctx *ctx);
 extern uint8_t req_ctx_num(struct req_ctx *ctx);
 unsigned int req_ctx_count(unsigned long state);
 
+extern void req_ctx_set_quota(enum rctx_owner owner, uint8_t min,
+			      uint8_t max);
+
+struct openpcd_rctx_stats;
+extern int req_ctx_stats(unsigned long state, struct openpcd_rctx_stats *st,
+			 int clear);
+
 #endif /* _REQ_CTX_H */
@@ -0,0 +1,111 @@
+/* Run-to-completion scheduler for the main loop of OpenPCD / OpenPICC
+ *
+ * Each task is a function with a pending bit.  Interrupt handlers (and
+ * tasks) post the bit when there is work, timers post it at a deadline
+ * (sched_post_in()), and sched_run() calls the most urgent pending task,
+ * starting over after every one.  With nothing pending the CPU sleeps
+ * until the next interrupt.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/types.h>
+#include <lib_AT91SAM7.h>
+#include <asm/system.h>
+#include <os/sched.h>
+#include <os/pit.h>
+#include <os/power.h>
+#include <os/wdt.h>
+
+static sched_fn *tasks[SCHED_NR_TASKS];
+static volatile uint32_t pending;
+static struct timer_list deadlines[SCHED_NR_TASKS];
+
+void sched_register(enum sched_task task, sched_fn *fn)
+{
+	tasks[task] = fn;
+}
+
+/* can be called from IRQ and FIQ context */
+void sched_post(enum sched_task task)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	local_fiq_disable();
+	pending |= 1 << task;
+	local_irq_restore(flags);
+}
+
+static void sched_deadline(void *data)
+{
+	sched_post((unsigned long) data);
+}
+
+/* post 'task' after 'ticks' jiffies, replacing an earlier deadline */
+void sched_post_in(enum sched_task task, unsigned long ticks)
+{
+	struct timer_list *tl = &deadlines[task];
+
+	tl->function = &sched_deadline;
+	tl->data = (void *) (unsigned long) task;
+	tl->expires = jiffies + ticks;
+	timer_add(tl);
+}
+
+/* take the most urgent pending task, or sleep until an interrupt */
+static int sched_next(void)
+{
+	unsigned long flags;
+	int task = -1;
+
+	local_irq_save(flags);
+	local_fiq_disable();
+	if (pending) {
+		for (task = 0; !(pending & (1 << task)); task++) {}
+		pending &= ~(1 << task);
+	} else {
+#ifdef CONFIG_IDLE
+		pit_tickless_enter();
+#endif
+		/* any pending interrupt wakes the core, even though it is
+		 * masked here */
+		cpu_idle();
+#ifdef CONFIG_IDLE
+		pit_tickless_exit();
+#endif
+	}
+	local_irq_restore(flags);
+
+	return task;
+}
+
+void sched_run(void)
+{
+	int task;
+
+	/* everybody gets a first chance to look for work */
+	pending = (1 << SCHED_NR_TASKS) - 1;
+
+	while (1) {
+		task = sched_next();
+		if (task >= 0 && tasks[task])
+			tasks[task]();
+
+		/* restart watchdog timer */
+		wdt_restart();
+	}
+}
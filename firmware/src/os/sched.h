@@ -0,0 +1,24 @@
+#ifndef _SCHED_H
+#define _SCHED_H
+
+#include <sys/types.h>
+
+/* in order of priority */
+enum sched_task {
+	SCHED_BOOT,		/* boot_late_init() */
+	SCHED_USB_OUT,		/* req_ctx pending for an IN endpoint */
+	SCHED_USB_IN,		/* requests received on the OUT endpoint */
+	SCHED_UNTHROTTLE,	/* a req_ctx has been freed */
+	SCHED_PIO,		/* edges queued by __pio_irq_demux() */
+	SCHED_APP,		/* _main_func() of the application */
+	SCHED_NR_TASKS
+};
+
+typedef void sched_fn(void);
+
+extern void sched_register(enum sched_task task, sched_fn *fn);
+extern void sched_post(enum sched_task task);
+extern void sched_post_in(enum sched_task task, unsigned long ticks);
+extern void sched_run(void);
+
+#endif /* _SCHED_H */
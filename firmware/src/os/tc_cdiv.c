@@ -84,8 +84,8 @@ void tc_cdiv_init(void)
 
 	tc_cdiv_set_divider(128);
 
-	/* Reset to start timers */
-	tcb->TCB_BCR = 1;
+	/* Start TC0 only, TCB_BCR would restart the TC1 timebase too */
+	tcb->TCB_TC0.TC_CCR = AT91C_TC_SWTRG;
 }
 
 void tc_cdiv_print(void)
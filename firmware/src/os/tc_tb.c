@@ -0,0 +1,105 @@
+/* High resolution timebase on TC1
+ *
+ * TC1 counts MCK/32 and its 16 bits are extended to 32 in software by
+ * counting overflows, giving a timestamp with ~0.67us resolution for
+ * the capture paths and for delays.  TC1 isn't used by any of the
+ * boards otherwise.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by 
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <sys/types.h>
+#include <asm/system.h>
+#include <lib_AT91SAM7.h>
+#include <AT91SAM7.h>
+#include <os/tc_tb.h>
+
+#include "../openpcd.h"
+
+static AT91PS_TC tctb = AT91C_BASE_TC1;
+
+/* overflows of TC1, the upper 16 bits of the timebase */
+static volatile uint16_t tb_high;
+
+/* Reading TC_SR clears COVFS, so both the IRQ and tc_tb_now() account
+ * for an overflow as soon as they see it */
+static void tc_tb_irq(void)
+{
+	if (tctb->TC_SR & AT91C_TC_COVFS)
+		tb_high++;
+	AT91F_AIC_ClearIt(AT91C_BASE_AIC, AT91C_ID_TC1);
+}
+
+uint32_t tc_tb_now(void)
+{
+	unsigned long flags;
+	uint32_t cv;
+
+	/* __pio_irq_demux() stamps edges from the FIQ */
+	local_irq_save(flags);
+	local_fiq_disable();
+	if (tctb->TC_SR & AT91C_TC_COVFS)
+		tb_high++;
+	cv = tctb->TC_CV;
+	/* the counter might have wrapped just before or after reading it */
+	if (tctb->TC_SR & AT91C_TC_COVFS) {
+		tb_high++;
+		cv = tctb->TC_CV;
+	}
+	cv |= (uint32_t) tb_high << 16;
+	local_irq_restore(flags);
+
+	return cv;
+}
+
+void tc_tb_udelay(uint32_t us)
+{
+	uint32_t start = tc_tb_now(), ticks = tc_tb_us(us);
+
+	while (tc_tb_now() - start < ticks) { }
+}
+
+void mdelay(uint32_t ms)
+{
+	while (ms--)
+		tc_tb_udelay(1000);
+}
+
+void usleep(uint32_t us)
+{
+	tc_tb_udelay(us);
+}
+
+void tc_tb_init(void)
+{
+	AT91F_PMC_EnablePeriphClock(AT91C_BASE_PMC,
+				    ((unsigned int) 1 << AT91C_ID_TC1));
+
+	/* MCK/32, capture mode without any triggers: free running */
+	tctb->TC_CCR = AT91C_TC_CLKDIS;
+	tctb->TC_CMR = AT91C_TC_CLKS_TIMER_DIV3_CLOCK;
+	tctb->TC_IDR = 0xff;
+	tctb->TC_IER = AT91C_TC_COVFS;
+
+	AT91F_AIC_ConfigureIt(AT91C_BASE_AIC, AT91C_ID_TC1,
+			      OPENPCD_IRQ_PRIO_TC_TB,
+			      AT91C_AIC_SRCTYPE_INT_HIGH_LEVEL, &tc_tb_irq);
+	AT91F_AIC_EnableIt(AT91C_BASE_AIC, AT91C_ID_TC1);
+
+	tctb->TC_CCR = AT91C_TC_CLKEN | AT91C_TC_SWTRG;
+}
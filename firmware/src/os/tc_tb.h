@@ -0,0 +1,40 @@
+#ifndef _TC_TB_H
+#define _TC_TB_H
+
+#include <sys/types.h>
+#include <board.h>
+
+/* free running 32 bit timebase on TC1, MCK/32 = 1.4976MHz, wraps after
+ * ~48 minutes */
+#define TC_TB_HZ	(MCK / 32)
+
+extern void tc_tb_init(void);
+extern uint32_t tc_tb_now(void);
+extern void tc_tb_udelay(uint32_t us);
+
+/* TC_TB_HZ / 1000000 = 936 / 625, split to stay within 32 bits */
+static inline uint32_t tc_tb_us(uint32_t us)
+{
+	return (us / 625) * 936 + (us % 625) * 936 / 625;
+}
+
+static inline uint32_t tc_tb_to_us(uint32_t ticks)
+{
+	return (ticks / 936) * 625 + (ticks % 936) * 625 / 936;
+}
+
+/* Deadlines for polling from the main loop instead of busy waiting:
+ *	dl = tc_tb_deadline(500);
+ *	...
+ *	if (tc_tb_expired(dl)) ... */
+static inline uint32_t tc_tb_deadline(uint32_t us)
+{
+	return tc_tb_now() + tc_tb_us(us);
+}
+
+static inline int tc_tb_expired(uint32_t deadline)
+{
+	return (int32_t) (tc_tb_now() - deadline) >= 0;
+}
+
+#endif /* _TC_TB_H */
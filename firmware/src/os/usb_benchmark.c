@@ -20,16 +20,175 @@
 #include <errno.h>
 #include <string.h>
 #include <lib_AT91SAM7.h>
+#include <asm/io.h>
+#include <asm/system.h>
 #include <os/led.h>
 #include <os/dbgu.h>
 #include <os/pcd_enumerate.h>
 #include <os/usb_handler.h>
 #include <os/req_ctx.h>
+#include <os/pio_irq.h>
+#include <os/tc_tb.h>
 #include "../openpcd.h"
 
 static struct req_ctx dummy_rctx;
 static struct req_ctx empty_rctx;
 
+#define MEMTEST_CHECK_LEN	72
+#define MEMTEST_REPS		16
+
+static void memtest_byte_copy(uint8_t *d, const uint8_t *s, unsigned int len)
+{
+	while (len--) {
+		*d++ = *s++;
+		/* keep gcc from turning the loop into a memcpy() call */
+		asm volatile("" : : : "memory");
+	}
+}
+
+static unsigned int memtest_cmp(const uint8_t *a, const uint8_t *b,
+				unsigned int len)
+{
+	unsigned int i, errors = 0;
+
+	for (i = 0; i < len; i++) {
+		if (a[i] != b[i])
+			errors++;
+	}
+	return errors;
+}
+
+/* compare memcpy, memmove and memset against byte loops for all
+ * alignments of short lengths, 'src' and 'dst' need 4*MEMTEST_CHECK_LEN
+ * bytes.  Returns the number of mismatches. */
+static unsigned int memtest_check(uint8_t *src, uint8_t *dst)
+{
+	uint8_t *ref = src + 2 * MEMTEST_CHECK_LEN;
+	unsigned int errors = 0;
+	int len, sa, da, i;
+
+	for (i = 0; i < 2 * MEMTEST_CHECK_LEN; i++)
+		src[i] = i * 7 + 1;
+
+	for (len = 0; len < MEMTEST_CHECK_LEN; len++) {
+		for (sa = 0; sa < 4; sa++) {
+			for (da = 0; da < 4; da++) {
+				uint8_t *d = dst + 4 + da;
+
+				for (i = 0; i < len + 8; i++)
+					ref[i] = dst[i] = 0xee;
+				memtest_byte_copy(ref + 4 + da, src + sa, len);
+				if (memcpy(d, src + sa, len) != d)
+					errors++;
+				errors += memtest_cmp(dst, ref, len + 8);
+			}
+
+			/* overlapping moves in both directions */
+			for (da = -5; da <= 5; da++) {
+				uint8_t *s = dst + 8 + sa, *d = s + da;
+
+				memtest_byte_copy(dst, src, len + 16);
+				memtest_byte_copy(ref, src, len + 16);
+				if (da > 0) {
+					for (i = len - 1; i >= 0; i--)
+						ref[8 + sa + da + i] =
+							ref[8 + sa + i];
+				} else
+					memtest_byte_copy(ref + 8 + sa + da,
+							  ref + 8 + sa, len);
+				if (memmove(d, s, len) != d)
+					errors++;
+				errors += memtest_cmp(dst, ref, len + 16);
+			}
+
+			memtest_byte_copy(dst, src, len + 8);
+			memtest_byte_copy(ref, src, len + 8);
+			for (i = 0; i < len; i++)
+				ref[4 + sa + i] = len;
+			if (memset(dst + 4 + sa, 0x100 | len, len) != dst + 4 + sa)
+				errors++;
+			errors += memtest_cmp(dst, ref, len + 8);
+		}
+	}
+
+	return errors;
+}
+
+/* MCK cycles per call of 'fn' on 'len' bytes */
+static uint32_t memtest_time(int fn, uint8_t *src, uint8_t *dst,
+			     unsigned int len)
+{
+	static volatile uint32_t fifo;
+	unsigned long flags;
+	uint32_t start;
+	int i;
+
+	local_irq_save(flags);
+	start = tc_tb_now();
+	for (i = 0; i < MEMTEST_REPS; i++) {
+		switch (fn) {
+		case OPENPCD_MEMTEST_MEMCPY:
+			memcpy(dst, src, len);
+			break;
+		case OPENPCD_MEMTEST_MEMCPY_UNALIGNED:
+			memcpy(dst, src + 1, len);
+			break;
+		case OPENPCD_MEMTEST_MEMMOVE:
+			memmove(src + 4, src, len);
+			break;
+		case OPENPCD_MEMTEST_MEMSET:
+			memset(dst, i, len);
+			break;
+		case OPENPCD_MEMTEST_BYTE_LOOP:
+			memtest_byte_copy(dst, src, len);
+			break;
+		case OPENPCD_MEMTEST_WRITESB:
+			__raw_writesb(&fifo, src, len);
+			break;
+		case OPENPCD_MEMTEST_READSB:
+			__raw_readsb(&fifo, dst, len);
+			break;
+		}
+	}
+	start = tc_tb_now() - start;
+	local_irq_restore(flags);
+
+	return start * (MCK / TC_TB_HZ) / MEMTEST_REPS;
+}
+
+/* the request req_ctx is large, everything behind the response is used as
+ * source buffer, a second req_ctx as destination */
+static int usbtest_mem(struct req_ctx *rctx)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+	struct openpcd_memtest mt;
+	struct req_ctx *scratch;
+	uint8_t *src = rctx->data + 64;
+	int fn;
+
+	if (rctx->size < 64 + OPENPCD_MEMTEST_MAX_LEN + 4)
+		return USB_ERR(USB_ERR_NO_RCTX);
+	scratch = req_ctx_find_get(1, RCTX_STATE_FREE,
+				   RCTX_STATE_MAIN_PROCESSING);
+	if (!scratch)
+		return USB_ERR(USB_ERR_NO_RCTX);
+
+	if (rctx->tot_len >= sizeof(*poh) + sizeof(uint16_t))
+		mt.len = poh->data[0] | poh->data[1] << 8;
+	else
+		mt.len = poh->val;
+	if (!mt.len || mt.len > OPENPCD_MEMTEST_MAX_LEN)
+		mt.len = OPENPCD_MEMTEST_MAX_LEN;
+	mt.errors = memtest_check(src, scratch->data);
+	for (fn = 0; fn < OPENPCD_MEMTEST_NUM; fn++)
+		mt.cycles[fn] = memtest_time(fn, src, scratch->data, mt.len);
+	req_ctx_put(scratch);
+
+	memcpy(poh->data, &mt, sizeof(mt));
+	rctx->tot_len = sizeof(*poh) + sizeof(mt);
+	return USB_RET_RESPOND;
+}
+
 static int usbtest_rx(struct req_ctx *rctx)
 {
 	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
@@ -54,9 +213,36 @@ static int usbtest_rx(struct req_ctx *rctx)
 		led_toggle(2);
 		break;
 	case OPENPCD_CMD_USBTEST_OUT:
-		DEBUGP("USBTEST_IN ");
-		/* test bulk out pipe */
-		return USB_ERR(USB_ERR_CMD_NOT_IMPL);
+		DEBUGP("USBTEST_OUT ");
+		/* test bulk out pipe: the payload is discarded, only the
+		 * last transfer of a run asks for a (header-only) response */
+		if (poh->flags & OPENPCD_FLAG_RESPOND) {
+			rctx->tot_len = sizeof(*poh);
+			return USB_RET_RESPOND;
+		}
+		break;
+	case OPENPCD_CMD_USBTEST_INT:
+		DEBUGP("USBTEST_INT ");
+		/* test interrupt in pipe: echo the header on EP3 */
+		rctx->tot_len = sizeof(*poh);
+		req_ctx_set_state(rctx, RCTX_STATE_UDP_EP3_PENDING);
+		return 0;
+	case OPENPCD_CMD_USBTEST_MEM:
+		DEBUGP("USBTEST_MEM ");
+		return usbtest_mem(rctx);
+	case OPENPCD_CMD_PIO_IRQ:
+		DEBUGP("PIO_IRQ ");
+		if (rctx->tot_len >= sizeof(*poh) + sizeof(uint32_t)) {
+			uint32_t mask;
+
+			memcpy(&mask, poh->data, sizeof(mask));
+			pio_irq_set_usbmask(mask);
+		} else
+			pio_irq_set_usbmask(poh->val);
+		if (poh->flags & OPENPCD_FLAG_RESPOND) {
+			rctx->tot_len = sizeof(*poh);
+			return USB_RET_RESPOND;
+		}
 		break;
 	}
 
@@ -72,4 +258,7 @@ void usbtest_init(void)
 	empty_rctx.tot_len = 0;
 
 	usb_hdlr_register(&usbtest_rx, OPENPCD_CMD_CLS_USBTEST);
+	usb_hdlr_set_prio(OPENPCD_CMD_CLS_USBTEST, USB_PRIO_BULK);
+	/* only sets the edge mask, no bulk data */
+	usb_cmd_set_prio(OPENPCD_CMD_PIO_IRQ, USB_PRIO_HIGH);
 }
@@ -0,0 +1,147 @@
+/* Event queue for the USB interrupt endpoint
+ *
+ * Asynchronous notifications (RC632 and PIO interrupts, card detection)
+ * are kept as small records instead of a req_ctx each.  Repeated events
+ * of the same type are merged while they wait for the host, and as many
+ * records as fit are packed into one OPENPCD_CMD_EVENTS packet on EP3.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by 
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <asm/system.h>
+#include <openpcd.h>
+
+#include <os/usb_event.h>
+#include <os/dbgu.h>
+#include <os/sched.h>
+
+#define USB_EVENT_NUM	16	/* power of two */
+
+struct usb_event {
+	uint8_t len;		/* of hdr + payload */
+	uint8_t count;		/* occurrences merged into this one */
+	uint8_t coalesce;
+	union {
+		struct openpcd_hdr hdr;
+		uint8_t raw[sizeof(struct openpcd_hdr) + USB_EVENT_DATA_MAX];
+	} u;
+};
+
+static struct usb_event events[USB_EVENT_NUM];
+static unsigned int ev_head, ev_tail;	/* free running */
+static unsigned int ev_lost;
+
+/* queue an event, can be called from IRQ context */
+int usb_event_post(uint8_t cmd, uint8_t reg, uint8_t val,
+		   const void *data, uint8_t len, int flags)
+{
+	struct usb_event *ev;
+	unsigned long irqflags;
+	unsigned int i, j;
+
+	if (len > USB_EVENT_DATA_MAX)
+		return -EINVAL;
+
+	local_irq_save(irqflags);
+
+	if (flags & USB_EVENT_F_COALESCE) {
+		for (i = ev_tail; i != ev_head; i++) {
+			ev = &events[i % USB_EVENT_NUM];
+			if (!ev->coalesce || ev->u.hdr.cmd != cmd ||
+			    ev->u.hdr.reg != reg ||
+			    ev->len != sizeof(ev->u.hdr) + len)
+				continue;
+			/* values are interrupt cause masks, accumulate */
+			ev->u.hdr.val |= val;
+			for (j = 0; j < len; j++)
+				ev->u.hdr.data[j] |= ((const uint8_t *)data)[j];
+			if (ev->count < 0xff)
+				ev->count++;
+			local_irq_restore(irqflags);
+			return 0;
+		}
+	}
+
+	if (ev_head - ev_tail >= USB_EVENT_NUM) {
+		ev_lost++;
+		local_irq_restore(irqflags);
+		return -ENOBUFS;
+	}
+
+	ev = &events[ev_head % USB_EVENT_NUM];
+	ev->len = sizeof(ev->u.hdr) + len;
+	ev->count = 1;
+	ev->coalesce = flags & USB_EVENT_F_COALESCE;
+	ev->u.hdr.cmd = cmd;
+	ev->u.hdr.flags = 0;
+	ev->u.hdr.reg = reg;
+	ev->u.hdr.val = val;
+	if (len)
+		memcpy(ev->u.hdr.data, data, len);
+	ev_head++;
+
+	local_irq_restore(irqflags);
+	sched_post(SCHED_USB_OUT);
+	return 0;
+}
+
+/* pack pending events into one OPENPCD_CMD_EVENTS packet of at most len
+ * bytes, returns its length or 0 if there is nothing to send */
+int usb_event_fill(uint8_t *buf, int len)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	unsigned long flags;
+	int cur = sizeof(*poh);
+
+	local_irq_save(flags);
+
+	if (ev_head == ev_tail && !ev_lost) {
+		local_irq_restore(flags);
+		return 0;
+	}
+
+	poh->cmd = OPENPCD_CMD_EVENTS;
+	poh->flags = 0;
+	poh->reg = ev_lost > 0xff ? 0xff : ev_lost;
+	poh->val = 0;
+	ev_lost = 0;
+
+	while (ev_tail != ev_head) {
+		struct usb_event *ev = &events[ev_tail % USB_EVENT_NUM];
+
+		if (cur + 2 + ev->len > len)
+			break;
+		buf[cur++] = ev->len;
+		buf[cur++] = ev->count;
+		memcpy(buf + cur, ev->u.raw, ev->len);
+		cur += ev->len;
+		poh->val++;
+		ev_tail++;
+	}
+
+	local_irq_restore(flags);
+	return cur;
+}
+
+unsigned int usb_event_pending(void)
+{
+	return ev_head - ev_tail;
+}
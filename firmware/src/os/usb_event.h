@@ -0,0 +1,17 @@
+#ifndef _USB_EVENT_H
+#define _USB_EVENT_H
+
+#include <sys/types.h>
+
+/* largest payload of one event (after the openpcd_hdr) */
+#define USB_EVENT_DATA_MAX	24
+
+/* merge with a pending event of the same cmd/reg */
+#define USB_EVENT_F_COALESCE	0x01
+
+extern int usb_event_post(uint8_t cmd, uint8_t reg, uint8_t val,
+			  const void *data, uint8_t len, int flags);
+extern int usb_event_fill(uint8_t *buf, int len);
+extern unsigned int usb_event_pending(void);
+
+#endif /* _USB_EVENT_H */
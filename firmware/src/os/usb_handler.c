@@ -17,6 +17,8 @@
  *
  */
 
+#define DEBUG_MODULE	DEBUG_MOD_USB
+
 #include <sys/types.h>
 #include <errno.h>
 #include <string.h>
@@ -28,10 +30,29 @@
 #include <os/req_ctx.h>
 #include <os/led.h>
 #include <os/dbgu.h>
+#include <os/sched.h>
+#include <os/boot.h>
 
 #include "../openpcd.h"
 
 static usb_cmd_fn *cmd_hdlrs[16];
+/* per class, two bits of enum usb_prio for each command */
+static uint32_t cmd_prio[16] = { [0 ... 15] = 0x55555555UL * USB_PRIO_NORMAL };
+
+/* requests whose handler returned USB_RET_DEFER */
+#define USB_MAX_DEFERRED	4
+static struct {
+	struct req_ctx *rctx;
+	usb_cmd_fn *cont;
+} deferred[USB_MAX_DEFERRED];
+
+/* set while usb_in_batch() dispatches, batched commands can't defer */
+static uint8_t batching;
+
+/* per class, a bit for each command that can't run inside a batch */
+static uint16_t cmd_no_batch[16] = {
+	[OPENPCD_CMD_CLS_GENERIC] = 1 << (OPENPCD_CMD_BATCH & 0xf),
+};
 
 int usb_hdlr_register(usb_cmd_fn *hdlr, uint8_t class)
 {
@@ -44,17 +65,112 @@ void usb_hdlr_unregister(uint8_t class)
 	cmd_hdlrs[class] = NULL;
 }
 
-static int usb_in(struct req_ctx *rctx)
+/* set the priority of all commands of a class, before any exceptions
+ * for single commands with usb_cmd_set_prio() */
+void usb_hdlr_set_prio(uint8_t class, enum usb_prio prio)
+{
+	cmd_prio[class] = 0x55555555UL * prio;
+}
+
+void usb_cmd_set_prio(uint8_t cmd, enum usb_prio prio)
+{
+	unsigned int shift = (cmd & 0xf) * 2;
+
+	cmd_prio[OPENPCD_CMD_CLS(cmd)] &= ~(3UL << shift);
+	cmd_prio[OPENPCD_CMD_CLS(cmd)] |= (uint32_t) prio << shift;
+}
+
+static uint8_t usb_cmd_prio(uint8_t cmd)
+{
+	return (cmd_prio[OPENPCD_CMD_CLS(cmd)] >> ((cmd & 0xf) * 2)) & 3;
+}
+
+/* a batch waits like the least urgent of its commands */
+static uint8_t usb_batch_prio(struct req_ctx *rctx)
+{
+	uint16_t ofs = sizeof(struct openpcd_hdr);
+	uint8_t prio = USB_PRIO_HIGH;
+
+	while (ofs + 2 < rctx->tot_len && prio < USB_PRIO_BULK) {
+		uint16_t len = rctx->data[ofs] | rctx->data[ofs + 1] << 8;
+
+		ofs += 2;
+		if (len == 0 || ofs + len > rctx->tot_len)
+			break;
+		if (usb_cmd_prio(rctx->data[ofs]) > prio)
+			prio = usb_cmd_prio(rctx->data[ofs]);
+		ofs += len;
+	}
+
+	return prio;
+}
+
+/* Commands whose handler keeps the request past its return (DMA into
+ * it, usb_defer()) must not be batched: the batch frees it right away. */
+void usb_cmd_no_batch(uint8_t cmd)
+{
+	cmd_no_batch[OPENPCD_CMD_CLS(cmd)] |= 1 << (cmd & 0xf);
+}
+
+static int usb_cmd_batchable(uint8_t cmd)
+{
+	return !(cmd_no_batch[OPENPCD_CMD_CLS(cmd)] & (1 << (cmd & 0xf)));
+}
+
+static uint8_t usb_rctx_prio(struct req_ctx *rctx)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+
+	if (rctx->tot_len < sizeof(*poh))
+		return USB_PRIO_HIGH;
+	if (poh->cmd == OPENPCD_CMD_BATCH)
+		return usb_batch_prio(rctx);
+
+	return usb_cmd_prio(poh->cmd);
+}
+
+/* Let a long running handler complete asynchronously: it returns
+ * usb_defer(rctx, cont) and cont(rctx) is called from usb_in_process()
+ * once no more urgent requests are pending, on the next run of the
+ * SCHED_USB_IN task.  cont returns like a handler
+ * and may defer itself again.  Unless it responds, the request is
+ * released once it has completed. */
+int usb_defer(struct req_ctx *rctx, usb_cmd_fn *cont)
+{
+	int i;
+
+	if (batching)
+		return USB_ERR(USB_ERR_NO_BATCH);
+
+	for (i = 0; i < USB_MAX_DEFERRED; i++) {
+		if (!deferred[i].rctx) {
+			deferred[i].rctx = rctx;
+			deferred[i].cont = cont;
+			sched_post(SCHED_USB_IN);
+			return USB_RET_DEFER;
+		}
+	}
+
+	return USB_ERR(USB_ERR_BUSY);
+}
+
+static void usb_set_err(struct req_ctx *rctx, int ret)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+
+	if (ret & USB_RET_ERR) {
+		poh->val = ret & 0xff;
+		poh->flags = OPENPCD_FLAG_ERROR;
+	}
+}
+
+/* hand a request to the handler of its class */
+static int usb_dispatch(struct req_ctx *rctx)
 {
 	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
 	usb_cmd_fn *hdlr;
 	int ret;
 
-/*	DEBUGP("usb_in(cls=%d) ", OPENPCD_CMD_CLS(poh->cmd));*/
-
-	if (rctx->tot_len < sizeof(*poh))
-		return -EINVAL;
-	
 	hdlr = cmd_hdlrs[OPENPCD_CMD_CLS(poh->cmd)];
 	if (!hdlr) {
 		DEBUGPCR("no handler for this class ");
@@ -62,10 +178,184 @@ static int usb_in(struct req_ctx *rctx)
 	} else
 		ret = (hdlr)(rctx);
 	
-	if (ret & USB_RET_ERR) {
-		poh->val = ret & 0xff;
+	usb_set_err(rctx, ret);
+
+	return ret;
+}
+
+static struct req_ctx *batch_reply_alloc(void)
+{
+	struct req_ctx *reply;
+	struct openpcd_hdr *poh;
+
+	reply = req_ctx_find_get(0, RCTX_STATE_FREE,
+				 RCTX_STATE_MAIN_PROCESSING);
+	if (!reply)
+		return NULL;
+
+	poh = (struct openpcd_hdr *) reply->data;
+	poh->cmd = OPENPCD_CMD_BATCH;
+	poh->flags = OPENPCD_FLAG_RESPOND;
+	poh->reg = 0;
+	poh->val = 0;
+	reply->tot_len = sizeof(*poh);
+
+	return reply;
+}
+
+/* We don't send ZLPs, so an IN transfer must never end on a packet
+ * boundary or the host keeps waiting for the rest of it.  Every producer
+ * of IN data calls this on the finished rctx, leaving one byte of room.
+ * Returns the number of zero bytes appended. */
+int usb_in_pad(struct req_ctx *rctx)
+{
+	if (rctx->tot_len % AT91C_EP_IN_SIZE)
+		return 0;
+
+	rctx->data[rctx->tot_len++] = 0;
+	return 1;
+}
+
+static void batch_reply_send(struct req_ctx *reply, uint8_t flags,
+			     uint8_t num, uint8_t more)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) reply->data;
+
+	poh->flags |= flags;
+	poh->reg = more;
+	poh->val = num;
+
+	usb_in_pad(reply);
+	req_ctx_set_state(reply, RCTX_STATE_UDP_EP2_PENDING);
+	udp_refill_ep(2);
+}
+
+/* append a response record, sending the reply first if it is full.
+ * 'num' is the number of commands executed before this one. */
+static int batch_reply_add(struct req_ctx **reply, uint8_t num,
+			   const uint8_t *data, uint16_t len)
+{
+	struct req_ctx *r = *reply;
+
+	/* keep two bytes for the length and one for padding */
+	if (r->tot_len + len + 3 > r->size) {
+		struct req_ctx *next = batch_reply_alloc();
+		if (!next)
+			return -ENOMEM;
+		batch_reply_send(r, 0, num, OPENPCD_BATCH_MORE);
+		*reply = r = next;
+	}
+	r->data[r->tot_len++] = len & 0xff;
+	r->data[r->tot_len++] = len >> 8;
+	memcpy(r->data + r->tot_len, data, len);
+	r->tot_len += len;
+
+	return 0;
+}
+
+/* Unpack a OPENPCD_CMD_BATCH container into consecutive dispatches of
+ * the individual commands, collecting all responses in batched replies.
+ * Commands that keep the request (see usb_cmd_no_batch()) are answered
+ * with USB_ERR_NO_BATCH without being dispatched. */
+static int usb_in_batch(struct req_ctx *rctx)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+	struct openpcd_hdr *rec;
+	struct req_ctx *reply, *sub;
+	uint16_t ofs = sizeof(*poh);
+	uint8_t num = 0, flags = 0;
+
+	reply = batch_reply_alloc();
+	if (!reply) {
 		poh->flags = OPENPCD_FLAG_ERROR;
+		poh->val = USB_ERR_NO_RCTX;
+		rctx->tot_len = sizeof(*poh);
+		req_ctx_set_state(rctx, RCTX_STATE_UDP_EP2_PENDING);
+		udp_refill_ep(2);
+		return 1;
+	}
+
+	while (ofs + 2 <= rctx->tot_len) {
+		uint16_t len = rctx->data[ofs] | rctx->data[ofs + 1] << 8;
+		int ret;
+
+		ofs += 2;
+		if (len == 0)
+			break;
+		if (len < sizeof(*poh) || ofs + len > rctx->tot_len) {
+			DEBUGPCR("short batch record ");
+			flags = OPENPCD_FLAG_ERROR;
+			break;
+		}
+
+		rec = (struct openpcd_hdr *) (rctx->data + ofs);
+		if (!usb_cmd_batchable(rec->cmd)) {
+			rec->flags = OPENPCD_FLAG_ERROR;
+			rec->val = USB_ERR_NO_BATCH;
+			batch_reply_add(&reply, num, (uint8_t *) rec,
+					sizeof(*rec));
+			flags = OPENPCD_FLAG_ERROR;
+			break;
+		}
+
+		sub = req_ctx_find_get(0, RCTX_STATE_FREE,
+				       RCTX_STATE_MAIN_PROCESSING);
+		if (!sub || len > sub->size) {
+			if (sub)
+				req_ctx_put(sub);
+			flags = OPENPCD_FLAG_ERROR;
+			break;
+		}
+		memcpy(sub->data, rctx->data + ofs, len);
+		sub->tot_len = len;
+		ofs += len;
+
+		batching = 1;
+		ret = usb_dispatch(sub);
+		batching = 0;
+		num++;
+
+		if (ret & USB_RET_RESPOND) {
+			if (ret & USB_RET_ERR)
+				sub->tot_len = sizeof(*poh);
+			if (batch_reply_add(&reply, num - 1, sub->data,
+					    sub->tot_len) < 0)
+				ret |= USB_RET_ERR;
+		}
+
+		/* handlers that didn't pass the request on leave it to us */
+		if (sub->state == RCTX_STATE_MAIN_PROCESSING)
+			req_ctx_put(sub);
+
+		if (ret & USB_RET_ERR) {
+			flags = OPENPCD_FLAG_ERROR;
+			break;
+		}
 	}
+
+	batch_reply_send(reply, flags, num, 0);
+	req_ctx_put(rctx);
+
+	return flags ? 1 : 0;
+}
+
+static int usb_in(struct req_ctx *rctx)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+	int ret;
+
+/*	DEBUGP("usb_in(cls=%d) ", OPENPCD_CMD_CLS(poh->cmd));*/
+
+	if (rctx->tot_len < sizeof(*poh))
+		return -EINVAL;
+
+	boot_mark(OPENPCD_BOOT_FIRST_REQ);
+
+	if (poh->cmd == OPENPCD_CMD_BATCH)
+		return usb_in_batch(rctx);
+
+	ret = usb_dispatch(rctx);
+
 	if (ret & USB_RET_RESPOND) { 
 		req_ctx_set_state(rctx, RCTX_STATE_UDP_EP2_PENDING);
 		udp_refill_ep(2);
@@ -75,6 +365,31 @@ static int usb_in(struct req_ctx *rctx)
 	return (ret & USB_RET_ERR) ? 1 : 0;
 }
 
+/* run the continuation of deferred request 'i' */
+static void usb_in_resume(int i)
+{
+	struct req_ctx *rctx = deferred[i].rctx;
+	usb_cmd_fn *cont = deferred[i].cont;
+	int ret;
+
+	deferred[i].rctx = NULL;
+	ret = cont(rctx);
+	if (ret & USB_RET_DEFER)
+		return;
+
+	usb_set_err(rctx, ret);
+	if (ret & USB_RET_RESPOND) {
+		req_ctx_set_state(rctx, RCTX_STATE_UDP_EP2_PENDING);
+		udp_refill_ep(2);
+	} else if (rctx->state == RCTX_STATE_MAIN_PROCESSING)
+		req_ctx_put(rctx);
+}
+
+static int usb_prio_match(struct req_ctx *rctx, void *data)
+{
+	return usb_rctx_prio(rctx) == (unsigned long) data;
+}
+
 /* Process all pending request contexts that want to Tx on either
  * IN or INTERRUPT endpoint */
 void usb_out_process(void)
@@ -85,16 +400,48 @@ void usb_out_process(void)
 }
 
 /* process incoming USB packets (OUT pipe) that have already been 
- * put into request contexts by the UDP IRQ handler */
+ * put into request contexts by the UDP IRQ handler.  Requests are
+ * dispatched by class priority, in order of arrival within one priority;
+ * after every request we start over, as something more urgent may have
+ * arrived in the meantime.  Deferred requests are continued after the
+ * new requests of the same priority, each one at most once per call. */
 void usb_in_process(void)
 {
 	struct req_ctx *rctx;
+	unsigned long prio = USB_PRIO_HIGH;
+	uint8_t resume = 0;
+	int i;
+
+	for (i = 0; i < USB_MAX_DEFERRED; i++) {
+		if (deferred[i].rctx)
+			resume |= (1 << i);
+	}
+
+	while (prio < USB_PRIO_COUNT) {
+		rctx = req_ctx_find_get_match(RCTX_STATE_UDP_RCV_DONE,
+					      RCTX_STATE_MAIN_PROCESSING,
+					      usb_prio_match, (void *) prio);
+		if (rctx) {
+/*			DEBUGPCRF("found used ctx %u: len=%u", 
+				  req_ctx_num(rctx), rctx->tot_len);*/
+			usb_in(rctx);
+			prio = USB_PRIO_HIGH;
+			continue;
+		}
+
+		for (i = 0; i < USB_MAX_DEFERRED; i++) {
+			if ((resume & (1 << i)) &&
+			    usb_rctx_prio(deferred[i].rctx) == prio)
+				break;
+		}
+		if (i < USB_MAX_DEFERRED) {
+			resume &= ~(1 << i);
+			usb_in_resume(i);
+			prio = USB_PRIO_HIGH;
+			continue;
+		}
 
-	while (rctx = req_ctx_find_get(0, RCTX_STATE_UDP_RCV_DONE,
-				       RCTX_STATE_MAIN_PROCESSING)) {
-/*		DEBUGPCRF("found used ctx %u: len=%u", 
-			  req_ctx_num(rctx), rctx->tot_len);*/
-		usb_in(rctx);
+		prio++;
 	}
 	udp_unthrottle();
 }
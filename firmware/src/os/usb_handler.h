@@ -8,18 +8,35 @@
 
 #define USB_RET_RESPOND		(1 << 8)
 #define USB_RET_ERR		(2 << 8)
+#define USB_RET_DEFER		(4 << 8)
 #define USB_ERR(x)	(USB_RET_RESPOND|USB_RET_ERR|(x & 0xff))
 
 enum usbapi_err {
 	USB_ERR_NONE,
 	USB_ERR_CMD_UNKNOWN,
 	USB_ERR_CMD_NOT_IMPL,
+	USB_ERR_NO_RCTX,
+	USB_ERR_BUSY,
+	USB_ERR_NO_BATCH,	/* can't complete inside a batch */
+};
+
+/* order in which received requests are dispatched */
+enum usb_prio {
+	USB_PRIO_HIGH,		/* short control commands */
+	USB_PRIO_NORMAL,
+	USB_PRIO_BULK,		/* bulk data transfers */
+	USB_PRIO_COUNT
 };
 
 typedef int usb_cmd_fn(struct req_ctx *rctx);
 
 extern int usb_hdlr_register(usb_cmd_fn *hdlr, uint8_t class);
 extern void usb_hdlr_unregister(uint8_t class);
+extern void usb_hdlr_set_prio(uint8_t class, enum usb_prio prio);
+extern void usb_cmd_set_prio(uint8_t cmd, enum usb_prio prio);
+extern void usb_cmd_no_batch(uint8_t cmd);
+extern int usb_defer(struct req_ctx *rctx, usb_cmd_fn *cont);
+extern int usb_in_pad(struct req_ctx *rctx);
 
 extern void usb_in_process(void);
 extern void usb_out_process(void);
@@ -0,0 +1,151 @@
+/* Debug log channel over USB
+ *
+ * debugp() keeps a copy of every message in a ring buffer, which the host
+ * drains with OPENPCD_CMD_DEBUG_LOG_READ (see host/opcd_log.c).  Unlike
+ * the DBGU serial port this works on units without the serial header and
+ * at USB speed.  If the ring is full the new message is dropped as a
+ * whole, so binary log records are never cut in half.  The same command
+ * class also controls the per-module log masks of dbgu.h.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by 
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <string.h>
+#include <sys/types.h>
+#include <asm/system.h>
+#include <openpcd.h>
+
+#include <os/usb_log.h>
+#include <os/usb_handler.h>
+#include <os/req_ctx.h>
+#include <os/dbgu.h>
+
+#ifdef DEBUG
+
+#define USB_LOG_SIZE	1024	/* power of two */
+
+static struct {
+	char buf[USB_LOG_SIZE];
+	unsigned int head, tail;	/* free running */
+	unsigned int lost;		/* messages dropped */
+	uint8_t flags;			/* OPENPCD_DEBUG_LOG_* */
+} usb_log = {
+	/* capture from boot on, the host may attach much later */
+	.flags = OPENPCD_DEBUG_LOG_USB,
+};
+
+/* copy one message into the ring, can be called from IRQ context.
+ * Returns non-zero if the message should still go to the DBGU. */
+int usb_log_append(const char *data, int len)
+{
+	unsigned long irqflags;
+	unsigned int ofs, first;
+
+	if (!(usb_log.flags & OPENPCD_DEBUG_LOG_USB))
+		return 1;
+
+	local_irq_save(irqflags);
+
+	if (USB_LOG_SIZE - (usb_log.head - usb_log.tail) < (unsigned int) len) {
+		usb_log.lost++;
+	} else {
+		ofs = usb_log.head % USB_LOG_SIZE;
+		first = USB_LOG_SIZE - ofs;
+		if (first > (unsigned int) len)
+			first = len;
+		memcpy(usb_log.buf + ofs, data, first);
+		memcpy(usb_log.buf, data + first, len - first);
+		usb_log.head += len;
+	}
+
+	local_irq_restore(irqflags);
+
+	return !(usb_log.flags & OPENPCD_DEBUG_LOG_NOSERIAL);
+}
+
+/* move up to len bytes of the log to buf, also returns the number of
+ * messages dropped since the last call */
+static unsigned int usb_log_read(uint8_t *buf, unsigned int len,
+				 unsigned int *lost)
+{
+	unsigned long irqflags;
+	unsigned int ofs, first;
+
+	local_irq_save(irqflags);
+
+	if (len > usb_log.head - usb_log.tail)
+		len = usb_log.head - usb_log.tail;
+	ofs = usb_log.tail % USB_LOG_SIZE;
+	first = USB_LOG_SIZE - ofs;
+	if (first > len)
+		first = len;
+	memcpy(buf, usb_log.buf + ofs, first);
+	memcpy(buf + first, usb_log.buf, len - first);
+	usb_log.tail += len;
+	*lost = usb_log.lost;
+	usb_log.lost = 0;
+
+	local_irq_restore(irqflags);
+
+	return len;
+}
+
+/* no DEBUGP() in here, it would feed the log we are draining */
+static int usb_log_rx(struct req_ctx *rctx)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+	unsigned int lost;
+	uint8_t flags;
+
+	rctx->tot_len = sizeof(*poh);
+
+	switch (poh->cmd) {
+	case OPENPCD_CMD_DEBUG_LOG_READ:
+		rctx->tot_len += usb_log_read(poh->data,
+					      rctx->size - sizeof(*poh) - 1,
+					      &lost);
+		poh->reg = lost > 0xff ? 0xff : lost;
+		poh->val = usb_in_pad(rctx);
+		break;
+	case OPENPCD_CMD_DEBUG_LOG_CTRL:
+		flags = usb_log.flags;
+		if (poh->reg)
+			usb_log.flags = poh->val;
+		poh->val = flags;
+		break;
+	case OPENPCD_CMD_DEBUG_MASK:
+		if (poh->reg >= DEBUG_MOD_COUNT)
+			return USB_ERR(USB_ERR_CMD_UNKNOWN);
+		flags = debug_masks[poh->reg];
+		if (poh->val & OPENPCD_DEBUG_MASK_SET)
+			debug_masks[poh->reg] = poh->val & ~OPENPCD_DEBUG_MASK_SET;
+		poh->val = flags;
+		break;
+	default:
+		return USB_ERR(USB_ERR_CMD_UNKNOWN);
+	}
+
+	return USB_RET_RESPOND;
+}
+
+void usb_log_init(void)
+{
+	usb_hdlr_register(&usb_log_rx, OPENPCD_CMD_CLS_DEBUG);
+}
+
+#endif /* DEBUG */
@@ -0,0 +1,13 @@
+#ifndef _USB_LOG_H
+#define _USB_LOG_H
+
+#include <sys/types.h>
+
+#ifdef DEBUG
+extern void usb_log_init(void);
+extern int usb_log_append(const char *data, int len);
+#else
+static inline void usb_log_init(void) {}
+#endif
+
+#endif /* _USB_LOG_H */
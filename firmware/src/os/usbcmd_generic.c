@@ -2,6 +2,7 @@
  * (C) 2006 by Harald Welte <hwelte@hmw-consulting.de>
  */
 
+#include <errno.h>
 #include <string.h>
 #include <sys/types.h>
 #include <openpcd.h>
@@ -11,6 +12,10 @@
 #include <os/dbgu.h>
 #include <os/main.h>
 #include <os/flash.h>
+#include <os/frec.h>
+#include <os/la.h>
+#include <os/boot.h>
+#include <os/usbcmd_generic.h>
 #include <board.h>
 #ifdef  PCD
 #include <rc632_highlevel.h>
@@ -19,41 +24,83 @@
 #define OPENPCD_API_VERSION (0x01)
 #define CONFIG_AREA_ADDR ((void*)(AT91C_IFLASH + AT91C_IFLASH_SIZE - ENVIRONMENT_SIZE))
 #define CONFIG_AREA_WORDS ( AT91C_IFLASH_PAGE_SIZE/sizeof(uint32_t) )
+#define CONFIG_USER_WORDS (CONFIG_AREA_WORDS - GEN_ENV_FW_WORDS)
+#define CONFIG_USER_SIZE (CONFIG_USER_WORDS * sizeof(uint32_t))
 
 volatile uint32_t config_stack[ CONFIG_AREA_WORDS ];
 
-static int gen_setenv(const void* buffer,int len)
+static void gen_env_flash(void)
 {
     volatile unsigned int i;
     uint32_t *dst;
 
-    if( len >= sizeof(config_stack) )
-	len=sizeof(config_stack);
-	
-    memcpy(&config_stack,buffer,len);
-    
-    /* retrieve current content to allow partial flashing */    
-    
     /* flash changes */
     dst=(uint32_t*)CONFIG_AREA_ADDR;
     for(i=0;i<CONFIG_AREA_WORDS;i++)
 	*dst++=config_stack[i];
 
     flash_page(CONFIG_AREA_ADDR);
+}
+
+static int gen_setenv(const void* buffer,int len)
+{
+    if( len >= CONFIG_USER_SIZE )
+	len=CONFIG_USER_SIZE;
+	
+    memcpy(&config_stack,buffer,len);
+    
+    /* retrieve current content to allow partial flashing */    
+    gen_env_flash();
 	
     return len;
 }
 
 static int gen_getenv(void* buffer,int len)
 {
-    if( len >= sizeof(config_stack) )
-	len=sizeof(config_stack);
+    if( len >= CONFIG_USER_SIZE )
+	len=CONFIG_USER_SIZE;
 
     memcpy(buffer,&config_stack,len);
 
     return len;
 }
 
+/* Single words at the end of the environment page, for settings of the
+ * firmware itself (enum gen_env_fw_word).  Setting one fails with -EBUSY
+ * while the flash controller is still busy with an earlier write. */
+uint32_t gen_env_word(unsigned int idx)
+{
+	return config_stack[CONFIG_USER_WORDS + idx];
+}
+
+int gen_env_set_word(unsigned int idx, uint32_t val)
+{
+	if (!(AT91F_MC_EFC_GetStatus(AT91C_BASE_MC) & AT91C_MC_FRDY))
+		return -EBUSY;
+
+	config_stack[CONFIG_USER_WORDS + idx] = val;
+	gen_env_flash();
+
+	return 0;
+}
+
+/* flash programming takes milliseconds: wait for the flash controller
+ * without blocking other requests */
+static int gen_setenv_cont(struct req_ctx *rctx)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+
+	if (!(AT91F_MC_EFC_GetStatus(AT91C_BASE_MC) & AT91C_MC_FRDY))
+		return usb_defer(rctx, &gen_setenv_cont);
+
+	gen_setenv(&poh->data, rctx->tot_len - sizeof(*poh));
+	rctx->tot_len = sizeof(*poh);
+
+	if (poh->flags & OPENPCD_FLAG_RESPOND)
+		return USB_RET_RESPOND;
+	return 0;
+}
+
 static int gen_usb_rx(struct req_ctx *rctx)
 {
 	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
@@ -81,8 +128,8 @@ static int gen_usb_rx(struct req_ctx *rctx)
 		
 	case OPENPCD_CMD_SET_ENVIRONMENT:
 		DEBUGP("CMD_SET_ENVIRONMENT (in_len=%u)\n", len);
-		gen_setenv(&poh->data,len);
-		break;
+		rctx->tot_len += len;
+		return usb_defer(rctx, &gen_setenv_cont);
 		
 	case OPENPCD_CMD_RESET:
 		DEBUGP("CMD_RESET\n");
@@ -102,6 +149,51 @@ static int gen_usb_rx(struct req_ctx *rctx)
 		led_switch(poh->reg, poh->val);
 		break;
 
+	case OPENPCD_CMD_RCTX_STATS:
+		DEBUGP("RCTX_STATS(%u)\n", poh->reg);
+		poh->flags |= OPENPCD_FLAG_RESPOND;
+		if (req_ctx_stats(poh->reg, (struct openpcd_rctx_stats *)
+				  poh->data, poh->val & OPENPCD_RCTX_STATS_CLEAR) < 0)
+			return USB_ERR(USB_ERR_CMD_UNKNOWN);
+		poh->val = RCTX_STATE_COUNT;
+		rctx->tot_len += sizeof(struct openpcd_rctx_stats);
+		break;
+
+	case OPENPCD_CMD_FREC_READ:
+		DEBUGP("FREC_READ(%u)\n", poh->reg);
+		poh->flags |= OPENPCD_FLAG_RESPOND;
+		/* 12 + 8n bytes, never a multiple of the EP size */
+		poh->val = frec_read(poh->data, poh->reg, poh->val);
+		rctx->tot_len += sizeof(struct openpcd_frec_hdr) +
+				 poh->val * sizeof(struct openpcd_frec_entry);
+		break;
+
+	case OPENPCD_CMD_LA_CTRL:
+		DEBUGP("LA_CTRL(len=%u)\n", len);
+		poh->flags |= OPENPCD_FLAG_RESPOND;
+		if (len >= sizeof(uint32_t)) {
+			uint32_t mask;
+
+			memcpy(&mask, poh->data, sizeof(mask));
+			if (la_start(mask) == 0)
+				break;
+		}
+		la_stop();
+		break;
+
+	case OPENPCD_CMD_GET_BOOT_TIMES:
+		DEBUGP("GET_BOOT_TIMES\n");
+		poh->flags |= OPENPCD_FLAG_RESPOND;
+		boot_get_times((struct openpcd_boot_times *) poh->data);
+		rctx->tot_len += sizeof(struct openpcd_boot_times);
+		break;
+
+#ifdef CONFIG_MULTIAPP
+	case OPENPCD_CMD_APP:
+		DEBUGP("APP(%u,%u)\n", poh->reg, poh->val);
+		return app_usb_rx(rctx);
+
+#endif
 	case OPENPCD_CMD_GET_SERIAL:
 		DEBUGP("GET SERIAL(");
 		poh->flags |= OPENPCD_FLAG_RESPOND;
@@ -140,5 +232,10 @@ void usbcmd_gen_init(void)
 	memcpy(&config_stack,CONFIG_AREA_ADDR,sizeof(config_stack));
 	
 	usb_hdlr_register(&gen_usb_rx, OPENPCD_CMD_CLS_GENERIC);
+	usb_hdlr_set_prio(OPENPCD_CMD_CLS_GENERIC, USB_PRIO_HIGH);
+	usb_cmd_no_batch(OPENPCD_CMD_SET_ENVIRONMENT);
+#ifdef CONFIG_MULTIAPP
+	usb_cmd_no_batch(OPENPCD_CMD_APP);
+#endif
 }
 
@@ -1,6 +1,14 @@
 #ifndef _USBAPI_GENERIC_H
 #define _USBAPI_GENERIC_H
 extern void usbcmd_gen_init(void);
-extern int gen_setenv(void* data,uint32_t pos,uint32_t length);
-extern int gen_getenv(void* data,uint32_t pos,uint32_t length);
+
+/* words of the environment page kept by the firmware, behind the part
+ * SET_ENVIRONMENT and GET_ENVIRONMENT can reach */
+enum gen_env_fw_word {
+	GEN_ENV_APP_DEFAULT,		/* main_multi default application */
+	GEN_ENV_FW_WORDS
+};
+
+extern uint32_t gen_env_word(unsigned int idx);
+extern int gen_env_set_word(unsigned int idx, uint32_t val);
 #endif
@@ -22,6 +22,7 @@
 
 #include <os/dbgu.h>
 #include <os/system_irq.h>
+#include <os/frec.h>
 
 #define WDT_WDD		0xFF
 #define WDT_WDV		0xFF
@@ -32,6 +33,7 @@
 
 static void wdt_irq(uint32_t sr)
 {
+	frec_log(OPENPCD_FREC_WDT, sr, 0);
 	if (sr & 1)
 		AT91F_DBGU_Frame("================> WATCHDOG EXPIRED !!!!!\n\r");
 	if (sr & 2)
@@ -34,6 +34,7 @@
 #include <os/trigger.h>
 #include <os/pcd_enumerate.h>
 #include <os/main.h>
+#include <os/sched.h>
 #include <pcd/rc632_highlevel.h>
 
 #include <librfid/rfid_reader.h>
@@ -112,4 +113,5 @@ void _main_func(void)
 	}
 #endif	
 	led_toggle(2);
+	sched_post(SCHED_APP);
 }
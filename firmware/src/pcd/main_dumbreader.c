@@ -26,14 +26,31 @@
 #include <os/led.h>
 #include <os/pcd_enumerate.h>
 #include <os/usb_handler.h>
+#include <os/sched.h>
+#include <os/boot.h>
+#include <os/pit.h>
 #include "../openpcd.h"
 #include <os/main.h>
 
 #define RAH NULL
 
-void _init_func(void)
+static void dumbreader_unthrottle(void)
+{
+	udp_unthrottle();
+	rc632_unthrottle();
+}
+
+/* resetting the RC632 takes a while, with FASTBOOT=1 this waits until
+ * the host configured the device */
+static void dumbreader_init(void)
 {
 	rc632_init();
+	sched_register(SCHED_UNTHROTTLE, &dumbreader_unthrottle);
+}
+
+void _init_func(void)
+{
+	boot_defer(&dumbreader_init);
 }
 
 int _main_dbgu(char key)
@@ -75,21 +92,6 @@ int _main_dbgu(char key)
 
 void _main_func(void)
 {
-	static int i;
-	
-	if(i<4096)
-	    i++;
-	else
-	{
-	    led_toggle(1);
-	    i=0;
-	}
-	
-	/* first we try to get rid of pending to-be-sent stuff */
-	usb_out_process();
-
-	/* next we deal with incoming requests from USB EP1 (OUT) */
-	usb_in_process();
-
-	rc632_unthrottle();
+	led_toggle(1);
+	sched_post_in(SCHED_APP, HZ/2);
 }
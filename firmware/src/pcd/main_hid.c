@@ -47,13 +47,4 @@ void _init_func(void)
 
 void _main_func(void)
 {
-	/* first we try to get rid of pending to-be-sent stuff */
-	usb_out_process();
-
-	/* next we deal with incoming requests from USB EP1 (OUT) */
-	usb_in_process();
-
-	/* try unthrottling sources since we now are [more] likely to
-	 * have empty request contexts */
-	udp_unthrottle();
 }
@@ -32,6 +32,8 @@
 #include <os/pcd_enumerate.h>
 #include <os/trigger.h>
 #include <os/req_ctx.h>
+#include <os/usb_event.h>
+#include <os/sched.h>
 #include <pcd/rc632.h>
 
 #include "../openpcd.h"
@@ -129,10 +131,8 @@ mifare_classic_read_sector(struct rfid_protocol_handle *ph, int sector)
 
 static int init_proto(void)
 {
-	struct req_ctx *detect_rctx;
-	struct openpcd_hdr *opcdh;
-	struct openpcd_l2_connectinfo *l2c;
-	struct openpcd_proto_connectinfo *pc;
+	struct openpcd_l2_connectinfo l2ci, *l2c = &l2ci;
+	struct openpcd_proto_connectinfo pci, *pc = &pci;
 	unsigned int size;
 
 	l2h = rfid_layer2_scan(rh);
@@ -141,21 +141,12 @@ static int init_proto(void)
 
 	DEBUGP("l2='%s' ", rfid_layer2_name(l2h));
 
-	detect_rctx = req_ctx_find_get(0, RCTX_STATE_FREE,
-					RCTX_STATE_LIBRFID_BUSY);
-	if (detect_rctx) {
-		unsigned int uid_len;
-		opcdh = (struct openpcd_hdr *) detect_rctx->data;
-		l2c = (struct openpcd_l2_connectinfo *) 
-				(char *) opcdh + sizeof(opcdh);
+	{
+		memset(l2c, 0, sizeof(*l2c));
 		l2c->uid_len = sizeof(l2c->uid);
-		opcdh->cmd = OPENPCD_CMD_LRFID_DETECT_IRQ;
-		opcdh->flags = 0x00;
-		opcdh->reg = 0x03;
-		opcdh->val = l2h->l2->id;
-
-		detect_rctx->tot_len = sizeof(*opcdh) + sizeof(*l2c);
 #if 0
+		unsigned int uid_len;
+
 		/* copy UID / PUPI into data section */
 		rfid_layer2_getopt(l2h, RFID_OPT_LAYER2_UID, (void *)l2c->uid, 
 					&uid_len);
@@ -174,25 +165,17 @@ static int init_proto(void)
 			break;
 		}
 #endif
-		req_ctx_set_state(detect_rctx, RCTX_STATE_UDP_EP3_PENDING);
-	} else
-		DEBUGPCRF("=>>>>>>>>>>>>>>no req_ctx for L2!");
+		if (usb_event_post(OPENPCD_CMD_LRFID_DETECT_IRQ, 0x03,
+				   l2h->l2->id, l2c, sizeof(*l2c), 0) < 0)
+			DEBUGPCRF("=>>>>>>>>>>>>>>no event for L2!");
+	}
 	ph = rfid_protocol_scan(l2h);
 	if (!ph)
 		return 3;
 
 	DEBUGP("p='%s' ", rfid_protocol_name(ph));
-	detect_rctx = req_ctx_find_get(0, RCTX_STATE_FREE,
-					RCTX_STATE_LIBRFID_BUSY);
-	if (detect_rctx) {
-		opcdh = (struct openpcd_hdr *) detect_rctx->data;
-		pc = (struct openpcd_proto_connectinfo *)
-				((char *) opcdh + sizeof(*opcdh));
-		detect_rctx->tot_len = sizeof(*opcdh) + sizeof(*pc);
-		opcdh->cmd = OPENPCD_CMD_LRFID_DETECT_IRQ;
-		opcdh->flags = 0x00;
-		opcdh->reg = 0x04;
-		opcdh->val = ph->proto->id;
+	{
+		memset(pc, 0, sizeof(*pc));
 		/* copy L4 info into data section */
 
 #if 0
@@ -220,9 +203,10 @@ static int init_proto(void)
 			} break;
 		}
 #endif
-		req_ctx_set_state(detect_rctx, RCTX_STATE_UDP_EP3_PENDING);
-	} else
-		DEBUGPCRF("=>>>>>>>>>>>>>>no req_ctx for L2!");
+		if (usb_event_post(OPENPCD_CMD_LRFID_DETECT_IRQ, 0x04,
+				   ph->proto->id, pc, sizeof(*pc), 0) < 0)
+			DEBUGPCRF("=>>>>>>>>>>>>>>no event for L4!");
+	}
 	led_switch(1, 1);
 
 	if (ph->proto->id == RFID_PROTOCOL_MIFARE_CLASSIC) {
@@ -260,9 +244,6 @@ void _main_func(void)
 {
 	int ret;
 
-	usb_out_process();
-	usb_in_process();
-	
 	ret = init_proto();
 
 	if (ret >= 4)
@@ -276,4 +257,5 @@ void _main_func(void)
 
 	led_switch(1, 0);
 	led_toggle(2);
+	sched_post(SCHED_APP);
 }
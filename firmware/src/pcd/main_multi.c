@@ -0,0 +1,157 @@
+/* main_multi - several OpenPCD applications in one image
+ *
+ * Built with TARGET=main_multi, the Makefile links the applications of
+ * APPS (main_dumbreader.c, main_pwm.c, ...) together, renaming their
+ * _init_func(), _main_func() and _main_dbgu() to <app>_init_func() etc.
+ * The ones here pass on to the application chosen at boot: the one
+ * picked with OPENPCD_CMD_APP before a reset, else the default stored in
+ * the environment, else the first one of APPS.  The applications have no
+ * way to shut down, so switching always goes through a reset, which
+ * takes milliseconds instead of a DFU cycle.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <lib_AT91SAM7.h>
+#include <openpcd.h>
+#include <os/dbgu.h>
+#include <os/main.h>
+#include <os/pit.h>
+#include <os/req_ctx.h>
+#include <os/usb_handler.h>
+#include <os/usbcmd_generic.h>
+#include <board.h>
+
+#ifndef APP_LIST
+#error APP_LIST undefined, build with TARGET=main_multi APPS="..."
+#endif
+
+struct app {
+	const char *name;
+	void (*init)(void);
+	void (*main)(void);
+	int (*dbgu)(char key);
+};
+
+#define APP(n)	extern void n##_init_func(void);			\
+		extern void n##_main_func(void);			\
+		extern int n##_main_dbgu(char key);
+APP_LIST
+#undef APP
+
+#define APP(n)	{ #n, &n##_init_func, &n##_main_func, &n##_main_dbgu },
+static const struct app apps[] = {
+	APP_LIST
+};
+#undef APP
+
+#define NUM_APPS	(sizeof(apps) / sizeof(apps[0]))
+
+#define APP_MAGIC	0x41500000		/* "AP" */
+
+/* application for the next boot and its complement, survives the reset
+ * but holds garbage after power-up */
+static uint32_t app_next[2] __attribute__ ((section (".noinit")));
+static unsigned int app_cur;
+static struct timer_list app_reset_timer;
+
+static int app_valid(uint32_t v)
+{
+	return (v & 0xffff0000) == APP_MAGIC && (v & 0xffff) < NUM_APPS;
+}
+
+static unsigned int app_default(void)
+{
+	uint32_t v = gen_env_word(GEN_ENV_APP_DEFAULT);
+
+	return app_valid(v) ? v & 0xffff : 0;
+}
+
+static void app_reset(void *data)
+{
+	AT91F_RSTSoftReset(AT91C_BASE_RSTC, AT91C_RSTC_PROCRST|
+			   AT91C_RSTC_PERRST|AT91C_RSTC_EXTRST);
+}
+
+static int app_usb_cont(struct req_ctx *rctx)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+	unsigned int i, len;
+
+	if (poh->reg & OPENPCD_APP_DEFAULT &&
+	    gen_env_set_word(GEN_ENV_APP_DEFAULT, APP_MAGIC | poh->val) < 0)
+		return usb_defer(rctx, &app_usb_cont);
+
+	if (poh->reg & OPENPCD_APP_SELECT) {
+		app_next[0] = APP_MAGIC | poh->val;
+		app_next[1] = ~app_next[0];
+		/* leave the reply time to go out */
+		app_reset_timer.function = &app_reset;
+		app_reset_timer.expires = jiffies + HZ / 10;
+		timer_add(&app_reset_timer);
+	}
+
+	poh->flags |= OPENPCD_FLAG_RESPOND;
+	poh->val = app_cur;
+	poh->reg = app_default();
+	for (i = 0; i < NUM_APPS; i++) {
+		len = strlen(apps[i].name) + 1;
+		if (rctx->tot_len + len > rctx->size - 1)
+			break;
+		memcpy(rctx->data + rctx->tot_len, apps[i].name, len);
+		rctx->tot_len += len;
+	}
+	usb_in_pad(rctx);
+
+	return USB_RET_RESPOND;
+}
+
+/* OPENPCD_CMD_APP, called by the generic command handler */
+int app_usb_rx(struct req_ctx *rctx)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) rctx->data;
+
+	if (poh->reg & (OPENPCD_APP_SELECT|OPENPCD_APP_DEFAULT) &&
+	    poh->val >= NUM_APPS)
+		return USB_ERR(USB_ERR_CMD_NOT_IMPL);
+
+	return app_usb_cont(rctx);
+}
+
+void _init_func(void)
+{
+	if (app_valid(app_next[0]) && app_next[1] == ~app_next[0])
+		app_cur = app_next[0] & 0xffff;
+	else
+		app_cur = app_default();
+	app_next[0] = app_next[1] = 0;
+
+	DEBUGPCR("application %s (%u of %u)", apps[app_cur].name, app_cur,
+		 NUM_APPS);
+	apps[app_cur].init();
+}
+
+int _main_dbgu(char key)
+{
+	return apps[app_cur].dbgu(key);
+}
+
+void _main_func(void)
+{
+	apps[app_cur].main();
+}
@@ -27,6 +27,7 @@
 #include <os/led.h>
 #include <os/pcd_enumerate.h>
 #include <os/usb_handler.h>
+#include <os/sched.h>
 #include <pcd/rc632_highlevel.h>
 
 #include <librfid/rfid_reader.h>
@@ -73,6 +74,12 @@ static int usb_presence_rx(struct req_ctx *rctx)
     return 0;
 }
 
+static void presence_unthrottle(void)
+{
+	udp_unthrottle();
+	rc632_unthrottle();
+}
+
 void _init_func(void)
 {
 	DEBUGPCRF("enabling RC632");	
@@ -87,9 +94,12 @@ void _init_func(void)
 		
 	DEBUGPCRF("registering USB handler");
 	usb_hdlr_register(&usb_presence_rx, OPENPCD_CMD_CLS_PRESENCE);
+	usb_hdlr_set_prio(OPENPCD_CMD_CLS_PRESENCE, USB_PRIO_HIGH);
 	
 	delay_scan=delay_blink=0;
 	last_uid=0;
+
+	sched_register(SCHED_UNTHROTTLE, &presence_unthrottle);
 }
 
 int _main_dbgu(char key)
@@ -154,10 +164,7 @@ void _main_func(void)
         led_switch(1,(delay_blink==0)?1:0);
 	if(delay_blink)
 	    delay_blink--;
-	
-	/* first we try to get rid of pending to-be-sent stuff */
-	usb_out_process();
-	/* next we deal with incoming requests from USB EP1 (OUT) */
-	usb_in_process();
-	rc632_unthrottle();
+
+	/* keep polling for cards */
+	sched_post(SCHED_APP);
 }
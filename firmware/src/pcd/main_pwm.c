@@ -32,6 +32,8 @@
 #include <os/tc_cdiv.h>
 #include <os/pcd_enumerate.h>
 #include <os/usb_handler.h>
+#include <os/sched.h>
+#include <os/pit.h>
 
 #ifdef SSC
 #include <pcd/ssc.h>
@@ -95,6 +97,15 @@ static void help(void)
 		 "{: decrease cdiv_idx }: increse cdiv idx");
 }
 
+static void pwm_unthrottle(void)
+{
+	udp_unthrottle();
+	rc632_unthrottle();
+#ifdef SSC
+	ssc_rx_unthrottle();
+#endif
+}
+
 void _init_func(void)
 {
 	DEBUGPCR("\r\n===> main_pwm <===\r\n");
@@ -121,6 +132,8 @@ void _init_func(void)
 	DEBUGPCRF("Initializing SSC RX");
 	ssc_rx_init();
 #endif
+
+	sched_register(SCHED_UNTHROTTLE, &pwm_unthrottle);
 }
 
 int _main_dbgu(char key)
@@ -257,20 +270,9 @@ int _main_dbgu(char key)
 }
 
 
+/* LED 2 shows that the main loop is alive */
 void _main_func(void)
 {
-	/* first we try to get rid of pending to-be-sent stuff */
-	usb_out_process();
-
-	/* next we deal with incoming requests from USB EP1 (OUT) */
-	usb_in_process();
-
-	/* try unthrottling sources since we now are [more] likely to
-	 * have empty request contexts */
-	rc632_unthrottle();
-#ifdef SSC
-	ssc_rx_unthrottle();
-#endif
-
 	led_toggle(2);
+	sched_post_in(SCHED_APP, HZ/4);
 }
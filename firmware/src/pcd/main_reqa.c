@@ -33,6 +33,7 @@
 #include <os/led.h>
 #include <os/pcd_enumerate.h>
 #include <os/trigger.h>
+#include <os/sched.h>
 #include <pcd/rc632_highlevel.h>
 
 #include <librfid/rfid_reader.h>
@@ -288,5 +289,5 @@ void _main_func(void)
 		led_switch(1, 1);
 
 	led_toggle(2);
-
+	sched_post(SCHED_APP);
 }
@@ -30,15 +30,7 @@ void _init_func(void)
 	usbtest_init();
 }
 
+/* nothing to poll, requests are handled by the SCHED_USB_* tasks */
 void _main_func(void)
 {
-	/* first we try to get rid of pending to-be-sent stuff */
-	usb_out_process();
-
-	/* next we deal with incoming requests from USB EP1 (OUT) */
-	usb_in_process();
-
-	/* try unthrottling sources since we now are [more] likely to
-	 * have empty request contexts */
-	udp_unthrottle();
 }
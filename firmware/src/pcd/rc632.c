@@ -25,6 +25,8 @@
  *
  */
 
+#define DEBUG_MODULE	DEBUG_MOD_RC632
+
 #include <string.h>
 #include <errno.h>
 #include <lib_AT91SAM7.h>
@@ -36,6 +38,8 @@
 #include <os/pcd_enumerate.h>
 #include <os/usb_handler.h>
 #include <os/req_ctx.h>
+#include <os/usb_event.h>
+#include <os/frec.h>
 #include "rc632.h"
 
 #include <librfid/rfid_asic.h>
@@ -50,11 +54,9 @@
 #define DEBUGPSPIIRQ(x, args...) NOTHING
 #endif
 
-#if 0
-#define DEBUG632 DEBUGPCRF
-#else
-#define DEBUG632(x, args ...)	NOTHING
-#endif
+/* register level tracing, enabled at runtime with DEBUG_LVL_TRACE */
+#define DEBUG632(x, args ...)	DEBUGPL(DEBUG_LVL_TRACE, "%s(%d): " x "\r\n", \
+					__FUNCTION__, __LINE__, ## args)
 
 
 /* SPI driver */
@@ -178,11 +180,22 @@ static int spi_transceive(const uint8_t *tx_data, uint16_t tx_len,
 
 /* RC632 driver */
 
-/* static buffers used by RC632 access primitives below. 
- * Since we only have one */
+/* static buffers used by RC632 access primitives below.  rc632_irq()
+ * has its own pair: it may come in while the main loop is filling or
+ * reading the other one, spi_transceive() only masks it for the
+ * transfer itself. */
 
-static uint8_t spi_outbuf[SPI_MAX_XFER_LEN];
-static uint8_t spi_inbuf[SPI_MAX_XFER_LEN];
+struct spi_bufs {
+	uint8_t out[SPI_MAX_XFER_LEN];
+	uint8_t in[SPI_MAX_XFER_LEN];
+};
+static struct spi_bufs spi_bufs[2];
+static volatile uint8_t spi_in_irq;
+
+static inline struct spi_bufs *spi_bufs_get(void)
+{
+	return &spi_bufs[spi_in_irq];
+}
 
 #define FIFO_ADDR (RC632_REG_FIFO_DATA << 1)
 
@@ -193,16 +206,17 @@ static uint8_t spi_inbuf[SPI_MAX_XFER_LEN];
 int opcd_rc632_reg_write(struct rfid_asic_handle *hdl,
 			 uint8_t addr, uint8_t data)
 {
+	struct spi_bufs *b = spi_bufs_get();
 	uint16_t rx_len = 2;
 
 	DEBUG632("[0x%02x] <= 0x%02x", addr, data);
 
 	addr = RC632_WRITE_ADDR(addr);
 
-	spi_outbuf[0] = addr;
-	spi_outbuf[1] = data;
+	b->out[0] = addr;
+	b->out[1] = data;
 
-	return spi_transceive(spi_outbuf, 2, spi_inbuf, &rx_len);
+	return spi_transceive(b->out, 2, b->in, &rx_len);
 }
 
 #define RC632_REGSET_START	0x10
@@ -213,6 +227,7 @@ static uint8_t regset_buf[RC632_REGSET_MAXSIZE * 2];
 int opcd_rc632_reg_write_set(struct rfid_asic_handle *hdl,
 			     uint8_t *regs, int len)
 {
+	struct spi_bufs *b = spi_bufs_get();
 	uint8_t i, j = 0;
 	uint16_t rx_len;
 
@@ -228,36 +243,38 @@ int opcd_rc632_reg_write_set(struct rfid_asic_handle *hdl,
 	}
 	
 	rx_len = j;
-	return spi_transceive(regset_buf, j, spi_inbuf, &rx_len);
+	return spi_transceive(regset_buf, j, b->in, &rx_len);
 }
 
 int opcd_rc632_fifo_write(struct rfid_asic_handle *hdl,
 			  uint8_t len, uint8_t *data, uint8_t flags)
 {
-	uint16_t rx_len = sizeof(spi_inbuf);
-	if (len > sizeof(spi_outbuf)-1)
-		len = sizeof(spi_outbuf)-1;
+	struct spi_bufs *b = spi_bufs_get();
+	uint16_t rx_len = sizeof(b->in);
+	if (len > sizeof(b->out)-1)
+		len = sizeof(b->out)-1;
 
-	spi_outbuf[0] = FIFO_ADDR;
-	memcpy(&spi_outbuf[1], data, len);
+	b->out[0] = FIFO_ADDR;
+	memcpy(&b->out[1], data, len);
 
 	DEBUG632("[FIFO] <= %s", hexdump(data, len));
 
-	return spi_transceive(spi_outbuf, len+1, spi_inbuf, &rx_len);
+	return spi_transceive(b->out, len+1, b->in, &rx_len);
 }
 
 int opcd_rc632_reg_read(struct rfid_asic_handle *hdl, 
 			uint8_t addr, uint8_t *val)
 {
+	struct spi_bufs *b = spi_bufs_get();
 	uint16_t rx_len = 2;
 
 	addr = (addr << 1) & 0x7e;
 
-	spi_outbuf[0] = addr | 0x80;
-	spi_outbuf[1] = 0x00;
+	b->out[0] = addr | 0x80;
+	b->out[1] = 0x00;
 
-	spi_transceive(spi_outbuf, 2, spi_inbuf, &rx_len);
-	*val = spi_inbuf[1];
+	spi_transceive(b->out, 2, b->in, &rx_len);
+	*val = b->in[1];
 
 	DEBUG632("[0x%02x] => 0x%02x", addr>>1, *val);
 
@@ -267,6 +284,7 @@ int opcd_rc632_reg_read(struct rfid_asic_handle *hdl,
 int opcd_rc632_fifo_read(struct rfid_asic_handle *hdl,
 			 uint8_t max_len, uint8_t *data)
 {
+	struct spi_bufs *b = spi_bufs_get();
 	int ret;
 	uint8_t fifo_length;
 	uint8_t i;
@@ -282,13 +300,13 @@ int opcd_rc632_fifo_read(struct rfid_asic_handle *hdl,
 		fifo_length = max_len;
 
 	for (i = 0; i < fifo_length; i++)
-		spi_outbuf[i] = FIFO_ADDR;
+		b->out[i] = FIFO_ADDR;
 
-	spi_outbuf[0] |= 0x80;
-	spi_outbuf[fifo_length] = 0x00;
+	b->out[0] |= 0x80;
+	b->out[fifo_length] = 0x00;
 
-	spi_transceive(spi_outbuf, fifo_length+1, spi_inbuf, &rx_len);
-	memcpy(data, spi_inbuf+1, rx_len-1);
+	spi_transceive(b->out, fifo_length+1, b->in, &rx_len);
+	memcpy(data, b->in+1, rx_len-1);
 
 	DEBUG632("[FIFO] => %s", hexdump(data, rx_len-1));
 
@@ -325,35 +343,137 @@ int opcd_rc632_clear_bits(struct rfid_asic_handle *hdl,
 	return opcd_rc632_reg_write(hdl, reg, val);
 }
 
+/* Virtual FIFO
+ *
+ * Frames longer than the 64 byte RC632 FIFO are streamed through two
+ * rings in RAM.  The USB handler is the producer of 'tx' and the consumer
+ * of 'rx', rc632_irq() the other side of both, so neither needs locking.
+ * The IRQ refills the RC632 FIFO from 'tx' on LoAlert and empties it into
+ * 'rx' on HiAlert and at the end of a command.  Once armed by
+ * WRITE_VFIFO, the IRQ owns the RC632 FIFO until the host goes back to
+ * plain READ_FIFO / WRITE_FIFO. */
+
+#define RC632_FIFO_SIZE		64
+#define VFIFO_WATER_LEVEL	32
+
+static struct {
+	struct fifo tx;
+	struct fifo rx;
+	volatile uint8_t armed;
+	volatile uint8_t oflow;		/* rx bytes were dropped */
+	uint8_t water_level;		/* FIFO_LEVEL before arming */
+	uint8_t int_en;			/* INTERRUPT_EN before arming */
+} vfifo;
+
+/* called from rc632_irq() on LoAlert */
+static void vfifo_refill(void)
+{
+	uint8_t fifo_len, *data;
+	uint16_t len, room;
+
+	opcd_rc632_reg_read(NULL, RC632_REG_FIFO_LENGTH, &fifo_len);
+	room = RC632_FIFO_SIZE - fifo_len;
+
+	/* at most two spans when the ring wraps */
+	while (room && (len = fifo_read_peek(&vfifo.tx, &data))) {
+		if (len > room)
+			len = room;
+		opcd_rc632_fifo_write(NULL, len, data, 0);
+		fifo_read_commit(&vfifo.tx, len);
+		room -= len;
+	}
+
+	/* nothing left to send, LoAlert would fire forever */
+	if (!fifo_available(&vfifo.tx))
+		opcd_rc632_reg_write(NULL, RC632_REG_INTERRUPT_EN,
+				     RC632_INT_LOALERT);
+}
+
+/* called from rc632_irq() on HiAlert and at the end of a command */
+static void vfifo_drain(void)
+{
+	uint8_t *data, scratch[RC632_FIFO_SIZE];
+	uint16_t len;
+	int ret;
+
+	do {
+		len = fifo_write_peek(&vfifo.rx, &data);
+		if (!len) {
+			/* host doesn't read, keep the RC632 going anyway */
+			opcd_rc632_fifo_read(NULL, sizeof(scratch), scratch);
+			vfifo.oflow = 1;
+			return;
+		}
+		if (len > RC632_FIFO_SIZE)
+			len = RC632_FIFO_SIZE;
+		ret = opcd_rc632_fifo_read(NULL, len, data);
+		if (ret <= 0)
+			return;
+		fifo_write_commit(&vfifo.rx, ret);
+	} while (ret == len);
+}
+
+static void vfifo_arm(void)
+{
+	if (vfifo.armed)
+		return;
+
+	opcd_rc632_reg_read(NULL, RC632_REG_FIFO_LEVEL, &vfifo.water_level);
+	opcd_rc632_reg_read(NULL, RC632_REG_INTERRUPT_EN, &vfifo.int_en);
+	opcd_rc632_reg_write(NULL, RC632_REG_FIFO_LEVEL, VFIFO_WATER_LEVEL);
+	vfifo.armed = 1;
+	opcd_rc632_reg_write(NULL, RC632_REG_INTERRUPT_EN, RC632_INT_SET|
+			     RC632_INT_HIALERT|RC632_INT_IDLE|RC632_INT_RX);
+}
+
+static void vfifo_disarm(void)
+{
+	if (!vfifo.armed)
+		return;
+
+	opcd_rc632_reg_write(NULL, RC632_REG_INTERRUPT_EN, 0x3f);
+	vfifo.armed = 0;
+	opcd_rc632_reg_write(NULL, RC632_REG_FIFO_LEVEL, vfifo.water_level);
+	opcd_rc632_reg_write(NULL, RC632_REG_INTERRUPT_EN,
+			     RC632_INT_SET|(vfifo.int_en & 0x3f));
+}
+
 /* RC632 interrupt handling */
 
-static void rc632_irq(void)
+static void __rc632_irq(void)
 {
-	struct req_ctx *irq_rctx;
-	struct openpcd_hdr *irq_opcdh;
 	uint8_t cause;
 
 	/* CL RC632 has interrupted us */
 	opcd_rc632_reg_read(NULL, RC632_REG_INTERRUPT_RQ, &cause);
+	frec_log(OPENPCD_FREC_IRQ_ENTER, OPENPCD_IRQ_RC632, cause);
 
 	/* ACK all interrupts */
 	//rc632_reg_write(NULL, RC632_REG_INTERRUPT_RQ, cause);
 	opcd_rc632_reg_write(NULL, RC632_REG_INTERRUPT_RQ, RC632_INT_TIMER);
 	DEBUGP("rc632_irq: ");
 
-	if (cause & RC632_INT_LOALERT) {
-		/* FIFO is getting low, refill from virtual FIFO */
-		DEBUGP("FIFO_low ");
-		#if 0
-		if (!fifo_available(&rc632.fifo))
+	if (vfifo.armed) {
+		if (cause & RC632_INT_LOALERT) {
+			/* FIFO is getting low, refill from virtual FIFO */
+			DEBUGP("FIFO_low ");
+			vfifo_refill();
+		}
+		if (cause & (RC632_INT_HIALERT|RC632_INT_IDLE|RC632_INT_RX)) {
+			/* FIFO is getting full or the frame is complete,
+			 * empty into virtual FIFO */
+			DEBUGP("FIFO_high ");
+			vfifo_drain();
+		}
+		/* the alerts only clear once the level has been fixed */
+		opcd_rc632_reg_write(NULL, RC632_REG_INTERRUPT_RQ,
+				cause & (RC632_INT_LOALERT|RC632_INT_HIALERT));
+		cause &= ~(RC632_INT_LOALERT|RC632_INT_HIALERT);
+		if (!cause) {
+			DEBUGPCR("");
+			frec_log(OPENPCD_FREC_IRQ_EXIT, OPENPCD_IRQ_RC632, 0);
 			return;
-		#endif
-		/* FIXME */
-	}
-	if (cause & RC632_INT_HIALERT) {
-		/* FIFO is getting full, empty into virtual FIFO */
-		DEBUGP("FIFO_high ");
-		/* FIXME */
+		}
 	}
 	/* All interrupts below can be reported directly to the host */
 	if (cause & RC632_INT_TIMER)
@@ -366,25 +486,19 @@ static void rc632_irq(void)
 		DEBUGP("TxComplete ");
 	
 
-	irq_rctx = req_ctx_find_get(0, RCTX_STATE_FREE,
-				    RCTX_STATE_RC632IRQ_BUSY);
-	if (!irq_rctx) {
-		DEBUGPCRF("NO RCTX!");
-		/* disable rc632 interrupt until RCTX is free */
-		AT91F_AIC_DisableIt(AT91C_BASE_AIC, OPENPCD_IRQ_RC632);
-		return;
-	}
-
-	irq_opcdh = (struct openpcd_hdr *) irq_rctx->data;
-
-	/* initialize static part of openpcd_hdr for USB IRQ reporting */
-	irq_opcdh->cmd = OPENPCD_CMD_IRQ;
-	irq_opcdh->flags = 0x00;
-	irq_opcdh->reg = 0x07;
-	irq_opcdh->val = cause;
-	
-	req_ctx_set_state(irq_rctx, RCTX_STATE_UDP_EP3_PENDING);
+	/* causes of an interrupt storm are merged into one event */
+	if (usb_event_post(OPENPCD_CMD_IRQ, RC632_REG_INTERRUPT_RQ, cause,
+			   NULL, 0, USB_EVENT_F_COALESCE) < 0)
+		DEBUGPCRF("event queue full!");
 	DEBUGPCR("");
+	frec_log(OPENPCD_FREC_IRQ_EXIT, OPENPCD_IRQ_RC632, 0);
+}
+
+static void rc632_irq(void)
+{
+	spi_in_irq = 1;
+	__rc632_irq();
+	spi_in_irq = 0;
 }
 
 void rc632_unthrottle(void)
@@ -442,6 +556,7 @@ static int rc632_usb_in(struct req_ctx *rctx)
 	case OPENPCD_CMD_READ_FIFO:
 		/* FIFO read always has to provoke a response */
 		poh->flags &= OPENPCD_FLAG_RESPOND;
+		vfifo_disarm();
 		{
 		uint16_t req_len = poh->val, remain_len = req_len, pih_len;
 #if 0
@@ -492,15 +607,37 @@ static int rc632_usb_in(struct req_ctx *rctx)
 	case OPENPCD_CMD_WRITE_FIFO:
 		DEBUGP("WRITE FIFO(len=%u): %s ", len,
 			hexdump(poh->data, len));
+		vfifo_disarm();
 		opcd_rc632_fifo_write(NULL, len, poh->data, 0);
 		break;
 	case OPENPCD_CMD_READ_VFIFO:
-		DEBUGP("READ VFIFO ");
-		goto not_impl;
+		/* FIFO read always has to provoke a response */
+		poh->flags &= OPENPCD_FLAG_RESPOND;
+		{
+		uint16_t req_len = poh->val;
+
+		if (req_len > rctx->size - sizeof(*poh) - 1)
+			req_len = rctx->size - sizeof(*poh) - 1;
+		poh->val = fifo_data_get(&vfifo.rx, req_len, poh->data);
+		poh->reg = vfifo.oflow ? OPENPCD_VFIFO_OFLOW : 0;
+		vfifo.oflow = 0;
+		rctx->tot_len += poh->val;
+		usb_in_pad(rctx);
+		DEBUGP("READ VFIFO(len=%u)=%s ", poh->val,
+			hexdump(poh->data, poh->val));
+		}
 		break;
 	case OPENPCD_CMD_WRITE_VFIFO:
-		DEBUGP("WRITE VFIFO ");
-		goto not_impl;
+		DEBUGP("WRITE VFIFO(len=%u) ", len);
+		/* all or nothing, the host retries once the frame drained */
+		if (len > fifo_space(&vfifo.tx))
+			return USB_ERR(USB_ERR_BUSY);
+		fifo_data_put(&vfifo.tx, len, poh->data);
+		vfifo_arm();
+		/* LoAlert is pending as long as the FIFO is low, so this
+		 * makes rc632_irq() start the refill right away */
+		opcd_rc632_reg_write(NULL, RC632_REG_INTERRUPT_EN,
+				     RC632_INT_SET|RC632_INT_LOALERT);
 		break;
 	case OPENPCD_CMD_REG_BITS_CLEAR:
 		DEBUGP("CLEAR BITS ");
@@ -527,7 +664,8 @@ not_impl:
 
 void rc632_init(void)
 {
-	//fifo_init(&rc632.fifo, 256, NULL, &rc632);
+	fifo_init(&vfifo.tx, FIFO_SIZE, NULL, NULL);
+	fifo_init(&vfifo.rx, FIFO_SIZE, NULL, NULL);
 
 	DEBUGPCRF("entering");
 
@@ -612,32 +750,33 @@ static int rc632_reg_write_verify(struct rfid_asic_handle *hdl,
 
 int rc632_dump(void)
 {
+	struct spi_bufs *b = spi_bufs_get();
 	uint8_t i;
-	uint16_t rx_len = sizeof(spi_inbuf);
+	uint16_t rx_len = sizeof(b->in);
 
 	for (i = 0; i <= 0x3f; i++) {
 		uint8_t reg = i;
 		if (reg == RC632_REG_FIFO_DATA)
 			reg = 0x3e;
 			
-		spi_outbuf[i] = reg << 1;
-		spi_inbuf[i] = 0x00;
+		b->out[i] = reg << 1;
+		b->in[i] = 0x00;
 	}
 
 	/* MSB of first byte of read spi transfer is high */
-	spi_outbuf[0] |= 0x80;
+	b->out[0] |= 0x80;
 
 	/* last byte of read spi transfer is 0x00 */
-	spi_outbuf[0x40] = 0x00;
-	spi_inbuf[0x40] = 0x00;
+	b->out[0x40] = 0x00;
+	b->in[0x40] = 0x00;
 
-	spi_transceive(spi_outbuf, 0x41, spi_inbuf, &rx_len);
+	spi_transceive(b->out, 0x41, b->in, &rx_len);
 
 	for (i = 0; i < 0x3f; i++) {
 		if (i == RC632_REG_FIFO_DATA)
 			DEBUGPCR("REG 0x02 = NOT READ");
 		else
-			DEBUGPCR("REG 0x%02x = 0x%02x", i, spi_inbuf[i+1]);
+			DEBUGPCR("REG 0x%02x = 0x%02x", i, b->in[i+1]);
 	}
 	
 	return 0;
@@ -137,6 +137,8 @@ static int adc_usb_in(struct req_ctx *rctx)
 		AT91F_ADC_StartConversion(adc);
 		break;
 	}
+
+	return 0;
 }
 
 int adc_init(void)
@@ -154,4 +156,6 @@ int adc_init(void)
 	AT91F_AIC_EnableIt(AT91C_BASE_AIC, AT91C_ID_ADC);
 
 	usb_hdlr_register(&adc_usb_in, OPENPCD_CMD_CLS_ADC);
+	/* the DMA fills the request after we return */
+	usb_cmd_no_batch(OPENPCD_CMD_ADC_READ);
 }
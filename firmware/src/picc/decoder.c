@@ -52,7 +52,7 @@ int decoder_decode(uint8_t algo, const char *sample_buf,
 
 	for (i = 0; i < (sample_buf_size*8)/st.algo->bits_per_sampled_char;
 	     i++) {
-		ret = get_next_data(&st, &data_buf[i]);
+		ret = get_next_data(&st, (uint8_t *) &data_buf[i]);
 		if (ret < 0) {
 			DEBUGPCR("decoder error %d at data byte %u",
 				 ret, i);
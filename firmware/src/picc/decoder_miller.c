@@ -120,7 +120,7 @@ static uint32_t get_next_bytesample(struct decoder_state *ms,
 	return ret;
 }
 
-static struct decoder_algo miller_decoder = {
+struct decoder_algo miller_decoder = {
 	.oversampling_rate = OVERSAMPLING_RATE,
 	.bits_per_sampled_char = 9 * OVERSAMPLING_RATE,
 	.bytesample_mask = 0xffffffff,
@@ -99,7 +99,7 @@ static int nrzl_decode_sample(const uint32_t sample, uint8_t *data)
 	return 0;
 }
 
-static struct decoder_algo nrzl_decoder = {
+struct decoder_algo nrzl_decoder = {
 	.oversampling_rate = OVERSAMPLING_RATE,
 	.bits_per_sampled_char = 10 * OVERSAMPLING_RATE,
 	.bytesample_mask = 0x3ff,
@@ -30,6 +30,7 @@
 #include <os/pwm.h>
 #include <os/tc_cdiv.h>
 #include <os/pio_irq.h>
+#include <os/sched.h>
 #include <picc/da.h>
 #include <picc/pll.h>
 #include <picc/ssc_picc.h>
@@ -47,6 +48,13 @@ static uint8_t load_mod = 0;
 
 #define DA_BASELINE 192
 
+/* the SSC receiver waits for free req_ctx like the OUT endpoint */
+static void picc_unthrottle(void)
+{
+	udp_unthrottle();
+	ssc_rx_unthrottle();
+}
+
 void _init_func(void)
 {
 	/* low-level hardware initialization */
@@ -67,6 +75,8 @@ void _init_func(void)
 
 	AT91F_PIO_CfgInput(AT91C_BASE_PIOA, OPENPICC_PIO_BOOTLDR);
 	da_comp_carr(DA_BASELINE);
+
+	sched_register(SCHED_UNTHROTTLE, &picc_unthrottle);
 }
 
 static void help(void)
@@ -248,12 +258,4 @@ int _main_dbgu(char key)
 
 void _main_func(void)
 {
-	/* first we try to get rid of pending to-be-sent stuff */
-	usb_out_process();
-
-	/* next we deal with incoming requests from USB EP1 (OUT) */
-	usb_in_process();
-
-	udp_unthrottle();
-	ssc_rx_unthrottle();
 }
@@ -24,6 +24,8 @@
 
 //#undef DEBUG
 
+#define DEBUG_MODULE	DEBUG_MOD_SSC
+
 #include <errno.h>
 #include <string.h>
 #include <sys/types.h>
@@ -112,8 +112,8 @@ void tc_fdt_init(void)
 		      AT91C_TC_EEVT_TIOB | AT91C_TC_ETRGEDG_FALLING |
 		      AT91C_TC_ENETRG | AT91C_TC_CPCSTOP ;
 
-	/* Reset to start timers */
-	tcb->TCB_BCR = 1;
+	/* Trigger TC2 alone, TCB_BCR hits the timebase on TC1 as well */
+	tcfdt->TC_CCR = AT91C_TC_SWTRG;
 
 	AT91F_AIC_ConfigureIt(AT91C_BASE_AIC, AT91C_ID_TC2,
 			      OPENPCD_IRQ_PRIO_TC_FDT,
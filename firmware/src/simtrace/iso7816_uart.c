@@ -17,6 +17,8 @@
  *
  */
 
+#define DEBUG_MODULE	DEBUG_MOD_ISO7816
+
 #include <errno.h>
 #include <string.h>
 #include <sys/types.h>
@@ -29,6 +31,7 @@
 #include <os/usb_handler.h>
 #include <os/dbgu.h>
 #include <os/pio_irq.h>
+#include <os/frec.h>
 
 #include "../simtrace.h"
 #include "../openpcd.h"
@@ -286,6 +289,7 @@ static void set_state(struct iso7816_3_handle *ih, enum iso7816_3_state new_stat
 		return;
 
 	//DEBUGPCR("7816 state %u -> %u", ih->state, new_state);
+	frec_log(OPENPCD_FREC_STATE, OPENPCD_FREC_SM_ISO7816, new_state);
 	ih->state = new_state;
 }
 
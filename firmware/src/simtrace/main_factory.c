@@ -88,11 +88,4 @@ int _main_dbgu(char key)
 
 void _main_func(void)
 {
-	/* first we try to get rid of pending to-be-sent stuff */
-	usb_out_process();
-
-	/* next we deal with incoming requests from USB EP1 (OUT) */
-	usb_in_process();
-
-	udp_unthrottle();
 }
@@ -29,6 +29,8 @@
 #include "../simtrace.h"
 #include <os/main.h>
 #include <os/pio_irq.h>
+#include <os/pit.h>
+#include <os/sched.h>
 
 #include <simtrace/tc_etu.h>
 #include <simtrace/iso7816_uart.h>
@@ -246,26 +248,18 @@ int _main_dbgu(char key)
 	return -EINVAL;
 }
 
+/* runs every jiffy, a receive buffer that didn't grow since the last
+ * run is sent to the host */
 void _main_func(void)
 {
-	static unsigned loopLow = 0, loopHigh = 0;
+	static unsigned runs = 0, beats = 0;
 
-	/* first we try to get rid of pending to-be-sent stuff */
-	usb_out_process();
-
-	/* next we deal with incoming requests from USB EP1 (OUT) */
-	usb_in_process();
-
-	udp_unthrottle();
-
-	if ((loopLow & 0xFFFF) == 0) {
-		DEBUGPCR("Heart beat %08X", loopHigh++);
-	}
-	if ((loopLow & 0x3F) == 0) {
-		iso_uart_idleflush();
-	}
-	loopLow++;
+	if ((runs++ % (10 * HZ)) == 0)
+		DEBUGPCR("Heart beat %08X", beats++);
+	iso_uart_idleflush();
 
 	iso_uart_report_errors();
 	check_spurious_irq();
+
+	sched_post_in(SCHED_APP, 1);
 }
@@ -123,6 +123,6 @@ void tc_etu_init(void)
 	/* Enable master clock for TC0 */
 	tcetu->TC_CCR = AT91C_TC_CLKEN;
 
-	/* Reset to start timers */
-	tcb->TCB_BCR = 1;
+	/* Start counting, leaving the other channels alone */
+	tcetu->TC_CCR = AT91C_TC_SWTRG;
 }
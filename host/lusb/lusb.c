@@ -0,0 +1,451 @@
+/* Asynchronous transport on top of libusb-1.0
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ * Distributed and licensed under the terms of GNU LGPL, Version 2.1
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "lusb.h"
+
+#ifdef DEBUG_LUSB
+#define DEBUGP(x, args...)	fprintf(stderr, "%s:%s():%u " x, __FILE__, \
+					__FUNCTION__, __LINE__, ## args)
+#else
+#define DEBUGP(x, args...)
+#endif
+
+/* IN transfers queued for the application before we stop resubmitting */
+#define LUSB_QUEUE_FACTOR	4
+
+static int xfer_status_to_err(enum libusb_transfer_status status)
+{
+	switch (status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		return 0;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		return LIBUSB_ERROR_TIMEOUT;
+	case LIBUSB_TRANSFER_STALL:
+		return LIBUSB_ERROR_PIPE;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		return LIBUSB_ERROR_NO_DEVICE;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		return LIBUSB_ERROR_OVERFLOW;
+	default:
+		return LIBUSB_ERROR_IO;
+	}
+}
+
+static int ep_is_in(struct lusb_ep *ep)
+{
+	return ep->addr & LIBUSB_ENDPOINT_IN;
+}
+
+/* submit as many idle IN transfers as the queue limit allows */
+static void ep_submit_idle(struct lusb_ep *ep)
+{
+	if (!ep_is_in(ep))
+		return;
+
+	while (ep->num_idle && !ep->stopping && !ep->status &&
+	       (ep->cb || ep->queue_len < ep->queue_max)) {
+		struct libusb_transfer *xfer = ep->idle[--ep->num_idle];
+		int ret;
+
+		ret = libusb_submit_transfer(xfer);
+		if (ret < 0) {
+			DEBUGP("ep 0x%02x: submit failed: %d\n", ep->addr, ret);
+			ep->idle[ep->num_idle++] = xfer;
+			ep->status = ret;
+			break;
+		}
+		ep->busy++;
+	}
+}
+
+static void in_complete(struct libusb_transfer *xfer)
+{
+	struct lusb_ep *ep = xfer->user_data;
+	struct lusb_buf *lb;
+
+	DEBUGP("ep 0x%02x: status=%d len=%d\n", ep->addr, xfer->status,
+		xfer->actual_length);
+
+	ep->busy--;
+	ep->idle[ep->num_idle++] = xfer;
+
+	switch (xfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		if (ep->cb) {
+			ep->cb(ep, xfer->buffer, xfer->actual_length,
+			       ep->cb_data);
+			break;
+		}
+		lb = malloc(sizeof(*lb) + xfer->actual_length);
+		if (!lb) {
+			ep->status = LIBUSB_ERROR_NO_MEM;
+			break;
+		}
+		lb->next = NULL;
+		lb->len = xfer->actual_length;
+		lb->ofs = 0;
+		memcpy(lb->data, xfer->buffer, lb->len);
+		*ep->queue_tail = lb;
+		ep->queue_tail = &lb->next;
+		ep->queue_len++;
+		break;
+	case LIBUSB_TRANSFER_CANCELLED:
+		break;
+	default:
+		if (!ep->status)
+			ep->status = xfer_status_to_err(xfer->status);
+		break;
+	}
+
+	ep_submit_idle(ep);
+}
+
+static void out_complete(struct libusb_transfer *xfer)
+{
+	struct lusb_ep *ep = xfer->user_data;
+
+	DEBUGP("ep 0x%02x: status=%d len=%d\n", ep->addr, xfer->status,
+		xfer->actual_length);
+
+	ep->busy--;
+	ep->idle[ep->num_idle++] = xfer;
+
+	if (xfer->status != LIBUSB_TRANSFER_COMPLETED &&
+	    xfer->status != LIBUSB_TRANSFER_CANCELLED && !ep->status)
+		ep->status = xfer_status_to_err(xfer->status);
+}
+
+static void deadline_set(struct timespec *deadline, int timeout)
+{
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += timeout / 1000;
+	deadline->tv_nsec += (timeout % 1000) * 1000000;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+/* process events until something happens or the deadline has passed.
+ * timeout == 0 means no deadline */
+static int wait_events(libusb_context *ctx, int timeout,
+		       struct timespec *deadline)
+{
+	struct timespec now;
+	long remain = 1000;
+
+	if (timeout) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remain = (deadline->tv_sec - now.tv_sec) * 1000 +
+			 (deadline->tv_nsec - now.tv_nsec) / 1000000;
+		if (remain <= 0)
+			return LIBUSB_ERROR_TIMEOUT;
+	}
+
+	return lusb_handle_events(ctx, remain);
+}
+
+int lusb_handle_events(libusb_context *ctx, int timeout)
+{
+	struct timeval tv;
+	int ret;
+
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+
+	ret = libusb_handle_events_timeout_completed(ctx, &tv, NULL);
+	if (ret == LIBUSB_ERROR_INTERRUPTED)
+		ret = 0;
+
+	return ret;
+}
+
+const struct libusb_pollfd **lusb_get_pollfds(libusb_context *ctx)
+{
+	return libusb_get_pollfds(ctx);
+}
+
+int lusb_ep_read(struct lusb_ep *ep, void *buf, int len, int timeout)
+{
+	struct timespec deadline;
+	struct lusb_buf *lb;
+	int ret;
+
+	if (!ep_is_in(ep) || ep->cb)
+		return LIBUSB_ERROR_INVALID_PARAM;
+
+	deadline_set(&deadline, timeout);
+
+	while (!ep->queue) {
+		if (ep->status) {
+			/* report the error once, then restart the pipe */
+			ret = ep->status;
+			ep->status = 0;
+			ep_submit_idle(ep);
+			return ret;
+		}
+		ret = wait_events(ep->dev->ctx, timeout, &deadline);
+		if (ret < 0)
+			return ret;
+	}
+
+	lb = ep->queue;
+	ret = lb->len - lb->ofs;
+	if (ret > len)
+		ret = len;
+	memcpy(buf, lb->data + lb->ofs, ret);
+	lb->ofs += ret;
+
+	if (lb->ofs >= lb->len) {
+		ep->queue = lb->next;
+		if (!ep->queue)
+			ep->queue_tail = &ep->queue;
+		ep->queue_len--;
+		free(lb);
+		ep_submit_idle(ep);
+	}
+
+	return ret;
+}
+
+int lusb_ep_write(struct lusb_ep *ep, const void *buf, int len, int timeout)
+{
+	struct timespec deadline;
+	struct libusb_transfer *xfer;
+	int ret;
+
+	if (ep_is_in(ep))
+		return LIBUSB_ERROR_INVALID_PARAM;
+	if (len > ep->buf_len)
+		return LIBUSB_ERROR_OVERFLOW;
+
+	deadline_set(&deadline, timeout);
+
+	while (!ep->num_idle) {
+		ret = wait_events(ep->dev->ctx, timeout, &deadline);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (ep->status) {
+		ret = ep->status;
+		ep->status = 0;
+		return ret;
+	}
+
+	xfer = ep->idle[--ep->num_idle];
+	memcpy(xfer->buffer, buf, len);
+	xfer->length = len;
+	xfer->timeout = timeout;
+
+	ret = libusb_submit_transfer(xfer);
+	if (ret < 0) {
+		ep->idle[ep->num_idle++] = xfer;
+		return ret;
+	}
+	ep->busy++;
+
+	return len;
+}
+
+/* wait until all OUT transfers of this endpoint have completed */
+int lusb_ep_flush(struct lusb_ep *ep, int timeout)
+{
+	struct timespec deadline;
+	int ret;
+
+	deadline_set(&deadline, timeout);
+
+	while (ep->busy) {
+		ret = wait_events(ep->dev->ctx, timeout, &deadline);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = ep->status;
+	ep->status = 0;
+
+	return ret;
+}
+
+int lusb_ep_start(struct lusb_ep *ep, lusb_cb_fn *cb, void *data)
+{
+	if (!ep_is_in(ep))
+		return LIBUSB_ERROR_INVALID_PARAM;
+
+	ep->cb = cb;
+	ep->cb_data = data;
+	ep->stopping = 0;
+	ep_submit_idle(ep);
+
+	return ep->status;
+}
+
+static void ep_free(struct lusb_ep *ep)
+{
+	struct lusb_buf *lb;
+	int i;
+
+	while ((lb = ep->queue)) {
+		ep->queue = lb->next;
+		free(lb);
+	}
+
+	for (i = 0; i < ep->num_xfer; i++) {
+		if (!ep->xfer[i])
+			continue;
+		free(ep->xfer[i]->buffer);
+		libusb_free_transfer(ep->xfer[i]);
+	}
+	free(ep->xfer);
+	free(ep->idle);
+	free(ep);
+}
+
+struct lusb_ep *lusb_ep_open(struct lusb_dev *dev, unsigned char addr,
+			     unsigned char type, int num_xfer, int buf_len)
+{
+	struct lusb_ep *ep;
+	int i;
+
+	DEBUGP("ep 0x%02x: %d transfers of %d bytes\n", addr, num_xfer,
+		buf_len);
+
+	ep = malloc(sizeof(*ep));
+	if (!ep)
+		return NULL;
+
+	memset(ep, 0, sizeof(*ep));
+	ep->dev = dev;
+	ep->addr = addr;
+	ep->type = type;
+	ep->buf_len = buf_len;
+	ep->num_xfer = num_xfer;
+	ep->queue_tail = &ep->queue;
+	ep->queue_max = num_xfer * LUSB_QUEUE_FACTOR;
+
+	ep->xfer = calloc(num_xfer, sizeof(*ep->xfer));
+	ep->idle = calloc(num_xfer, sizeof(*ep->idle));
+	if (!ep->xfer || !ep->idle)
+		goto out_free;
+
+	for (i = 0; i < num_xfer; i++) {
+		struct libusb_transfer *xfer;
+		unsigned char *buf;
+		libusb_transfer_cb_fn cb;
+
+		xfer = libusb_alloc_transfer(0);
+		if (!xfer)
+			goto out_free;
+		ep->xfer[i] = xfer;
+
+		buf = malloc(buf_len);
+		if (!buf)
+			goto out_free;
+
+		cb = (addr & LIBUSB_ENDPOINT_IN) ? in_complete : out_complete;
+		if (type == LIBUSB_TRANSFER_TYPE_INTERRUPT)
+			libusb_fill_interrupt_transfer(xfer, dev->hdl, addr,
+						       buf, buf_len, cb, ep, 0);
+		else
+			libusb_fill_bulk_transfer(xfer, dev->hdl, addr,
+						  buf, buf_len, cb, ep, 0);
+
+		ep->idle[ep->num_idle++] = xfer;
+	}
+
+	ep->next = dev->eps;
+	dev->eps = ep;
+
+	return ep;
+
+out_free:
+	ep_free(ep);
+	return NULL;
+}
+
+struct lusb_dev *lusb_open(libusb_context *ctx, uint16_t vendor,
+			   uint16_t product, int interface)
+{
+	struct lusb_dev *dev;
+	int ret;
+
+	dev = malloc(sizeof(*dev));
+	if (!dev)
+		return NULL;
+
+	memset(dev, 0, sizeof(*dev));
+	dev->ctx = ctx;
+	dev->interface = interface;
+
+	dev->hdl = libusb_open_device_with_vid_pid(ctx, vendor, product);
+	if (!dev->hdl) {
+		DEBUGP("no device %04x:%04x\n", vendor, product);
+		free(dev);
+		return NULL;
+	}
+
+	/* not supported on all platforms, claim_interface will tell */
+	libusb_set_auto_detach_kernel_driver(dev->hdl, 1);
+
+	ret = libusb_claim_interface(dev->hdl, interface);
+	if (ret < 0) {
+		DEBUGP("unable to claim interface %d: %d\n", interface, ret);
+		libusb_close(dev->hdl);
+		free(dev);
+		return NULL;
+	}
+
+	return dev;
+}
+
+void lusb_close(struct lusb_dev *dev)
+{
+	struct lusb_ep *ep;
+	int i, busy, tries;
+
+	/* cancel everything in flight and wait for the cancellations */
+	for (ep = dev->eps; ep; ep = ep->next) {
+		ep->stopping = 1;
+		for (i = 0; i < ep->num_xfer; i++)
+			libusb_cancel_transfer(ep->xfer[i]);
+	}
+
+	for (tries = 0; tries < 10; tries++) {
+		busy = 0;
+		for (ep = dev->eps; ep; ep = ep->next)
+			busy += ep->busy;
+		if (!busy)
+			break;
+		lusb_handle_events(dev->ctx, 100);
+	}
+
+	libusb_release_interface(dev->hdl, dev->interface);
+	libusb_close(dev->hdl);
+
+	/* transfers still busy after the grace period are leaked rather
+	 * than freed under the feet of libusb */
+	while ((ep = dev->eps)) {
+		dev->eps = ep->next;
+		if (!ep->busy)
+			ep_free(ep);
+	}
+
+	free(dev);
+}
+
+const char *lusb_strerror(int err)
+{
+	return libusb_error_name(err);
+}
@@ -0,0 +1,86 @@
+#ifndef _LUSB_H
+#define _LUSB_H
+
+/* Asynchronous transport on top of libusb-1.0
+ *
+ * Every endpoint owns a small pool of transfers.  IN endpoints keep all of
+ * them submitted, so the host is always ready to receive the next packet,
+ * OUT endpoints allow several writes to be in flight at the same time.
+ * Completions are processed from lusb_handle_events(), which can either be
+ * called by the blocking read/write helpers or from the main loop of the
+ * application (see lusb_get_pollfds()).
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ * Distributed under the terms of GNU LGPL, Version 2.1
+ */
+
+#include <stdint.h>
+#include <libusb.h>
+
+/* a completed IN transfer that has not been consumed yet */
+struct lusb_buf {
+	struct lusb_buf *next;
+	int len;
+	int ofs;
+	unsigned char data[0];
+};
+
+struct lusb_dev;
+struct lusb_ep;
+
+typedef void lusb_cb_fn(struct lusb_ep *ep, const unsigned char *buf,
+			int len, void *data);
+
+struct lusb_ep {
+	struct lusb_ep *next;
+	struct lusb_dev *dev;
+	unsigned char addr;
+	unsigned char type;		/* LIBUSB_TRANSFER_TYPE_* */
+	int buf_len;
+
+	int num_xfer;
+	struct libusb_transfer **xfer;
+	int busy;			/* transfers submitted to the kernel */
+	int num_idle;
+	struct libusb_transfer **idle;	/* stack of transfers not submitted */
+	int status;			/* pending error, reported once */
+	int stopping;
+
+	/* IN: completed transfers if no callback is registered */
+	struct lusb_buf *queue;
+	struct lusb_buf **queue_tail;
+	int queue_len;
+	int queue_max;
+
+	lusb_cb_fn *cb;
+	void *cb_data;
+};
+
+struct lusb_dev {
+	libusb_context *ctx;
+	libusb_device_handle *hdl;
+	int interface;
+	struct lusb_ep *eps;
+};
+
+/* device */
+struct lusb_dev *lusb_open(libusb_context *ctx, uint16_t vendor,
+			   uint16_t product, int interface);
+void lusb_close(struct lusb_dev *dev);
+
+/* endpoints */
+struct lusb_ep *lusb_ep_open(struct lusb_dev *dev, unsigned char addr,
+			     unsigned char type, int num_xfer, int buf_len);
+int lusb_ep_start(struct lusb_ep *ep, lusb_cb_fn *cb, void *data);
+int lusb_ep_read(struct lusb_ep *ep, void *buf, int len, int timeout);
+int lusb_ep_write(struct lusb_ep *ep, const void *buf, int len, int timeout);
+int lusb_ep_flush(struct lusb_ep *ep, int timeout);
+
+/* event loop */
+int lusb_handle_events(libusb_context *ctx, int timeout);
+const struct libusb_pollfd **lusb_get_pollfds(libusb_context *ctx);
+
+const char *lusb_strerror(int err);
+
+#endif /* _LUSB_H */
@@ -0,0 +1,156 @@
+/* opcd_app - list and switch the applications of a multi-application
+ * OpenPCD image (firmware built with TARGET=main_multi)
+ *
+ *	opcd_app		list them, '*' running, 'd' default
+ *	opcd_app -s reqa	reset into reqa once
+ *	opcd_app -d reqa	make reqa the default and reset into it
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <openpcd.h>
+#include "opcd_usb.h"
+
+#define APP_BUF_SIZE	960
+#define APP_MAX		32
+
+static unsigned char buf[APP_BUF_SIZE];
+static const char *names[APP_MAX];
+static unsigned int num;
+
+/* returns the number of applications, their names end up in names[] */
+static int app_cmd(struct opcd_handle *od, uint8_t flags, uint8_t app)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	int ret, ofs;
+
+	opcd_send_command(od, OPENPCD_CMD_APP, flags, app, 0, NULL);
+	ret = opcd_recv_reply(od, (char *) buf, sizeof(buf) - 1);
+	if (ret < (int) sizeof(*poh) || poh->flags & OPENPCD_FLAG_ERROR)
+		return -1;
+	buf[ret] = '\0';
+
+	num = 0;
+	for (ofs = sizeof(*poh); ofs < ret && buf[ofs] && num < APP_MAX;
+	     ofs += strlen((char *) buf + ofs) + 1)
+		names[num++] = (char *) buf + ofs;
+
+	return num;
+}
+
+static int app_find(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		if (!strcmp(names[i], name))
+			return i;
+	}
+	/* a number works as well */
+	i = strtoul(name, NULL, 0);
+	return i < num ? (int) i : -1;
+}
+
+static void print_help(void)
+{
+	printf( "\t-p\t--picc\t\tuse OpenPICC instead of OpenPCD\n"
+		"\t-s\t--select app\treset into 'app'\n"
+		"\t-d\t--default app\tmake 'app' the default and reset into it\n"
+		"\t-h\t--help\n");
+}
+
+static struct option opts[] = {
+	{ "picc", 0, 0, 'p' },
+	{ "select", 1, 0, 's' },
+	{ "default", 1, 0, 'd' },
+	{ "help", 0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	struct opcd_handle *od;
+	const char *app = NULL;
+	uint8_t flags = 0;
+	unsigned int i;
+	int picc = 0, idx;
+
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "ps:d:h", opts, &option_index);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			picc = 1;
+			break;
+		case 's':
+			app = optarg;
+			flags = OPENPCD_APP_SELECT;
+			break;
+		case 'd':
+			app = optarg;
+			flags = OPENPCD_APP_SELECT|OPENPCD_APP_DEFAULT;
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? 0 : 2);
+		}
+	}
+
+	od = opcd_init(picc);
+	od->verbose = 0;
+
+	if (app_cmd(od, 0, 0) < 0) {
+		fprintf(stderr, "not a multi-application image\n");
+		exit(1);
+	}
+
+	if (!app) {
+		for (i = 0; i < num; i++)
+			printf("%c%c %2u %s\n", i == poh->val ? '*' : ' ',
+			       i == poh->reg ? 'd' : ' ', i, names[i]);
+		opcd_fini(od);
+		exit(0);
+	}
+
+	idx = app_find(app);
+	if (idx < 0) {
+		fprintf(stderr, "no application %s\n", app);
+		exit(1);
+	}
+	if (app_cmd(od, flags, idx) < 0) {
+		fprintf(stderr, "switching to %s failed\n", app);
+		exit(1);
+	}
+	printf("resetting into %s\n", names[idx]);
+
+	opcd_fini(od);
+
+	exit(0);
+}
@@ -0,0 +1,508 @@
+/* opcd_bench - USB benchmark suite for OpenPCD / OpenPICC / SIMtrace
+ *
+ * Measures command round-trip latency, bulk IN/OUT throughput over a
+ * sweep of transfer sizes, interrupt endpoint latency and the effect of
+ * the number of outstanding requests, as well as the cycles the
+ * firmware spends in its string functions.  Results are written as JSON
+ * to stdout, so they can be compared between firmware builds.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <openpcd.h>
+#include "opcd_usb.h"
+
+#define EP_SIZE		64
+/* largest transfer the firmware can handle in one req_ctx */
+#define RCTX_SIZE	960
+
+static unsigned int iterations = 1000;
+static int first_section = 1;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	const unsigned long long *x = a, *y = b;
+
+	if (*x < *y)
+		return -1;
+	return *x > *y;
+}
+
+/* print latency statistics of 'num' samples in nanoseconds as JSON object */
+static void json_latency(const char *name, unsigned long long *samples,
+			 unsigned int num, unsigned int errors, double bps)
+{
+	unsigned long long sum = 0;
+	unsigned int i;
+
+	if (!num) {
+		printf("\t\t\"%s\": { \"samples\": 0, \"errors\": %u }", name,
+			errors);
+		return;
+	}
+
+	qsort(samples, num, sizeof(*samples), cmp_ull);
+	for (i = 0; i < num; i++)
+		sum += samples[i];
+
+#define PCT(p)	(samples[((num - 1) * (p)) / 1000] / 1000.0)
+	printf("\t\t\"%s\": { \"samples\": %u, \"errors\": %u, "
+	       "\"min_us\": %.1f, \"mean_us\": %.1f, \"p50_us\": %.1f, "
+	       "\"p90_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, "
+	       "\"max_us\": %.1f", name, num, errors,
+	       samples[0] / 1000.0, (sum / num) / 1000.0, PCT(500), PCT(900),
+	       PCT(990), PCT(999), samples[num - 1] / 1000.0);
+#undef PCT
+	if (bps >= 0)
+		printf(", \"bytes_per_sec\": %.0f", bps);
+	printf(" }");
+}
+
+static void json_section_start(const char *name)
+{
+	printf("%s\t\"%s\": {\n", first_section ? "" : ",\n", name);
+	first_section = 0;
+}
+
+static void json_section_end(void)
+{
+	printf("\n\t}");
+}
+
+/* command round-trip: GET_API_VERSION is handled entirely in firmware
+ * without touching any peripheral */
+static void bench_cmd_latency(struct opcd_handle *od)
+{
+	unsigned long long *samples;
+	unsigned int i, num = 0, errors = 0;
+	char buf[256];
+
+	samples = calloc(iterations, sizeof(*samples));
+	if (!samples)
+		exit(1);
+
+	for (i = 0; i < iterations; i++) {
+		unsigned long long start = now_ns();
+
+		if (opcd_send_command(od, OPENPCD_CMD_GET_API_VERSION,
+				      0, 0, 0, NULL) < 0 ||
+		    opcd_recv_reply(od, buf, sizeof(buf)) < 0) {
+			errors++;
+			continue;
+		}
+		samples[num++] = now_ns() - start;
+	}
+
+	json_section_start("command_latency");
+	json_latency("get_api_version", samples, num, errors, -1);
+	json_section_end();
+	free(samples);
+}
+
+/* Bulk IN: each USBTEST_IN command makes the firmware send 'frames'
+ * full-size packets.  Up to 'depth' commands are kept outstanding. */
+static int bulk_in_run(struct opcd_handle *od, unsigned int frames,
+		       unsigned int depth, unsigned int transfers,
+		       double *bytes_per_sec, unsigned long long *samples)
+{
+	static char buf[RCTX_SIZE * 16];
+	unsigned long long start, t_req[64];
+	unsigned int sent = 0, done = 0;
+	unsigned int xfer_len = frames * EP_SIZE;
+	unsigned long long total = 0, expected = 0;
+
+	if (depth > 64)
+		depth = 64;
+
+	start = now_ns();
+	while (done < transfers) {
+		int ret;
+
+		while (sent < transfers && sent - done < depth) {
+			t_req[sent % 64] = now_ns();
+			if (opcd_send_command(od, OPENPCD_CMD_USBTEST_IN, 0,
+					      frames, 0, NULL) < 0)
+				return -EIO;
+			sent++;
+			expected += xfer_len;
+		}
+
+		/* transfers are multiples of wMaxPacketSize without ZLP,
+		 * so the host may merge subsequent ones; account bytes */
+		ret = opcd_recv_reply(od, buf, xfer_len);
+		if (ret <= 0)
+			return -EIO;
+		total += ret;
+		while (done < sent && total >= (unsigned long long)
+						(done + 1) * xfer_len) {
+			if (samples)
+				samples[done] = now_ns() - t_req[done % 64];
+			done++;
+		}
+	}
+
+	*bytes_per_sec = total * 1e9 / (now_ns() - start);
+	return 0;
+}
+
+static void bench_bulk_in(struct opcd_handle *od)
+{
+	static const unsigned int frames[] = { 1, 2, 4, 8, 15 };
+	unsigned int i;
+
+	json_section_start("bulk_in");
+	for (i = 0; i < sizeof(frames)/sizeof(frames[0]); i++) {
+		double bps;
+		int ret;
+
+		ret = bulk_in_run(od, frames[i], 2, iterations, &bps, NULL);
+		printf("%s\t\t\"%u\": { \"error\": %d, \"bytes_per_sec\": %.0f }",
+			i ? ",\n" : "", frames[i] * EP_SIZE, ret,
+			ret < 0 ? 0.0 : bps);
+	}
+	json_section_end();
+}
+
+/* Bulk OUT: sizes deliberately avoid multiples of the packet size, as the
+ * firmware only terminates a transfer with a short packet */
+static void bench_bulk_out(struct opcd_handle *od)
+{
+	static const unsigned int sizes[] = { 63, 127, 255, 511, 959 };
+	static unsigned char buf[RCTX_SIZE];
+	struct openpcd_hdr *ohdr = (struct openpcd_hdr *) buf;
+	char reply[64];
+	unsigned int i, n;
+
+	json_section_start("bulk_out");
+	for (i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+		unsigned long long start, total = 0;
+		int ret = 0;
+
+		memset(buf, 0x23, sizeof(buf));
+		ohdr->cmd = OPENPCD_CMD_USBTEST_OUT;
+		ohdr->reg = ohdr->val = 0;
+
+		start = now_ns();
+		for (n = 0; n < iterations; n++) {
+			ohdr->flags = (n == iterations - 1) ?
+					OPENPCD_FLAG_RESPOND : 0;
+			ret = opcd_send_raw(od, buf, sizes[i]);
+			if (ret < 0)
+				break;
+			total += ret;
+		}
+		if (ret >= 0)
+			ret = opcd_recv_reply(od, reply, sizeof(reply));
+
+		printf("%s\t\t\"%u\": { \"error\": %d, \"bytes_per_sec\": %.0f }",
+			i ? ",\n" : "", sizes[i], ret < 0 ? ret : 0,
+			ret < 0 ? 0.0 : total * 1e9 / (now_ns() - start));
+	}
+	json_section_end();
+}
+
+/* interrupt IN: time from USBTEST_INT command to arrival on EP3 */
+static void bench_int_latency(struct opcd_handle *od)
+{
+	unsigned long long *samples;
+	unsigned int i, num = 0, errors = 0;
+	char buf[OPCD_INTBUF_SIZE];
+
+	samples = calloc(iterations, sizeof(*samples));
+	if (!samples)
+		exit(1);
+
+	for (i = 0; i < iterations; i++) {
+		unsigned long long start = now_ns();
+
+		if (opcd_send_command(od, OPENPCD_CMD_USBTEST_INT,
+				      0, 0, 0, NULL) < 0 ||
+		    opcd_recv_irq(od, buf, sizeof(buf), 1000) < 0) {
+			errors++;
+			continue;
+		}
+		samples[num++] = now_ns() - start;
+	}
+
+	json_section_start("interrupt_latency");
+	json_latency("usbtest_int", samples, num, errors, -1);
+	json_section_end();
+	free(samples);
+}
+
+/* throughput and per-request latency as a function of outstanding
+ * bulk IN requests */
+static void bench_queue_depth(struct opcd_handle *od)
+{
+	static const unsigned int depths[] = { 1, 2, 4, 8 };
+	unsigned long long *samples;
+	unsigned int i;
+
+	samples = calloc(iterations, sizeof(*samples));
+	if (!samples)
+		exit(1);
+
+	json_section_start("queue_depth");
+	for (i = 0; i < sizeof(depths)/sizeof(depths[0]); i++) {
+		char name[16];
+		double bps = 0;
+		int ret;
+
+		memset(samples, 0, iterations * sizeof(*samples));
+		ret = bulk_in_run(od, 15, depths[i], iterations, &bps,
+				  samples);
+		snprintf(name, sizeof(name), "%u", depths[i]);
+		printf("%s", i ? ",\n" : "");
+		json_latency(name, samples, ret < 0 ? 0 : iterations,
+			     ret < 0 ? 1 : 0, bps);
+	}
+	json_section_end();
+	free(samples);
+}
+
+/* the same sequence of commands, once one by one and once as batch */
+#define BATCH_CMDS	32
+static void bench_batch(struct opcd_handle *od)
+{
+	unsigned long long *single, *batched;
+	unsigned int i, j, num_s = 0, num_b = 0, err_s = 0, err_b = 0;
+	static unsigned char buf[OPCD_BATCH_SIZE * 2];
+	struct opcd_batch b;
+	int executed;
+
+	single = calloc(iterations, sizeof(*single));
+	batched = calloc(iterations, sizeof(*batched));
+	if (!single || !batched)
+		exit(1);
+
+	for (i = 0; i < iterations; i++) {
+		unsigned long long start = now_ns();
+
+		for (j = 0; j < BATCH_CMDS; j++) {
+			if (opcd_send_command(od, OPENPCD_CMD_GET_API_VERSION,
+					      0, 0, 0, NULL) < 0 ||
+			    opcd_recv_reply(od, (char *) buf, sizeof(buf)) < 0)
+				break;
+		}
+		if (j < BATCH_CMDS) {
+			err_s++;
+			continue;
+		}
+		single[num_s++] = now_ns() - start;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		unsigned long long start = now_ns();
+
+		opcd_batch_init(&b);
+		for (j = 0; j < BATCH_CMDS; j++)
+			opcd_batch_add(&b, OPENPCD_CMD_GET_API_VERSION,
+				       0, 0, 0, NULL);
+		if (opcd_batch_send(od, &b) < 0 ||
+		    opcd_batch_recv(od, buf, sizeof(buf), &executed) < 0 ||
+		    executed != BATCH_CMDS) {
+			err_b++;
+			continue;
+		}
+		batched[num_b++] = now_ns() - start;
+	}
+
+	json_section_start("batch_32_cmds");
+	json_latency("single", single, num_s, err_s, -1);
+	printf(",\n");
+	json_latency("batched", batched, num_b, err_b, -1);
+	json_section_end();
+	free(single);
+	free(batched);
+}
+
+/* cycles per call of the string functions of the firmware */
+static void bench_mem(struct opcd_handle *od)
+{
+	static const unsigned int lens[] = { 16, 64, 256, 512 };
+	static const char *names[OPENPCD_MEMTEST_NUM] = {
+		[OPENPCD_MEMTEST_MEMCPY]		= "memcpy",
+		[OPENPCD_MEMTEST_MEMCPY_UNALIGNED]	= "memcpy_unaligned",
+		[OPENPCD_MEMTEST_MEMMOVE]		= "memmove",
+		[OPENPCD_MEMTEST_MEMSET]		= "memset",
+		[OPENPCD_MEMTEST_BYTE_LOOP]		= "byte_loop",
+		[OPENPCD_MEMTEST_WRITESB]		= "writesb",
+		[OPENPCD_MEMTEST_READSB]		= "readsb",
+	};
+	char buf[256];
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	struct openpcd_memtest mt;
+	unsigned int i, j;
+	int ret;
+
+	json_section_start("string_cycles");
+	for (i = 0; i < sizeof(lens)/sizeof(lens[0]); i++) {
+		unsigned char len[2] = { lens[i] & 0xff, lens[i] >> 8 };
+
+		if (opcd_send_command(od, OPENPCD_CMD_USBTEST_MEM, 0, 0,
+				      sizeof(len), len) < 0)
+			break;
+		ret = opcd_recv_reply(od, buf, sizeof(buf));
+		if (ret < (int) (sizeof(*poh) + sizeof(mt)) ||
+		    poh->flags & OPENPCD_FLAG_ERROR) {
+			printf("%s\t\t\"error\": \"not supported\"",
+			       i ? ",\n" : "");
+			break;
+		}
+		memcpy(&mt, poh->data, sizeof(mt));
+
+		printf("%s\t\t\"%u\": { \"check_errors\": %u", i ? ",\n" : "",
+		       mt.len, mt.errors);
+		for (j = 0; j < OPENPCD_MEMTEST_NUM; j++)
+			printf(", \"%s\": %u", names[j], mt.cycles[j]);
+		printf(" }");
+	}
+	json_section_end();
+}
+
+static void json_device(struct opcd_handle *od)
+{
+	char buf[256];
+	struct openpcd_compile_version *ver =
+		(struct openpcd_compile_version *) (buf + sizeof(struct openpcd_hdr));
+	int ret;
+
+	opcd_send_command(od, OPENPCD_CMD_GET_VERSION, 0, 0, 0, NULL);
+	ret = opcd_recv_reply(od, buf, sizeof(buf));
+
+	json_section_start("device");
+	if (ret >= (int) (sizeof(struct openpcd_hdr) + sizeof(*ver)))
+		printf("\t\t\"version\": \"%.*s\",\n\t\t\"date\": \"%.*s\",\n"
+		       "\t\t\"by\": \"%.*s\",\n",
+		       OPCD_REV_LEN, ver->svnrev, OPCD_REV_LEN, ver->date,
+		       OPCD_REV_LEN, ver->by);
+	printf("\t\t\"iterations\": %u", iterations);
+	json_section_end();
+}
+
+/* is 'name' contained in the comma separated list 'tests'? */
+static int test_selected(const char *tests, const char *name)
+{
+	int len = strlen(name);
+
+	while (tests && *tests) {
+		if (!strncmp(tests, name, len) &&
+		    (tests[len] == ',' || tests[len] == '\0'))
+			return 1;
+		tests = strchr(tests, ',');
+		if (tests)
+			tests++;
+	}
+	return 0;
+}
+
+static void print_help(void)
+{
+	printf( "\t-p\t--picc\t\tuse OpenPICC instead of OpenPCD\n"
+		"\t-n\t--iterations\tnumber of iterations per test\n"
+		"\t-t\t--tests\t\tcomma separated subset of\n"
+		"\t\t\t\tlatency,in,out,int,depth,batch,mem\n"
+		"\t-h\t--help\n");
+}
+
+static struct option opts[] = {
+	{ "picc", 0, 0, 'p' },
+	{ "iterations", 1, 0, 'n' },
+	{ "tests", 1, 0, 't' },
+	{ "help", 0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	struct opcd_handle *od;
+	const char *tests = "latency,in,out,int,depth,batch,mem";
+	int picc = 0;
+
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "pn:t:h", opts, &option_index);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			picc = 1;
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			if (!iterations)
+				exit(2);
+			break;
+		case 't':
+			tests = optarg;
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? 0 : 2);
+		}
+	}
+
+	od = opcd_init(picc);
+	if (!od) {
+		fprintf(stderr, "Cannot open the device\n");
+		exit(1);
+	}
+	od->verbose = 0;
+
+	printf("{\n");
+	json_device(od);
+	if (test_selected(tests, "latency"))
+		bench_cmd_latency(od);
+	if (test_selected(tests, "in"))
+		bench_bulk_in(od);
+	if (test_selected(tests, "out"))
+		bench_bulk_out(od);
+	if (test_selected(tests, "int"))
+		bench_int_latency(od);
+	if (test_selected(tests, "depth"))
+		bench_queue_depth(od);
+	if (test_selected(tests, "batch"))
+		bench_batch(od);
+	if (test_selected(tests, "mem"))
+		bench_mem(od);
+	printf("\n}\n");
+
+	opcd_fini(od);
+
+	exit(0);
+}
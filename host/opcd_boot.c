@@ -0,0 +1,143 @@
+/* opcd_boot - show how long an OpenPCD took to boot
+ *
+ * Reads the boot phase timestamps of the firmware (see
+ * firmware/src/os/boot.c) with OPENPCD_CMD_GET_BOOT_TIMES and prints
+ * them in order, with the time since the previous phase.  Run it right
+ * after plugging the device in, or with -r to reset it first.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <openpcd.h>
+#include "opcd_usb.h"
+
+/* enum openpcd_boot_phase */
+static const char *phase_names[OPENPCD_BOOT_NUM] = {
+	[OPENPCD_BOOT_MAIN]		= "main",
+	[OPENPCD_BOOT_DBGU]		= "dbgu",
+	[OPENPCD_BOOT_SYS]		= "sys_init",
+	[OPENPCD_BOOT_USB_OPEN]		= "usb_open",
+	[OPENPCD_BOOT_APP_INIT]		= "app_init",
+	[OPENPCD_BOOT_SCHED]		= "main_loop",
+	[OPENPCD_BOOT_USB_RESET]	= "usb_reset",
+	[OPENPCD_BOOT_USB_ADDRESS]	= "usb_address",
+	[OPENPCD_BOOT_USB_CONFIGURED]	= "usb_configured",
+	[OPENPCD_BOOT_LATE_INIT]	= "late_init",
+	[OPENPCD_BOOT_FIRST_REQ]	= "first_request",
+};
+
+static void print_help(void)
+{
+	printf( "\t-p\t--picc\t\tuse OpenPICC instead of OpenPCD\n"
+		"\t-r\t--reset\t\treset the device and wait for it first\n"
+		"\t-h\t--help\n");
+}
+
+static struct option opts[] = {
+	{ "picc", 0, 0, 'p' },
+	{ "reset", 0, 0, 'r' },
+	{ "help", 0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	unsigned char buf[256];
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	struct openpcd_boot_times bt;
+	struct opcd_handle *od;
+	int picc = 0, reset = 0;
+	unsigned int order[OPENPCD_BOOT_NUM], num = 0, i, j;
+	uint32_t prev = 0;
+	int ret;
+
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "prh", opts, &option_index);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			picc = 1;
+			break;
+		case 'r':
+			reset = 1;
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? 0 : 2);
+		}
+	}
+
+	od = opcd_init(picc);
+	od->verbose = 0;
+
+	if (reset) {
+		opcd_send_command(od, OPENPCD_CMD_RESET, 0, 0, 0, NULL);
+		opcd_fini(od);
+		/* leave it time to disconnect and enumerate again */
+		sleep(2);
+		od = opcd_init(picc);
+		od->verbose = 0;
+	}
+
+	opcd_send_command(od, OPENPCD_CMD_GET_BOOT_TIMES, 0, 0, 0, NULL);
+	ret = opcd_recv_reply(od, (char *) buf, sizeof(buf));
+	if (ret < (int) sizeof(*poh) || poh->flags & OPENPCD_FLAG_ERROR) {
+		fprintf(stderr, "firmware doesn't report boot times\n");
+		exit(1);
+	}
+	if (ret < (int) (sizeof(*poh) + sizeof(bt))) {
+		fprintf(stderr, "short reply (%d bytes)\n", ret);
+		exit(1);
+	}
+	memcpy(&bt, poh->data, sizeof(bt));
+
+	printf("%s boot\n", bt.flags & OPENPCD_BOOT_FAST ? "fast" : "normal");
+	/* USB runs from interrupts, its phases interleave with the others */
+	for (i = 0; i < OPENPCD_BOOT_NUM; i++) {
+		if (!(bt.reached & (1 << i)))
+			continue;
+		for (j = num++; j > 0 && bt.stamp[order[j - 1]] > bt.stamp[i];
+		     j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	printf("%-16s %10s %10s\n", "phase", "time_us", "delta_us");
+	for (i = 0; i < num; i++) {
+		uint32_t t = bt.stamp[order[i]];
+
+		printf("%-16s %10u %10u\n", phase_names[order[i]], t, t - prev);
+		prev = t;
+	}
+
+	opcd_fini(od);
+
+	exit(0);
+}
@@ -0,0 +1,938 @@
+/* opcd_emu - userspace emulator of OpenPCD / SIMtrace devices
+ *
+ * Speaks the openpcd_hdr / simtrace_hdr protocols on emulated bulk and
+ * interrupt endpoints over a UNIX socket (see opcd_emu.h), so the host
+ * tools can be run and benchmarked without hardware.
+ *
+ * The PCD personality contains a model of the RC632 register file and
+ * FIFO (water level alerts, interrupt request/enable registers, FIFO
+ * flush and overflow, TRANSMIT/TRANSCEIVE without a card in the field,
+ * CALC_CRC), the generic and USBTEST commands and BATCH containers.
+ * Logic analyzer captures (OPENPCD_CMD_LA_CTRL) see a simulated PIO
+ * source: the n-th selected line toggles every (n+1) * 100us.
+ * The SIMtrace personality replays a script of SIM traffic as
+ * SIMTRACE_MSGT_DATA messages.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <openpcd.h>
+#include <simtrace_usb.h>
+#include <cl_rc632.h>
+
+#include "opcd_emu.h"
+
+/* mirrors enum usbapi_err of the firmware */
+#define EMU_ERR_CMD_UNKNOWN	1
+#define EMU_ERR_CMD_NOT_IMPL	2
+#define EMU_ERR_NO_BATCH	5
+
+#define EMU_EP_SIZE		64
+#define EMU_RCTX_SIZE		960
+#define EMU_API_VERSION		0x01
+#define EMU_ENV_SIZE		(256 - 4)	/* the firmware keeps a word */
+
+enum emu_mode {
+	EMU_PCD,
+	EMU_SIMTRACE,
+};
+
+static enum emu_mode mode = EMU_PCD;
+static int verbose;
+static int client_fd = -1;
+
+static uint8_t env[EMU_ENV_SIZE];
+
+/* a client connecting counts as the device booting */
+static struct {
+	unsigned long long start;
+	unsigned long long first_req;
+} boot;
+
+#define DEBUGP(x, args...)	do { if (verbose) fprintf(stderr, x, ## args); } while (0)
+
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static unsigned long long now_ms(void)
+{
+	return now_us() / 1000;
+}
+
+static void emu_send(uint8_t ep, const void *data, int len)
+{
+	unsigned char msg[OPCD_EMU_MSG_SIZE];
+
+	if (client_fd < 0 || len + 1 > sizeof(msg))
+		return;
+
+	msg[0] = ep;
+	memcpy(msg + 1, data, len);
+	if (send(client_fd, msg, len + 1, MSG_NOSIGNAL) < 0)
+		DEBUGP("send: %s\n", strerror(errno));
+}
+
+/***********************************************************************
+ * RC632 model
+ ***********************************************************************/
+
+#define RC632_FIFO_SIZE		64
+#define RC632_STAT_LOALERT	0x01
+#define RC632_STAT_HIALERT	0x02
+#define RC632_STAT_IRQ		0x08
+
+static struct {
+	uint8_t reg[0x40];
+	uint8_t fifo[RC632_FIFO_SIZE];
+	unsigned int fifo_len;
+	uint8_t irq_reported;
+} rc632;
+
+/* recompute status registers and report new interrupts on EP3, the
+ * way rc632_irq() of the firmware does */
+static void rc632_update(void)
+{
+	uint8_t wl = rc632.reg[RC632_REG_FIFO_LEVEL];
+	uint8_t stat = 0, pending;
+
+	if (rc632.fifo_len <= wl) {
+		stat |= RC632_STAT_LOALERT;
+		rc632.reg[RC632_REG_INTERRUPT_RQ] |= RC632_INT_LOALERT;
+	}
+	if (RC632_FIFO_SIZE - rc632.fifo_len <= wl) {
+		stat |= RC632_STAT_HIALERT;
+		rc632.reg[RC632_REG_INTERRUPT_RQ] |= RC632_INT_HIALERT;
+	}
+
+	pending = rc632.reg[RC632_REG_INTERRUPT_RQ] &
+		  rc632.reg[RC632_REG_INTERRUPT_EN] & 0x3f;
+	if (pending)
+		stat |= RC632_STAT_IRQ;
+
+	rc632.reg[RC632_REG_FIFO_LENGTH] = rc632.fifo_len;
+	rc632.reg[RC632_REG_PRIMARY_STATUS] = stat;
+
+	if (pending & ~rc632.irq_reported) {
+		/* one OPENPCD_CMD_EVENTS packet with a single record */
+		uint8_t ev[2 * sizeof(struct openpcd_hdr) + 2];
+		struct openpcd_hdr *poh = (struct openpcd_hdr *) ev;
+		struct openpcd_hdr *irq = (struct openpcd_hdr *) (ev + 6);
+
+		poh->cmd = OPENPCD_CMD_EVENTS;
+		poh->flags = 0;
+		poh->reg = 0;
+		poh->val = 1;
+		ev[4] = sizeof(*irq);
+		ev[5] = 1;
+		irq->cmd = OPENPCD_CMD_IRQ;
+		irq->flags = 0;
+		irq->reg = RC632_REG_INTERRUPT_RQ;
+		irq->val = pending;
+		emu_send(OPCD_INT_EP, ev, sizeof(ev));
+	}
+	rc632.irq_reported = pending;
+}
+
+static void rc632_reset(void)
+{
+	memset(&rc632, 0, sizeof(rc632));
+	rc632.reg[RC632_REG_FIFO_LEVEL] = 0x08;
+	rc632_update();
+}
+
+static void rc632_fifo_push(uint8_t byte)
+{
+	if (rc632.fifo_len >= RC632_FIFO_SIZE) {
+		rc632.reg[RC632_REG_ERROR_FLAG] |= RC632_ERR_FLAG_FIFO_OVERFLOW;
+		return;
+	}
+	rc632.fifo[rc632.fifo_len++] = byte;
+}
+
+static uint8_t rc632_fifo_pop(void)
+{
+	uint8_t byte;
+
+	if (!rc632.fifo_len)
+		return 0;
+
+	byte = rc632.fifo[0];
+	memmove(rc632.fifo, rc632.fifo + 1, --rc632.fifo_len);
+	return byte;
+}
+
+/* ISO 14443-A CRC */
+static uint16_t crc_a(const uint8_t *data, unsigned int len)
+{
+	uint16_t crc = 0x6363;
+
+	while (len--) {
+		uint8_t b = *data++;
+
+		b ^= crc & 0xff;
+		b ^= b << 4;
+		crc = (crc >> 8) ^ ((uint16_t)b << 8) ^ ((uint16_t)b << 3) ^
+		      (b >> 4);
+	}
+	return crc;
+}
+
+static void rc632_command(uint8_t cmd)
+{
+	uint8_t *irq = &rc632.reg[RC632_REG_INTERRUPT_RQ];
+	uint16_t crc;
+
+	DEBUGP("rc632 command 0x%02x, fifo_len=%u\n", cmd, rc632.fifo_len);
+
+	switch (cmd) {
+	case RC632_CMD_IDLE:
+		break;
+	case RC632_CMD_TRANSMIT:
+	case RC632_CMD_TRANSCEIVE:
+		/* everything in the FIFO is sent, nobody answers */
+		rc632.fifo_len = 0;
+		*irq |= RC632_INT_TX | RC632_INT_IDLE;
+		if (cmd == RC632_CMD_TRANSCEIVE)
+			*irq |= RC632_INT_TIMER;
+		break;
+	case RC632_CMD_CALC_CRC:
+		crc = crc_a(rc632.fifo, rc632.fifo_len);
+		rc632.reg[RC632_REG_CRC_RESULT_LSB] = crc & 0xff;
+		rc632.reg[RC632_REG_CRC_RESULT_MSB] = crc >> 8;
+		rc632.fifo_len = 0;
+		*irq |= RC632_INT_IDLE;
+		break;
+	default:
+		*irq |= RC632_INT_IDLE;
+		break;
+	}
+	rc632.reg[RC632_REG_COMMAND] = RC632_CMD_IDLE;
+}
+
+static void rc632_reg_write(uint8_t reg, uint8_t val)
+{
+	reg &= 0x3f;
+
+	switch (reg) {
+	case RC632_REG_FIFO_DATA:
+		rc632_fifo_push(val);
+		break;
+	case RC632_REG_PRIMARY_STATUS:
+	case RC632_REG_FIFO_LENGTH:
+		/* read only */
+		break;
+	case RC632_REG_INTERRUPT_EN:
+	case RC632_REG_INTERRUPT_RQ:
+		if (val & RC632_INT_SET)
+			rc632.reg[reg] |= val & 0x3f;
+		else
+			rc632.reg[reg] &= ~(val & 0x3f);
+		break;
+	case RC632_REG_CONTROL:
+		if (val & RC632_CONTROL_FIFO_FLUSH) {
+			rc632.fifo_len = 0;
+			rc632.reg[RC632_REG_ERROR_FLAG] &=
+					~RC632_ERR_FLAG_FIFO_OVERFLOW;
+		}
+		rc632.reg[reg] = val & ~RC632_CONTROL_FIFO_FLUSH;
+		break;
+	case RC632_REG_COMMAND:
+		rc632_command(val & 0x3f);
+		break;
+	default:
+		rc632.reg[reg] = val;
+		break;
+	}
+	rc632_update();
+}
+
+static uint8_t rc632_reg_read(uint8_t reg)
+{
+	uint8_t val;
+
+	reg &= 0x3f;
+	if (reg == RC632_REG_FIFO_DATA)
+		val = rc632_fifo_pop();
+	else
+		val = rc632.reg[reg];
+	rc632_update();
+
+	return val;
+}
+
+/***********************************************************************
+ * USB command handling
+ ***********************************************************************/
+
+/***********************************************************************
+ * simulated PIO lines for logic analyzer captures
+ ***********************************************************************/
+
+#define LA_PERIOD_US		100
+#define LA_FLUSH_MS		50
+/* as many edges as the firmware puts into one req_ctx */
+#define LA_EDGES_MAX		((EMU_RCTX_SIZE - sizeof(struct openpcd_hdr) \
+				  - 1) / sizeof(struct openpcd_pio_edge))
+
+static struct {
+	uint32_t mask;
+	unsigned long long start;	/* us */
+	unsigned long long t;		/* us, edges up to here are sent */
+	uint32_t level;
+	uint8_t buf[EMU_RCTX_SIZE];
+	unsigned int num;
+} la;
+
+static uint32_t la_stamp(unsigned long long t)
+{
+	return t * OPENPCD_PIO_EDGE_HZ / 1000000;
+}
+
+static void la_flush(void)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) la.buf;
+
+	memset(poh, 0, sizeof(*poh));
+	poh->cmd = OPENPCD_CMD_LA_DATA;
+	poh->val = la.num;
+	emu_send(OPCD_IN_EP, la.buf, sizeof(*poh) +
+		 la.num * sizeof(struct openpcd_pio_edge));
+	la.num = 0;
+}
+
+static void la_edge(unsigned long long t, uint32_t pio)
+{
+	struct openpcd_pio_edge *e = (struct openpcd_pio_edge *)
+		(la.buf + sizeof(struct openpcd_hdr));
+
+	la.level ^= pio;
+	e[la.num].stamp = la_stamp(t);
+	e[la.num].pio = pio;
+	e[la.num].level = la.level;
+	if (++la.num == LA_EDGES_MAX)
+		la_flush();
+}
+
+/* the edges of the selected lines up to now, returns ms until the next
+ * batch is due */
+static int la_run(void)
+{
+	unsigned long long now = now_us();
+
+	while (1) {
+		unsigned long long next = ~0ULL;
+		uint32_t pio = 0;
+		unsigned int i, n = 0;
+
+		for (i = 0; i < 32; i++) {
+			unsigned long long period, t;
+
+			if (!(la.mask & (1 << i)))
+				continue;
+			period = (++n) * LA_PERIOD_US;
+			t = la.start + ((la.t - la.start) / period + 1) *
+				       period;
+			if (t < next) {
+				next = t;
+				pio = 0;
+			}
+			if (t == next)
+				pio |= 1 << i;
+		}
+		if (next > now)
+			break;
+		la.t = next;
+		la_edge(next, pio);
+	}
+	la_flush();
+
+	return LA_FLUSH_MS;
+}
+
+static void la_ctrl(uint32_t mask)
+{
+	if (la.mask) {
+		la_run();
+		la.mask = 0;
+	}
+	if (!mask)
+		return;
+
+	la.mask = mask;
+	la.start = la.t = now_us();
+	la.level = 0;
+	la.num = 0;
+	/* the levels at the start */
+	la_edge(la.start, 0);
+}
+
+/* Handle one command in 'in' (header + payload of 'len' bytes).  The
+ * response is built in 'out', returns its length or 0 if there is none */
+static int emu_cmd(struct openpcd_hdr *in, int len, uint8_t *out)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) out;
+	int data_len = len - sizeof(*in);
+	int respond = in->flags & OPENPCD_FLAG_RESPOND;
+	int out_len = sizeof(*poh);
+	uint8_t buf[EMU_RCTX_SIZE];
+	int i;
+
+	memcpy(poh, in, sizeof(*poh));
+
+	DEBUGP("cmd 0x%02x reg 0x%02x val 0x%02x len %d\n", in->cmd,
+		in->reg, in->val, data_len);
+
+	if (!boot.first_req)
+		boot.first_req = now_us();
+
+	switch (in->cmd) {
+	case OPENPCD_CMD_GET_VERSION: {
+		struct openpcd_compile_version *ver = (void *) poh->data;
+
+		memset(ver, 0, sizeof(*ver));
+		strncpy(ver->svnrev, "emu", sizeof(ver->svnrev));
+		strncpy(ver->by, "opcd_emu", sizeof(ver->by));
+		strncpy(ver->date, __DATE__, sizeof(ver->date));
+		out_len += sizeof(*ver);
+		respond = 1;
+		break;
+	}
+	case OPENPCD_CMD_GET_API_VERSION:
+		poh->val = EMU_API_VERSION;
+		break;
+	case OPENPCD_CMD_SET_LED:
+		DEBUGP("LED %u %s\n", in->reg, in->val ? "on" : "off");
+		break;
+	case OPENPCD_CMD_GET_SERIAL:
+		memcpy(poh->data, "\xde\xad\xbe\xef", 4);
+		out_len += 4;
+		respond = 1;
+		break;
+	case OPENPCD_CMD_GET_ENVIRONMENT:
+		if (poh->val > sizeof(env))
+			poh->val = sizeof(env);
+		memcpy(poh->data, env, poh->val);
+		out_len += poh->val;
+		break;
+	case OPENPCD_CMD_SET_ENVIRONMENT:
+		if (data_len > sizeof(env))
+			data_len = sizeof(env);
+		memcpy(env, in->data, data_len);
+		break;
+	case OPENPCD_CMD_RESET:
+		rc632_reset();
+		break;
+	case OPENPCD_CMD_GET_BOOT_TIMES: {
+		struct openpcd_boot_times bt;
+
+		/* everything up to the configuration is instant here */
+		memset(&bt, 0, sizeof(bt));
+		bt.reached = (1 << OPENPCD_BOOT_MAIN) |
+			     (1 << OPENPCD_BOOT_SCHED) |
+			     (1 << OPENPCD_BOOT_USB_CONFIGURED) |
+			     (1 << OPENPCD_BOOT_FIRST_REQ);
+		bt.stamp[OPENPCD_BOOT_FIRST_REQ] = boot.first_req - boot.start;
+		memcpy(poh->data, &bt, sizeof(bt));
+		out_len += sizeof(bt);
+		respond = 1;
+		break;
+	}
+	case OPENPCD_CMD_LA_CTRL: {
+		uint32_t mask = 0;
+
+		if (data_len >= sizeof(mask))
+			memcpy(&mask, in->data, sizeof(mask));
+		la_ctrl(mask);
+		respond = 1;
+		break;
+	}
+
+	case OPENPCD_CMD_USBTEST_IN:
+		if (in->val > EMU_RCTX_SIZE / EMU_EP_SIZE)
+			in->val = EMU_RCTX_SIZE / EMU_EP_SIZE;
+		memset(buf, 0x55, sizeof(buf));
+		emu_send(OPCD_IN_EP, buf, in->val * EMU_EP_SIZE);
+		return 0;
+	case OPENPCD_CMD_USBTEST_OUT:
+		break;
+	case OPENPCD_CMD_USBTEST_INT:
+		emu_send(OPCD_INT_EP, poh, sizeof(*poh));
+		return 0;
+
+	case OPENPCD_CMD_READ_REG:
+		if (mode != EMU_PCD)
+			goto unknown;
+		poh->val = rc632_reg_read(in->reg);
+		break;
+	case OPENPCD_CMD_WRITE_REG:
+		if (mode != EMU_PCD)
+			goto unknown;
+		rc632_reg_write(in->reg, in->val);
+		break;
+	case OPENPCD_CMD_WRITE_REG_SET:
+		if (mode != EMU_PCD)
+			goto unknown;
+		for (i = 0; i + 1 < data_len; i += 2)
+			rc632_reg_write(in->data[i], in->data[i+1]);
+		break;
+	case OPENPCD_CMD_REG_BITS_SET:
+	case OPENPCD_CMD_REG_BITS_CLEAR:
+		if (mode != EMU_PCD)
+			goto unknown;
+		i = rc632.reg[in->reg & 0x3f];
+		if (in->cmd == OPENPCD_CMD_REG_BITS_SET)
+			i |= in->val;
+		else
+			i &= ~in->val;
+		rc632_reg_write(in->reg, i);
+		poh->val = 0;
+		break;
+	case OPENPCD_CMD_WRITE_FIFO:
+		if (mode != EMU_PCD)
+			goto unknown;
+		for (i = 0; i < data_len; i++)
+			rc632_fifo_push(in->data[i]);
+		rc632_update();
+		break;
+	case OPENPCD_CMD_READ_FIFO:
+		if (mode != EMU_PCD)
+			goto unknown;
+		for (i = 0; i < in->val && rc632.fifo_len; i++)
+			poh->data[i] = rc632_fifo_pop();
+		rc632_update();
+		poh->val = i;
+		out_len += i;
+		break;
+	case OPENPCD_CMD_READ_VFIFO:
+	case OPENPCD_CMD_WRITE_VFIFO:
+	case OPENPCD_CMD_DUMP_REGS:
+		if (mode != EMU_PCD)
+			goto unknown;
+		poh->flags = OPENPCD_FLAG_ERROR;
+		poh->val = EMU_ERR_CMD_NOT_IMPL;
+		return sizeof(*poh);
+
+	default:
+	unknown:
+		poh->flags = OPENPCD_FLAG_ERROR;
+		poh->val = EMU_ERR_CMD_UNKNOWN;
+		return sizeof(*poh);
+	}
+
+	return respond ? out_len : 0;
+}
+
+/* the same container handling as usb_in_batch() of the firmware */
+static void emu_batch(uint8_t *in, int len)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) in;
+	uint8_t reply[EMU_RCTX_SIZE], rsp[EMU_RCTX_SIZE];
+	struct openpcd_hdr *rh = (struct openpcd_hdr *) reply;
+	int ofs = sizeof(*poh), rlen = sizeof(*rh);
+	uint8_t num = 0, flags = 0;
+
+	memset(rh, 0, sizeof(*rh));
+	rh->cmd = OPENPCD_CMD_BATCH;
+
+	while (ofs + 2 <= len) {
+		int sub_len = in[ofs] | in[ofs + 1] << 8;
+		struct openpcd_hdr *sub;
+		int ret, batched = 1;
+
+		ofs += 2;
+		if (sub_len == 0)
+			break;
+		if (sub_len < sizeof(*poh) || ofs + sub_len > len) {
+			flags = OPENPCD_FLAG_ERROR;
+			break;
+		}
+		sub = (struct openpcd_hdr *) (in + ofs);
+		ofs += sub_len;
+
+		switch (sub->cmd) {
+		case OPENPCD_CMD_BATCH:
+		case OPENPCD_CMD_SET_ENVIRONMENT:
+		case OPENPCD_CMD_APP:
+		case OPENPCD_CMD_ADC_READ:
+			memcpy(rsp, sub, sizeof(*sub));
+			((struct openpcd_hdr *) rsp)->flags = OPENPCD_FLAG_ERROR;
+			((struct openpcd_hdr *) rsp)->val = EMU_ERR_NO_BATCH;
+			ret = sizeof(*sub);
+			batched = 0;
+			break;
+		default:
+			ret = emu_cmd(sub, sub_len, rsp);
+			break;
+		}
+
+		if (ret) {
+			if (rlen + ret + 3 > sizeof(reply)) {
+				rh->flags = OPENPCD_FLAG_RESPOND;
+				rh->reg = OPENPCD_BATCH_MORE;
+				rh->val = num;
+				emu_send(OPCD_IN_EP, reply, rlen);
+				rlen = sizeof(*rh);
+			}
+			reply[rlen++] = ret & 0xff;
+			reply[rlen++] = ret >> 8;
+			memcpy(reply + rlen, rsp, ret);
+			rlen += ret;
+		}
+		num += batched;
+		if (((struct openpcd_hdr *) rsp)->flags & OPENPCD_FLAG_ERROR &&
+		    ret) {
+			flags = OPENPCD_FLAG_ERROR;
+			break;
+		}
+	}
+
+	rh->flags = OPENPCD_FLAG_RESPOND | flags;
+	rh->reg = 0;
+	rh->val = num;
+	emu_send(OPCD_IN_EP, reply, rlen);
+}
+
+static void emu_rx(uint8_t *buf, int len)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	uint8_t rsp[EMU_RCTX_SIZE];
+	int ret;
+
+	if (len < sizeof(*poh))
+		return;
+
+	if (poh->cmd == OPENPCD_CMD_BATCH) {
+		emu_batch(buf, len);
+		return;
+	}
+
+	ret = emu_cmd(poh, len, rsp);
+	if (ret)
+		emu_send(OPCD_IN_EP, rsp, ret);
+}
+
+/***********************************************************************
+ * SIM byte source
+ ***********************************************************************/
+
+/* a script is a list of lines, each one of
+ *	reset			reset asserted (SIMTRACE_MSGT_RESET)
+ *	atr <hex bytes>		ATR after reset
+ *	data <hex bytes>	bytes up to the end of a waiting time
+ *	fidi <fi> <di>		new Fi/Di after PPS
+ *	wait <ms>		pause
+ *	loop			start over
+ * '#' starts a comment */
+static const char *default_script[] = {
+	"reset",
+	"atr 3b 9f 95 80 1f c3 80 31 e0 73 fe 21 13 57 86 81 02 86 98 44 18 a8",
+	"data ff 10 94 7b",
+	"fidi 9 4",
+	"data a0 a4 00 00 02 a4 3f 00 9f 22",
+	"data a0 c0 00 00 22 c0 00 00 00 00 7f 20 02 00 00 00 00 00 09 91 00 "
+		"17 04 00 83 8a 83 8a 00 03 00 00 90 00",
+	"wait 50",
+	"data a0 b0 00 00 0a b0 98 94 00 00 00 00 00 00 00 00 90 00",
+	"wait 100",
+	"loop",
+	NULL
+};
+
+static struct {
+	char **lines;
+	int num;
+	int pos;
+	unsigned long long next;
+	uint8_t fi, di;
+	int fidi_changed;
+} sim;
+
+static int sim_load(const char *fname)
+{
+	char line[1024];
+	FILE *f;
+
+	f = fopen(fname, "r");
+	if (!f)
+		return -errno;
+
+	while (fgets(line, sizeof(line), f)) {
+		char *c = strchr(line, '#');
+
+		if (c)
+			*c = '\0';
+		line[strcspn(line, "\r\n")] = '\0';
+		if (strspn(line, " \t") == strlen(line))
+			continue;
+
+		sim.lines = realloc(sim.lines, (sim.num + 1) *
+					       sizeof(*sim.lines));
+		if (!sim.lines)
+			exit(1);
+		sim.lines[sim.num++] = strdup(line);
+	}
+	fclose(f);
+
+	return 0;
+}
+
+static void sim_send(uint8_t msgt, uint8_t flags, const char *hex)
+{
+	uint8_t buf[EMU_RCTX_SIZE];
+	struct simtrace_hdr *sh = (struct simtrace_hdr *) buf;
+	int len = sizeof(*sh);
+	char *end;
+
+	memset(sh, 0, sizeof(*sh));
+	sh->cmd = msgt;
+	sh->flags = flags;
+	sh->res[0] = sim.fi;
+	sh->res[1] = sim.di;
+	if (msgt == SIMTRACE_MSGT_DATA && sim.fidi_changed) {
+		sh->flags |= SIMTRACE_FLAG_PPS_FIDI;
+		sim.fidi_changed = 0;
+	}
+
+	while (hex && len < sizeof(buf)) {
+		unsigned long byte = strtoul(hex, &end, 16);
+
+		if (end == hex)
+			break;
+		buf[len++] = byte;
+		hex = end;
+	}
+
+	emu_send(OPCD_IN_EP, buf, len);
+}
+
+/* execute script lines that are due, returns ms until the next one */
+static int sim_run(void)
+{
+	unsigned long long now = now_ms();
+	int loops = 0;
+
+	while (sim.num && now >= sim.next) {
+		const char *line = sim.lines[sim.pos];
+		const char *arg = line + strcspn(line, " \t");
+
+		if (++sim.pos >= sim.num)
+			sim.pos = 0;
+
+		if (!strncmp(line, "reset", 5)) {
+			/* a reset returns to the default rate */
+			sim.fi = sim.di = 1;
+			sim_send(SIMTRACE_MSGT_RESET, 0, NULL);
+		}
+		else if (!strncmp(line, "atr", 3))
+			sim_send(SIMTRACE_MSGT_DATA, SIMTRACE_FLAG_ATR, arg);
+		else if (!strncmp(line, "data", 4))
+			sim_send(SIMTRACE_MSGT_DATA, SIMTRACE_FLAG_WTIME_EXP,
+				 arg);
+		else if (!strncmp(line, "fidi", 4)) {
+			unsigned int fi = 1, di = 1;
+
+			sscanf(arg, "%u %u", &fi, &di);
+			sim.fi = fi;
+			sim.di = di;
+			sim.fidi_changed = 1;
+		} else if (!strncmp(line, "wait", 4))
+			sim.next = now + strtoul(arg, NULL, 0);
+		else if (!strncmp(line, "loop", 4)) {
+			sim.pos = 0;
+			/* don't spin on a script without waits */
+			if (++loops > 1)
+				sim.next = now + 1;
+		} else
+			fprintf(stderr, "unknown script line `%s'\n", line);
+	}
+
+	if (!sim.num)
+		return -1;
+	return sim.next > now ? sim.next - now : 0;
+}
+
+/***********************************************************************
+ * main
+ ***********************************************************************/
+
+static void emu_session(void)
+{
+	uint8_t msg[OPCD_EMU_MSG_SIZE];
+
+	rc632_reset();
+	boot.start = now_us();
+	boot.first_req = 0;
+	la.mask = 0;
+	sim.pos = 0;
+	sim.next = now_ms();
+	sim.fi = sim.di = 1;
+
+	while (1) {
+		struct pollfd pfd;
+		int timeout = -1, ret;
+
+		if (mode == EMU_SIMTRACE)
+			timeout = sim_run();
+		else if (la.mask)
+			timeout = la_run();
+
+		pfd.fd = client_fd;
+		pfd.events = POLLIN;
+		ret = poll(&pfd, 1, timeout);
+		if (ret < 0 && errno != EINTR)
+			break;
+		if (ret <= 0)
+			continue;
+
+		ret = recv(client_fd, msg, sizeof(msg), 0);
+		if (ret <= 0)
+			break;
+
+		if (msg[0] != OPCD_OUT_EP) {
+			DEBUGP("message for unknown endpoint 0x%02x\n",
+				msg[0]);
+			continue;
+		}
+		emu_rx(msg + 1, ret - 1);
+	}
+}
+
+static void print_help(void)
+{
+	printf( "\t-m\t--mode\t\tpcd|simtrace (default: pcd)\n"
+		"\t-S\t--socket\tpath of the socket (default: %s)\n"
+		"\t-f\t--script\tSIM traffic script for simtrace mode\n"
+		"\t-v\t--verbose\n"
+		"\t-h\t--help\n", OPCD_EMU_SOCK);
+}
+
+static struct option opts[] = {
+	{ "mode", 1, 0, 'm' },
+	{ "socket", 1, 0, 'S' },
+	{ "script", 1, 0, 'f' },
+	{ "verbose", 0, 0, 'v' },
+	{ "help", 0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	const char *path = OPCD_EMU_SOCK;
+	struct sockaddr_un sun;
+	int fd;
+
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "m:S:f:vh", opts,
+				    &option_index);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'm':
+			if (!strcmp(optarg, "simtrace"))
+				mode = EMU_SIMTRACE;
+			else if (!strcmp(optarg, "pcd"))
+				mode = EMU_PCD;
+			else {
+				fprintf(stderr, "unknown mode `%s'\n", optarg);
+				exit(2);
+			}
+			break;
+		case 'S':
+			path = optarg;
+			break;
+		case 'f':
+			if (sim_load(optarg) < 0) {
+				fprintf(stderr, "can't read script `%s'\n",
+					optarg);
+				exit(2);
+			}
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? 0 : 2);
+		}
+	}
+
+	if (!sim.num) {
+		sim.lines = (char **) default_script;
+		while (default_script[sim.num])
+			sim.num++;
+	}
+
+	fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (fd < 0) {
+		perror("socket");
+		exit(1);
+	}
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+	unlink(path);
+
+	if (bind(fd, (struct sockaddr *) &sun, sizeof(sun)) < 0 ||
+	    listen(fd, 1) < 0) {
+		perror("bind");
+		exit(1);
+	}
+
+	printf("emulating %s on %s\n", mode == EMU_PCD ? "OpenPCD" :
+		"SIMtrace", path);
+
+	while (1) {
+		client_fd = accept(fd, NULL, NULL);
+		if (client_fd < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("accept");
+			exit(1);
+		}
+		DEBUGP("client connected\n");
+		emu_session();
+		close(client_fd);
+		client_fd = -1;
+		DEBUGP("client disconnected\n");
+	}
+
+	return 0;
+}
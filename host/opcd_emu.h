@@ -0,0 +1,23 @@
+#ifndef _OPCD_EMU_H
+#define _OPCD_EMU_H
+
+/* Wire format between host tools and the opcd_emu device emulator.
+ *
+ * The emulator listens on a UNIX SOCK_SEQPACKET socket.  Every message
+ * is one USB transfer, prefixed with one byte of endpoint address, so
+ * transfer boundaries are kept without any need for short packets.
+ * Host tools connect to the socket named by $OPENPCD_EMU instead of
+ * opening the USB device.
+ */
+
+#define OPCD_OUT_EP	0x01
+#define OPCD_IN_EP	0x82
+#define OPCD_INT_EP	0x83
+
+#define OPCD_EMU_ENV		"OPENPCD_EMU"
+#define OPCD_EMU_SOCK		"/tmp/opcd_emu.sock"
+
+/* endpoint byte + largest transfer we ever send */
+#define OPCD_EMU_MSG_SIZE	(1 + 4096)
+
+#endif /* _OPCD_EMU_H */
@@ -0,0 +1,236 @@
+/* opcd_frec - dump the flight recorder of an OpenPCD
+ *
+ * Freezes the event recorder (see firmware/src/os/frec.c), reads all of
+ * it with OPENPCD_CMD_FREC_READ and prints a timeline, oldest event
+ * first.  After a watchdog reset the recorder is already frozen and holds
+ * the events that led up to the reset.  Recording is resumed afterwards
+ * unless -n is given.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <openpcd.h>
+#include "opcd_usb.h"
+
+#define FREC_BUF_SIZE	960
+#define FREC_MAX	1024
+
+static const char *reset_names[] = {
+	"power-up", "wake-up", "watchdog", "software", "user", "brownout",
+};
+
+/* AIC source numbers */
+static const char *irq_names[32] = {
+	[0] = "fiq", [1] = "sys", [2] = "pioa", [4] = "adc", [5] = "spi",
+	[6] = "us0", [7] = "us1", [8] = "ssc", [9] = "twi", [10] = "pwmc",
+	[11] = "udp", [12] = "tc0", [13] = "tc1", [14] = "tc2",
+	[30] = "irq0", [31] = "rc632",
+};
+
+/* RCTX_STATE_* of firmware/src/os/req_ctx.h */
+static const char *rctx_names[] = {
+	"free", "rcv_busy", "rcv_done", "main", "rc632irq", "ep2_pend",
+	"ep2_busy", "ep3_pend", "ep3_busy", "ssc_rx", "librfid", "pioirq",
+	"invalid", "ep0_pend", "ep0_busy", "ep1_pend", "ep1_busy",
+};
+
+/* enum usb_device_state */
+static const char *usb_names[] = {
+	"notattached", "attached", "powered", "unauthenticated",
+	"reconnecting", "default", "address", "configured", "suspended",
+};
+
+/* enum iso7816_3_state of firmware/src/simtrace/iso7816_uart.c */
+static const char *iso7816_names[] = {
+	"reset", "wait_atr", "in_atr", "wait_apdu", "in_apdu", "in_pts",
+};
+
+#define NAME(tbl, i) \
+	((unsigned int)(i) < sizeof(tbl)/sizeof(tbl[0]) && tbl[i] ? \
+	 tbl[i] : "?")
+
+static int frec_read(struct opcd_handle *od, unsigned int page, int flags,
+		     struct openpcd_frec_hdr *hdr,
+		     struct openpcd_frec_entry *ent)
+{
+	unsigned char buf[FREC_BUF_SIZE];
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	int ret;
+
+	opcd_send_command(od, OPENPCD_CMD_FREC_READ, page, flags, 0, NULL);
+	ret = opcd_recv_reply(od, (char *) buf, sizeof(buf));
+	if (ret < (int) (sizeof(*poh) + sizeof(*hdr)))
+		return -EIO;
+	if (poh->flags & OPENPCD_FLAG_ERROR) {
+		fprintf(stderr, "firmware has no flight recorder\n");
+		return -ENOTSUP;
+	}
+	if (ret < (int) (sizeof(*poh) + sizeof(*hdr) +
+			 poh->val * sizeof(*ent)))
+		return -EIO;
+
+	memcpy(hdr, poh->data, sizeof(*hdr));
+	memcpy(ent, poh->data + sizeof(*hdr), poh->val * sizeof(*ent));
+
+	return poh->val;
+}
+
+static void print_entry(const struct openpcd_frec_entry *e)
+{
+	switch (e->type) {
+	case OPENPCD_FREC_BOOT:
+		printf("boot #%u, %s reset\n", e->arg16,
+		       NAME(reset_names, e->arg8));
+		break;
+	case OPENPCD_FREC_IRQ_ENTER:
+		printf("irq %s enter (0x%04x)\n", NAME(irq_names, e->arg8 & 31),
+		       e->arg16);
+		break;
+	case OPENPCD_FREC_IRQ_EXIT:
+		printf("irq %s exit\n", NAME(irq_names, e->arg8 & 31));
+		break;
+	case OPENPCD_FREC_RCTX:
+		printf("rctx %u %s -> %s\n", e->arg16 >> 8,
+		       NAME(rctx_names, e->arg16 & 0xff),
+		       NAME(rctx_names, e->arg8));
+		break;
+	case OPENPCD_FREC_USB_EP:
+		if (e->arg8 & OPENPCD_FREC_EP_NO_RCTX)
+			printf("ep%u no req_ctx for %u bytes\n",
+			       e->arg8 & ~OPENPCD_FREC_EP_NO_RCTX, e->arg16);
+		else
+			printf("ep%u %s %u bytes\n", e->arg8,
+			       e->arg8 == 1 ? "received" : "sending",
+			       e->arg16);
+		break;
+	case OPENPCD_FREC_USB_STATE:
+		printf("usb state %s\n", NAME(usb_names, e->arg8));
+		break;
+	case OPENPCD_FREC_STATE:
+		if (e->arg8 == OPENPCD_FREC_SM_ISO7816)
+			printf("iso7816 state %s\n",
+			       NAME(iso7816_names, e->arg16));
+		else
+			printf("state machine %u state %u\n", e->arg8,
+			       e->arg16);
+		break;
+	case OPENPCD_FREC_WDT:
+		printf("watchdog%s%s\n", e->arg8 & 1 ? " expired" : "",
+		       e->arg8 & 2 ? " error" : "");
+		break;
+	default:
+		printf("type %u: 0x%02x 0x%04x\n", e->type, e->arg8,
+		       e->arg16);
+		break;
+	}
+}
+
+static void print_help(void)
+{
+	printf( "\t-p\t--picc\t\tuse OpenPICC instead of OpenPCD\n"
+		"\t-c\t--clear\t\tclear the recorder after reading\n"
+		"\t-n\t--no-resume\tleave recording frozen\n"
+		"\t-h\t--help\n");
+}
+
+static struct option opts[] = {
+	{ "picc", 0, 0, 'p' },
+	{ "clear", 0, 0, 'c' },
+	{ "no-resume", 0, 0, 'n' },
+	{ "help", 0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	static struct openpcd_frec_entry ent[FREC_MAX + OPENPCD_FREC_PAGE];
+	struct openpcd_frec_hdr hdr, tmp;
+	struct opcd_handle *od;
+	int picc = 0, clear = 0, resume = 1;
+	unsigned int num, page, i;
+	uint32_t first, prev;
+	int ret;
+
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "pcnh", opts, &option_index);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			picc = 1;
+			break;
+		case 'c':
+			clear = 1;
+			break;
+		case 'n':
+			resume = 0;
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? 0 : 2);
+		}
+	}
+
+	od = opcd_init(picc);
+	od->verbose = 0;
+
+	/* freeze first, so the pages stay consistent while we read them */
+	ret = frec_read(od, 0, OPENPCD_FREC_FREEZE, &hdr, ent);
+	if (ret < 0)
+		exit(1);
+	num = ret;
+	for (page = 1; num < hdr.num && num < FREC_MAX; page++) {
+		ret = frec_read(od, page, 0, &hdr, ent + num);
+		if (ret <= 0)
+			break;
+		num += ret;
+	}
+	if (resume || clear)
+		frec_read(od, 0, (resume ? OPENPCD_FREC_RESUME : 0) |
+			  (clear ? OPENPCD_FREC_CLEAR : 0), &tmp, ent + num);
+
+	printf("%u events, boot #%u after %s reset\n", num, hdr.boots,
+	       NAME(reset_names, hdr.reset));
+	printf("%12s %10s\n", "time_us", "delta_us");
+
+	first = prev = num ? ent[0].stamp : 0;
+	for (i = 0; i < num; i++) {
+		/* the time base restarts at boot */
+		if (ent[i].type == OPENPCD_FREC_BOOT)
+			first = prev = ent[i].stamp;
+		printf("%12u %10u ", ent[i].stamp - first,
+		       ent[i].stamp - prev);
+		print_entry(&ent[i]);
+		prev = ent[i].stamp;
+	}
+
+	opcd_fini(od);
+
+	exit(0);
+}
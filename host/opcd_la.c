@@ -0,0 +1,252 @@
+/* opcd_la - logic analyzer capture of PIOA lines to a VCD file
+ *
+ * Starts an edge capture of the given PIOA lines with OPENPCD_CMD_LA_CTRL,
+ * collects the OPENPCD_CMD_LA_DATA stream from the bulk IN pipe for the
+ * requested time and writes it as a Value Change Dump, which can be
+ * viewed in GTKWave or imported into sigrok / PulseView.  The levels of
+ * each record are checked against the previous ones, so lost edges show
+ * up even when the firmware could not count them.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <openpcd.h>
+#include "opcd_usb.h"
+
+#define LA_BUF_SIZE	960
+
+struct la_state {
+	FILE *out;
+	uint32_t mask;
+	int started;
+	uint32_t last_stamp;
+	unsigned long long t;		/* ticks since the start */
+	uint32_t level;
+	unsigned long edges, lost, bad;
+};
+
+static unsigned long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int la_ctrl(struct opcd_handle *od, uint32_t mask)
+{
+	unsigned char data[4];
+
+	data[0] = mask;
+	data[1] = mask >> 8;
+	data[2] = mask >> 16;
+	data[3] = mask >> 24;
+
+	return opcd_send_command(od, OPENPCD_CMD_LA_CTRL, 0, 0,
+				 mask ? sizeof(data) : 0, data);
+}
+
+/* one identifier character per line */
+#define VCD_ID(i)	('!' + (i))
+
+static void vcd_header(struct la_state *la)
+{
+	time_t now = time(NULL);
+	unsigned int i;
+
+	fprintf(la->out, "$date %s$end\n", ctime(&now));
+	fprintf(la->out, "$version opcd_la $end\n");
+	fprintf(la->out, "$timescale 1 ns $end\n");
+	fprintf(la->out, "$scope module pioa $end\n");
+	for (i = 0; i < 32; i++) {
+		if (la->mask & (1 << i))
+			fprintf(la->out, "$var wire 1 %c PA%u $end\n",
+				VCD_ID(i), i);
+	}
+	fprintf(la->out, "$upscope $end\n$enddefinitions $end\n");
+}
+
+static void vcd_change(struct la_state *la, uint32_t lines)
+{
+	unsigned int i;
+
+	fprintf(la->out, "#%llu\n",
+		la->t * 1000000000ULL / OPENPCD_PIO_EDGE_HZ);
+	for (i = 0; i < 32; i++) {
+		if (lines & (1 << i))
+			fprintf(la->out, "%u%c\n", (la->level >> i) & 1,
+				VCD_ID(i));
+	}
+}
+
+static void la_record(struct la_state *la, const struct openpcd_pio_edge *e)
+{
+	uint32_t level = e->level & la->mask;
+
+	if (!la->started) {
+		/* the first record only has the initial levels */
+		la->started = 1;
+		la->last_stamp = e->stamp;
+		la->level = level;
+		vcd_header(la);
+		fprintf(la->out, "$dumpvars\n");
+		vcd_change(la, la->mask);
+		fprintf(la->out, "$end\n");
+		return;
+	}
+
+	/* the 32bit time stamps wrap after 48 minutes */
+	la->t += e->stamp - la->last_stamp;
+	la->last_stamp = e->stamp;
+	la->edges++;
+
+	/* a line that toggled twice between two interrupts looks unchanged,
+	 * one that changed without being reported means lost edges */
+	if ((level ^ la->level) & ~e->pio)
+		la->bad++;
+
+	if (level != la->level) {
+		uint32_t changed = level ^ la->level;
+
+		la->level = level;
+		vcd_change(la, changed);
+	}
+}
+
+/* returns 1 on the reply to OPENPCD_CMD_LA_CTRL */
+static int la_packet(struct la_state *la, unsigned char *buf, int len)
+{
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	const struct openpcd_pio_edge *e =
+		(const struct openpcd_pio_edge *) poh->data;
+	unsigned int i;
+
+	if (len < (int) sizeof(*poh))
+		return 0;
+	if (poh->cmd == OPENPCD_CMD_LA_CTRL)
+		return 1;
+	if (poh->cmd != OPENPCD_CMD_LA_DATA ||
+	    len < (int) (sizeof(*poh) + poh->val * sizeof(*e)))
+		return 0;
+
+	la->lost += poh->reg;
+	for (i = 0; i < poh->val; i++)
+		la_record(la, &e[i]);
+
+	return 0;
+}
+
+static void print_help(void)
+{
+	printf( "usage: opcd_la [options] mask\n"
+		"\t-p\t--picc\t\tuse OpenPICC instead of OpenPCD\n"
+		"\t-t\t--time\t\tcapture time in ms (default: 1000)\n"
+		"\t-o\t--output\tVCD file (default: stdout)\n"
+		"\t-h\t--help\n");
+}
+
+static struct option opts[] = {
+	{ "picc", 0, 0, 'p' },
+	{ "time", 1, 0, 't' },
+	{ "output", 1, 0, 'o' },
+	{ "help", 0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	unsigned char buf[LA_BUF_SIZE];
+	struct la_state la;
+	struct opcd_handle *od;
+	unsigned long long end;
+	unsigned int duration = 1000;
+	int picc = 0, replies = 0, ret;
+
+	memset(&la, 0, sizeof(la));
+	la.out = stdout;
+
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "pt:o:h", opts, &option_index);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			picc = 1;
+			break;
+		case 't':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			la.out = fopen(optarg, "w");
+			if (!la.out) {
+				perror(optarg);
+				exit(1);
+			}
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? 0 : 2);
+		}
+	}
+	if (optind >= argc) {
+		print_help();
+		exit(2);
+	}
+	la.mask = strtoul(argv[optind], NULL, 0);
+	if (!la.mask) {
+		fprintf(stderr, "no lines selected\n");
+		exit(2);
+	}
+
+	od = opcd_init(picc);
+	od->verbose = 0;
+
+	la_ctrl(od, la.mask);
+	end = now_ms() + duration;
+
+	/* the reply to the start and then the one to the stop */
+	while (replies < 2) {
+		ret = opcd_recv_reply(od, (char *) buf, sizeof(buf));
+		if (ret < 0)
+			break;
+		replies += la_packet(&la, buf, ret);
+		if (end && now_ms() >= end) {
+			la_ctrl(od, 0);
+			end = 0;
+		}
+	}
+
+	opcd_fini(od);
+	fclose(la.out);
+
+	fprintf(stderr, "%lu edges, %lu lost, %lu inconsistent\n",
+		la.edges, la.lost, la.bad);
+
+	exit(ret < 0 ? 1 : 0);
+}
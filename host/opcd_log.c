@@ -0,0 +1,222 @@
+/* opcd_log - read the firmware debug log over USB
+ *
+ * Drains the debug ring of a DEBUG=1 firmware with
+ * OPENPCD_CMD_DEBUG_LOG_READ and writes the byte stream to stdout, just
+ * as it would appear on the DBGU serial port.  Logs of DEBUG_BINLOG
+ * firmware can be piped into firmware/scripts/dbglog.py.  The per-module
+ * log masks can be changed before reading, e.g. -m usb=7.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <openpcd.h>
+#include "opcd_usb.h"
+
+/* one req_ctx worth of log per read */
+#define LOG_BUF_SIZE	960
+#define POLL_INTERVAL	20000	/* usec, while the log is empty */
+
+/* enum debug_module of the firmware */
+static const char *mod_names[] = {
+	"rc632", "req_ctx", "usb", "iso7816", "ssc", "pit",
+};
+
+/* "module=mask", module by name or number */
+static int log_mask(struct opcd_handle *od, const char *arg)
+{
+	unsigned char buf[LOG_BUF_SIZE];
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	const char *eq = strchr(arg, '=');
+	unsigned int mod, mask;
+	int ret;
+
+	if (!eq)
+		return -EINVAL;
+	for (mod = 0; mod < sizeof(mod_names)/sizeof(mod_names[0]); mod++) {
+		if (strlen(mod_names[mod]) == (size_t)(eq - arg) &&
+		    !strncmp(mod_names[mod], arg, eq - arg))
+			break;
+	}
+	if (mod == sizeof(mod_names)/sizeof(mod_names[0]))
+		mod = strtoul(arg, NULL, 0);
+	mask = strtoul(eq + 1, NULL, 0);
+
+	opcd_send_command(od, OPENPCD_CMD_DEBUG_MASK, mod,
+			  OPENPCD_DEBUG_MASK_SET | (mask & 0x7f), 0, NULL);
+	ret = opcd_recv_reply(od, (char *) buf, sizeof(buf));
+	if (ret < (int) sizeof(*poh))
+		return -EIO;
+	if (poh->flags & OPENPCD_FLAG_ERROR) {
+		fprintf(stderr, "unknown module `%s'\n", arg);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* returns the previous routing, set_flags < 0 only reads it */
+static int log_ctrl(struct opcd_handle *od, int set_flags)
+{
+	unsigned char buf[LOG_BUF_SIZE];
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	int ret;
+
+	opcd_send_command(od, OPENPCD_CMD_DEBUG_LOG_CTRL, set_flags >= 0,
+			  set_flags >= 0 ? set_flags : 0, 0, NULL);
+	ret = opcd_recv_reply(od, (char *) buf, sizeof(buf));
+	if (ret < (int) sizeof(*poh))
+		return -EIO;
+	if (poh->flags & OPENPCD_FLAG_ERROR) {
+		fprintf(stderr, "firmware has no debug log (not built with "
+			"DEBUG=1?)\n");
+		return -ENOTSUP;
+	}
+	return poh->val;
+}
+
+/* returns the number of log bytes written */
+static int log_read(struct opcd_handle *od)
+{
+	unsigned char buf[LOG_BUF_SIZE];
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	int ret;
+
+	opcd_send_command(od, OPENPCD_CMD_DEBUG_LOG_READ, 0, 0, 0, NULL);
+	ret = opcd_recv_reply(od, (char *) buf, sizeof(buf));
+	if (ret < (int) sizeof(*poh))
+		return -EIO;
+	if (poh->flags & OPENPCD_FLAG_ERROR)
+		return -ENOTSUP;
+
+	if (poh->reg)
+		fprintf(stderr, "[opcd_log: %u%s messages dropped]\n",
+			poh->reg, poh->reg == 0xff ? "+" : "");
+
+	/* 'val' pad bytes keep the reply off a packet boundary */
+	ret -= sizeof(*poh);
+	if (ret < poh->val)
+		return -EIO;
+	ret -= poh->val;
+	if (ret && fwrite(poh->data, 1, ret, stdout) != (size_t) ret)
+		return -EIO;
+	fflush(stdout);
+
+	return ret;
+}
+
+static void print_help(void)
+{
+	printf( "\t-p\t--picc\t\tuse OpenPICC instead of OpenPCD\n"
+		"\t-1\t--once\t\texit when the log is empty\n"
+		"\t-s\t--no-serial\tstop sending the log to the DBGU\n"
+		"\t-S\t--serial\tsend the log to the DBGU again\n"
+		"\t-m\t--mask\t\tmodule=mask, set a log level mask\n"
+		"\t\t\t\t(1=err 2=info 4=trace), modules are\n"
+		"\t\t\t\trc632,req_ctx,usb,iso7816,ssc,pit\n"
+		"\t-h\t--help\n");
+}
+
+static struct option opts[] = {
+	{ "picc", 0, 0, 'p' },
+	{ "once", 0, 0, '1' },
+	{ "no-serial", 0, 0, 's' },
+	{ "serial", 0, 0, 'S' },
+	{ "mask", 1, 0, 'm' },
+	{ "help", 0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	struct opcd_handle *od;
+	int picc = 0, once = 0, serial = -1;
+	const char *masks[16];
+	int num_masks = 0;
+	int flags, ret, i;
+
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "p1sSm:h", opts, &option_index);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			picc = 1;
+			break;
+		case '1':
+			once = 1;
+			break;
+		case 's':
+			serial = 0;
+			break;
+		case 'S':
+			serial = 1;
+			break;
+		case 'm':
+			if (num_masks < 16)
+				masks[num_masks++] = optarg;
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? 0 : 2);
+		}
+	}
+
+	od = opcd_init(picc);
+	od->verbose = 0;
+
+	flags = log_ctrl(od, -1);
+	if (flags < 0)
+		exit(1);
+	flags |= OPENPCD_DEBUG_LOG_USB;
+	if (serial == 0)
+		flags |= OPENPCD_DEBUG_LOG_NOSERIAL;
+	else if (serial == 1)
+		flags &= ~OPENPCD_DEBUG_LOG_NOSERIAL;
+	log_ctrl(od, flags);
+
+	for (i = 0; i < num_masks; i++) {
+		if (log_mask(od, masks[i]) < 0)
+			exit(2);
+	}
+
+	while (1) {
+		ret = log_read(od);
+		if (ret < 0)
+			break;
+		if (!ret) {
+			if (once)
+				break;
+			usleep(POLL_INTERVAL);
+		}
+	}
+
+	opcd_fini(od);
+
+	exit(ret < 0 ? 1 : 0);
+}
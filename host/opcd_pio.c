@@ -0,0 +1,169 @@
+/* opcd_pio - print a timeline of PIOA edges
+ *
+ * Asks the firmware to report edges on the given PIOA lines
+ * (OPENPCD_CMD_PIO_IRQ) and prints every edge as it arrives on the
+ * interrupt endpoint, with the time since the first edge, the lines that
+ * changed and their level afterwards.  Reporting is switched off again
+ * on exit.
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <openpcd.h>
+#include "opcd_usb.h"
+
+#define IRQ_BUF_SIZE	960
+#define IRQ_TIMEOUT	500	/* msec */
+
+static volatile int stop;
+
+static void sig_stop(int sig)
+{
+	stop = 1;
+}
+
+static int pio_mask(struct opcd_handle *od, uint32_t mask)
+{
+	unsigned char data[4];
+
+	data[0] = mask;
+	data[1] = mask >> 8;
+	data[2] = mask >> 16;
+	data[3] = mask >> 24;
+
+	return opcd_send_command(od, OPENPCD_CMD_PIO_IRQ, 0, 0,
+				 sizeof(data), data);
+}
+
+static void print_edges(const struct openpcd_hdr *poh, int len,
+			uint32_t mask, int *first, uint32_t *t0, uint32_t *prev)
+{
+	const struct openpcd_pio_edge *e =
+		(const struct openpcd_pio_edge *) poh->data;
+	unsigned int i;
+
+	if (poh->reg)
+		printf("[%u edges lost]\n", poh->reg);
+	if (len < (int) (sizeof(*poh) + poh->val * sizeof(*e)))
+		return;
+
+	for (i = 0; i < poh->val; i++) {
+		if (*first) {
+			*t0 = *prev = e[i].stamp;
+			*first = 0;
+		}
+		printf("%12.1f %10.1f  pio 0x%08x  level 0x%08x\n",
+		       (e[i].stamp - *t0) * 1e6 / OPENPCD_PIO_EDGE_HZ,
+		       (e[i].stamp - *prev) * 1e6 / OPENPCD_PIO_EDGE_HZ,
+		       e[i].pio, e[i].level & mask);
+		*prev = e[i].stamp;
+	}
+}
+
+static void print_help(void)
+{
+	printf( "usage: opcd_pio [options] mask\n"
+		"\t-p\t--picc\t\tuse OpenPICC instead of OpenPCD\n"
+		"\t-h\t--help\n");
+}
+
+static struct option opts[] = {
+	{ "picc", 0, 0, 'p' },
+	{ "help", 0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	unsigned char buf[IRQ_BUF_SIZE];
+	struct opcd_handle *od;
+	uint32_t mask, t0 = 0, prev = 0;
+	int picc = 0, first = 1;
+
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "ph", opts, &option_index);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			picc = 1;
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? 0 : 2);
+		}
+	}
+	if (optind >= argc) {
+		print_help();
+		exit(2);
+	}
+	mask = strtoul(argv[optind], NULL, 0);
+
+	od = opcd_init(picc);
+	od->verbose = 0;
+
+	signal(SIGINT, sig_stop);
+	signal(SIGTERM, sig_stop);
+
+	pio_mask(od, mask);
+	printf("%12s %10s\n", "time_us", "delta_us");
+
+	while (!stop) {
+		struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+		int ret, ofs = 0, count;
+
+		ret = opcd_recv_irq(od, (char *) buf, sizeof(buf),
+				    IRQ_TIMEOUT);
+		if (ret < (int) sizeof(*poh))
+			continue;
+
+		if (poh->cmd == OPENPCD_CMD_PIO_IRQ) {
+			print_edges(poh, ret, mask, &first, &t0, &prev);
+			continue;
+		}
+		if (poh->cmd != OPENPCD_CMD_EVENTS)
+			continue;
+
+		/* the firmware ran out of buffers, only the lines are left */
+		while ((poh = opcd_event_next(buf, ret, &ofs, &count, NULL))) {
+			uint32_t pio;
+
+			if (poh->cmd != OPENPCD_CMD_PIO_IRQ)
+				continue;
+			memcpy(&pio, poh->data, sizeof(pio));
+			printf("%12s %10s  pio 0x%08x  (%u edges)\n", "?", "?",
+			       pio, count);
+		}
+	}
+
+	pio_mask(od, 0);
+	opcd_fini(od);
+
+	exit(0);
+}
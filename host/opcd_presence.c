@@ -30,7 +30,7 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 
-#include <usb.h>
+#include <stdint.h>
 
 #include <openpcd.h>
 #include "opcd_usb.h"
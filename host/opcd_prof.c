@@ -0,0 +1,147 @@
+/* opcd_prof - read the function profile of a PROFILE=1 OpenPCD firmware
+ *
+ * Prints one line per function, most expensive first: address, calls and
+ * the self and inclusive MCK cycles (see firmware/src/os/profile.c).
+ * The addresses are resolved by firmware/scripts/ramfunc.py, which also
+ * picks the functions to move to RAM:
+ *	opcd_prof -c > /dev/null
+ *	... let the device do its job ...
+ *	opcd_prof > before.prof
+ *	ramfunc.py select main_foo.elf before.prof > main_foo.ramfuncs
+ *
+ * (C) 2026 by the OpenPCD developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+
+#include <sys/types.h>
+
+#include <stdint.h>
+#include <openpcd.h>
+#include "opcd_usb.h"
+
+#define PROF_BUF_SIZE	960
+#define PROF_MAX	256
+
+static int prof_read(struct opcd_handle *od, unsigned int page, int flags,
+		     struct openpcd_prof_hdr *hdr,
+		     struct openpcd_prof_entry *ent)
+{
+	unsigned char buf[PROF_BUF_SIZE];
+	struct openpcd_hdr *poh = (struct openpcd_hdr *) buf;
+	int ret;
+
+	opcd_send_command(od, OPENPCD_CMD_PROF_READ, page, flags, 0, NULL);
+	ret = opcd_recv_reply(od, (char *) buf, sizeof(buf));
+	if (ret < (int) sizeof(*poh))
+		return -EIO;
+	if (poh->flags & OPENPCD_FLAG_ERROR) {
+		fprintf(stderr, "firmware not built with PROFILE=1\n");
+		return -ENOTSUP;
+	}
+	if (ret < (int) (sizeof(*poh) + sizeof(*hdr) +
+			 poh->val * sizeof(*ent)))
+		return -EIO;
+
+	memcpy(hdr, poh->data, sizeof(*hdr));
+	memcpy(ent, poh->data + sizeof(*hdr), poh->val * sizeof(*ent));
+
+	return poh->val;
+}
+
+static int cmp_self(const void *a, const void *b)
+{
+	const struct openpcd_prof_entry *x = a, *y = b;
+
+	return x->self < y->self ? 1 : x->self > y->self ? -1 : 0;
+}
+
+static void print_help(void)
+{
+	printf( "\t-p\t--picc\t\tuse OpenPICC instead of OpenPCD\n"
+		"\t-c\t--clear\t\tclear the profile after reading\n"
+		"\t-h\t--help\n");
+}
+
+static struct option opts[] = {
+	{ "picc", 0, 0, 'p' },
+	{ "clear", 0, 0, 'c' },
+	{ "help", 0, 0, 'h' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	static struct openpcd_prof_entry ent[PROF_MAX + OPENPCD_PROF_PAGE];
+	struct openpcd_prof_hdr hdr;
+	struct opcd_handle *od;
+	int picc = 0, clear = 0;
+	unsigned int num = 0, page, i;
+	int ret;
+
+	while (1) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "pch", opts, &option_index);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			picc = 1;
+			break;
+		case 'c':
+			clear = 1;
+			break;
+		case 'h':
+		default:
+			print_help();
+			exit(c == 'h' ? 0 : 2);
+		}
+	}
+
+	od = opcd_init(picc);
+	od->verbose = 0;
+
+	for (page = 0; num < PROF_MAX; page++) {
+		ret = prof_read(od, page, 0, &hdr, ent + num);
+		if (ret < 0)
+			exit(1);
+		num += ret;
+		if (ret < OPENPCD_PROF_PAGE || num >= hdr.num)
+			break;
+	}
+	if (clear)
+		prof_read(od, page + 1, OPENPCD_PROF_CLEAR, &hdr, ent + num);
+
+	qsort(ent, num, sizeof(ent[0]), cmp_self);
+
+	printf("# %u functions, %u calls lost\n", num, hdr.lost);
+	printf("# %8s %10s %12s %12s\n", "addr", "calls", "self_cyc",
+	       "incl_cyc");
+	for (i = 0; i < num; i++)
+		printf("0x%08x %10u %12llu %12llu\n", ent[i].addr, ent[i].calls,
+		       (unsigned long long) ent[i].self * hdr.tick_cycles,
+		       (unsigned long long) ent[i].incl * hdr.tick_cycles);
+
+	opcd_fini(od);
+
+	exit(0);
+}
@@ -28,7 +28,7 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 
-#include <usb.h>
+#include <stdint.h>
 
 #include <openpcd.h>
 #include "opcd_usb.h"
@@ -68,9 +68,60 @@ static void print_help(void)
 		"\t-c\t--clear-bits\treg\tmask\n"
 
 		"\t-u\t--usb-perf\txfer_size\n"
+		"\t-q\t--rctx-stats\n"
+		"\t-Q\t--rctx-stats-clear\n"
 		);
 }
 
+/* names of the RCTX_STATE_* in firmware/src/os/req_ctx.h */
+static const char *rctx_state_names[] = {
+	"FREE", "UDP_RCV_BUSY", "UDP_RCV_DONE", "MAIN_PROCESSING",
+	"RC632IRQ_BUSY", "UDP_EP2_PENDING", "UDP_EP2_BUSY",
+	"UDP_EP3_PENDING", "UDP_EP3_BUSY", "SSC_RX_BUSY", "LIBRFID_BUSY",
+	"PIOIRQ_BUSY", "INVALID", "UDP_EP0_PENDING", "UDP_EP0_BUSY",
+	"UDP_EP1_PENDING", "UDP_EP1_BUSY",
+};
+
+static int rctx_stats(struct opcd_handle *od, int clear)
+{
+	unsigned char buf[256];
+	struct openpcd_hdr *ohdr = (struct openpcd_hdr *) buf;
+	struct openpcd_rctx_stats *st = (struct openpcd_rctx_stats *) ohdr->data;
+	unsigned int state = 0, num = 1, i;
+	int ret;
+
+	printf("%-16s %5s %5s %10s  time in state (log2 us: count)\n",
+	       "state", "now", "max", "enter");
+	for (state = 0; state < num; state++) {
+		opcd_send_command(od, OPENPCD_CMD_RCTX_STATS, state,
+				  clear ? OPENPCD_RCTX_STATS_CLEAR : 0, 0, NULL);
+		ret = opcd_recv_reply(od, (char *) buf, sizeof(buf));
+		if (ret < 0)
+			return ret;
+		if (ret < sizeof(*ohdr) + sizeof(*st) ||
+		    ohdr->flags & OPENPCD_FLAG_ERROR) {
+			fprintf(stderr, "RCTX_STATS not supported\n");
+			return -EIO;
+		}
+		num = ohdr->val;
+
+		if (!st->enter && !st->max)
+			continue;
+		if (state < sizeof(rctx_state_names)/sizeof(char *))
+			printf("%-16s", rctx_state_names[state]);
+		else
+			printf("%-16u", state);
+		printf(" %5u %5u %10u ", st->count, st->max, st->enter);
+		for (i = 0; i < OPENPCD_RCTX_HIST_LEN; i++) {
+			if (st->hist[i])
+				printf(" %u:%u", i, st->hist[i]);
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
+
 
 static struct option opts[] = {
 	{ "led-set", 1, 0, 'l' },
@@ -86,6 +137,8 @@ static struct option opts[] = {
 	{ "ssc-read", 0, 0, 'S' },
 	{ "loop", 0, 0, 'L' },
 	{ "serial-number", 0, 0, 'n' },
+	{ "rctx-stats", 0, 0, 'q' },
+	{ "rctx-stats-clear", 0, 0, 'Q' },
 	{ "help", 0, 0, 'h'},
 };	
 
@@ -107,7 +160,7 @@ int main(int argc, char **argv)
 	while (1) {
 		int option_index = 0;
 
-		c = getopt_long(argc, argv, "l:r:w:R:W:s:c:h?u:aASLn", opts,
+		c = getopt_long(argc, argv, "l:r:w:R:W:s:c:h?u:aASLnqQ", opts,
 				&option_index);
 
 		if (c == -1)
@@ -205,6 +258,11 @@ int main(int argc, char **argv)
 			}
 			close(outfd);
 			break;
+		case 'q':
+		case 'Q':
+			od->verbose = 0;
+			rctx_stats(od, c == 'Q');
+			break;
 		case 'h':
 		case '?':
 			print_help();
@@ -219,7 +277,7 @@ int main(int argc, char **argv)
 				data = buf + sizeof(struct openpcd_hdr);
 				printf("SERIAL: %s\n", opcd_hexdump(data, retlen-4));
 			} else
-				printf("ERROR: %d, %s\n", retlen, usb_strerror());
+				printf("ERROR: %d, %s\n", retlen, lusb_strerror(retlen));
 			break;
 		default:
 			fprintf(stderr, "unknown key `%c'\n", c);
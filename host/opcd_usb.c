@@ -24,11 +24,17 @@
 #include <sys/time.h>
 
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 
-#include "ausb/ausb.h"
+#include <stdlib.h>
+
+#include "lusb/lusb.h"
 #include <openpcd.h>
 
 #include "opcd_usb.h"
+#include "opcd_emu.h"
 
 const char *
 opcd_hexdump(const void *data, unsigned int len)
@@ -50,94 +56,202 @@ opcd_hexdump(const void *data, unsigned int len)
 	return string;
 }
 
-#define OPCD_OUT_EP	0x01
-#define OPCD_IN_EP	0x82
-#define OPCD_INT_EP	0x83
+/* number of transfers kept in flight per endpoint */
+#define OPCD_NUM_XFER	8
+/* multiple of the packet size, larger than the biggest req_ctx */
+#define OPCD_BUF_SIZE	1024
 
-static struct usb_device *find_opcd_handle(int picc)
+static void opcd_dump_hdr(struct openpcd_hdr *hdr)
 {
-	struct usb_bus *bus;
-	u_int16_t product_id;
+	printf("IRQ: cmd=0x%02x, flags=0x%02x, reg=0x%02x, val=0x%02x\n",
+		hdr->cmd, hdr->flags, hdr->reg, hdr->val);
+}
 
-	if (picc)
-		product_id = OPENPICC_PRODUCT_ID;
-	else
-		product_id = OPENPCD_PRODUCT_ID;
+/* a transfer from the emulator for an endpoint we're not reading yet */
+struct opcd_emu_msg {
+	struct opcd_emu_msg *next;
+	int len;
+	unsigned char data[0];
+};
+
+static int opcd_emu_init(struct opcd_handle *oh, const char *path)
+{
+	struct sockaddr_un sun;
+
+	oh->emu_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (oh->emu_fd < 0)
+		return -errno;
 
-	for (bus = usb_busses; bus; bus = bus->next) {
-		struct usb_device *dev;
-		for (dev = bus->devices; dev; dev = dev->next) {
-			if (dev->descriptor.idVendor == OPENPCD_VENDOR_ID &&
-			    dev->descriptor.idProduct == product_id)
-				return dev;
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+	if (connect(oh->emu_fd, (struct sockaddr *) &sun, sizeof(sun)) < 0) {
+		int err = errno;
+
+		close(oh->emu_fd);
+		oh->emu_fd = -1;
+		return -err;
+	}
+
+	return 0;
+}
+
+static void opcd_emu_fini(struct opcd_handle *od)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		while (od->emu_q[i]) {
+			struct opcd_emu_msg *msg = od->emu_q[i];
+
+			od->emu_q[i] = msg->next;
+			free(msg);
 		}
 	}
-	return NULL;
+	close(od->emu_fd);
 }
 
-static void opcd_dump_hdr(struct openpcd_hdr *hdr)
+static int opcd_emu_write(struct opcd_handle *od, const unsigned char *buf,
+			  int len)
 {
-	printf("IRQ: cmd=0x%02x, flags=0x%02x, reg=0x%02x, val=0x%02x\n",
-		hdr->cmd, hdr->flags, hdr->reg, hdr->val);
+	unsigned char msg[OPCD_EMU_MSG_SIZE];
+
+	if (len + 1 > sizeof(msg))
+		return LIBUSB_ERROR_OVERFLOW;
+
+	msg[0] = OPCD_OUT_EP;
+	memcpy(msg + 1, buf, len);
+	if (send(od->emu_fd, msg, len + 1, MSG_NOSIGNAL) < 0)
+		return errno == EPIPE ? LIBUSB_ERROR_NO_DEVICE :
+					LIBUSB_ERROR_IO;
+
+	return len;
 }
 
-static void handle_interrupt(struct usbdevfs_urb *uurb, void *userdata)
+/* read one transfer for endpoint 'ep', queueing those for the other one.
+ * Like a short USB buffer, the rest of a too long transfer is lost */
+static int opcd_emu_read(struct opcd_handle *od, unsigned char ep,
+			 void *buf, int len, int timeout)
 {
-	ausb_dev_handle *ah;
-	struct openpcd_hdr *opcdh;
+	int q = (ep == OPCD_INT_EP);
+	unsigned char rx[OPCD_EMU_MSG_SIZE];
+	struct opcd_emu_msg *msg;
+	int ret;
 
-	if (!uurb) {
-		fprintf(stderr, "interrupt with no URB?!?\n");
-		return;
+	while (!od->emu_q[q]) {
+		struct pollfd pfd;
+		struct opcd_emu_msg **tail;
+
+		pfd.fd = od->emu_fd;
+		pfd.events = POLLIN;
+		ret = poll(&pfd, 1, timeout ? timeout : -1);
+		if (ret < 0 && errno != EINTR)
+			return LIBUSB_ERROR_IO;
+		if (ret == 0)
+			return LIBUSB_ERROR_TIMEOUT;
+		if (ret < 0)
+			continue;
+
+		ret = recv(od->emu_fd, rx, sizeof(rx), 0);
+		if (ret < 0)
+			return LIBUSB_ERROR_IO;
+		if (ret == 0)
+			return LIBUSB_ERROR_NO_DEVICE;
+		if (rx[0] != OPCD_IN_EP && rx[0] != OPCD_INT_EP)
+			continue;
+
+		msg = malloc(sizeof(*msg) + ret - 1);
+		if (!msg)
+			return LIBUSB_ERROR_NO_MEM;
+		msg->next = NULL;
+		msg->len = ret - 1;
+		memcpy(msg->data, rx + 1, ret - 1);
+
+		tail = &od->emu_q[rx[0] == OPCD_INT_EP];
+		while (*tail)
+			tail = &(*tail)->next;
+		*tail = msg;
 	}
 
-	ah = uurb->usercontext;
+	msg = od->emu_q[q];
+	od->emu_q[q] = msg->next;
+	ret = msg->len < len ? msg->len : len;
+	memcpy(buf, msg->data, ret);
+	free(msg);
 
-	opcdh = (struct openpcd_hdr *)uurb->buffer;
-	opcd_dump_hdr(opcdh);
+	return ret;
+}
 
-	if (ausb_submit_urb(ah, uurb))
-		fprintf(stderr, "unable to resubmit interupt urb\n");
+static int opcd_read(struct opcd_handle *od, unsigned char ep, void *buf,
+		     int len, int timeout)
+{
+	if (od->emu_fd >= 0)
+		return opcd_emu_read(od, ep, buf, len, timeout);
+
+	return lusb_ep_read(ep == OPCD_INT_EP ? od->ep_int : od->ep_in,
+			    buf, len, timeout);
 }
 
 struct opcd_handle *opcd_init(int picc)
 {
 	struct opcd_handle *oh;
-	struct usb_device *dev;
+	u_int16_t product_id;
+	const char *emu;
 
 	oh = malloc(sizeof(*oh));
 	if (!oh)
 		return NULL;
 
 	memset(oh, 0, sizeof(*oh));
+	oh->verbose = 1;
+	oh->emu_fd = -1;
 
-	ausb_init();
+	emu = getenv(OPCD_EMU_ENV);
+	if (emu) {
+		int ret = opcd_emu_init(oh, emu);
 
-	dev = find_opcd_handle(picc);
-	if (!dev) {
-		fprintf(stderr, "Cannot find OpenPCD device. "
-			"Are you sure it is connected?\n");
+		if (ret < 0) {
+			fprintf(stderr, "Cannot connect to emulator at %s: "
+				"%s\n", emu, strerror(-ret));
+			exit(1);
+		}
+		return oh;
+	}
+
+	if (libusb_init(&oh->ctx) < 0) {
+		fprintf(stderr, "Unable to initialize libusb\n");
 		exit(1);
 	}
 
-	oh->hdl = ausb_open(dev);
+	if (picc)
+		product_id = OPENPICC_PRODUCT_ID;
+	else
+		product_id = OPENPCD_PRODUCT_ID;
+
+	oh->hdl = lusb_open(oh->ctx, OPENPCD_VENDOR_ID, product_id, 0);
 	if (!oh->hdl) {
-		fprintf(stderr, "Unable to open usb device: %s\n",
-			usb_strerror());
+		fprintf(stderr, "Cannot open OpenPCD device. "
+			"Are you sure it is connected?\n");
 		exit(1);
 	}
 
-	if (ausb_claim_interface(oh->hdl, 0) < 0) {
-		fprintf(stderr, "Unable to claim usb interface "
-			"1 of device: %s\n", usb_strerror());
+	oh->ep_out = lusb_ep_open(oh->hdl, OPCD_OUT_EP,
+				  LIBUSB_TRANSFER_TYPE_BULK,
+				  OPCD_NUM_XFER, OPCD_BUF_SIZE);
+	oh->ep_in = lusb_ep_open(oh->hdl, OPCD_IN_EP,
+				 LIBUSB_TRANSFER_TYPE_BULK,
+				 OPCD_NUM_XFER, OPCD_BUF_SIZE);
+	oh->ep_int = lusb_ep_open(oh->hdl, OPCD_INT_EP,
+				  LIBUSB_TRANSFER_TYPE_INTERRUPT,
+				  OPCD_NUM_XFER, OPCD_INTBUF_SIZE);
+	if (!oh->ep_out || !oh->ep_in || !oh->ep_int) {
+		fprintf(stderr, "Unable to allocate usb transfers\n");
 		exit(1);
 	}
 
-	ausb_fill_int_urb(&oh->int_urb, OPCD_INT_EP, oh->int_buf, 
-			  sizeof(oh->int_buf));
-	if (ausb_register_callback(oh->hdl, USBDEVFS_URB_TYPE_INTERRUPT, 
-				   handle_interrupt, oh)) {
-		fprintf(stderr, "unable to submit interrupt urb");
+	if (lusb_ep_start(oh->ep_in, NULL, NULL) < 0 ||
+	    lusb_ep_start(oh->ep_int, NULL, NULL) < 0) {
+		fprintf(stderr, "Unable to submit usb transfers\n");
 		exit(1);
 	}
 
@@ -146,8 +260,16 @@ struct opcd_handle *opcd_init(int picc)
 
 void opcd_fini(struct opcd_handle *od)
 {
-	ausb_discard_urb(od->hdl, &od->int_urb);
-	ausb_close(od->hdl);
+	if (od->emu_fd >= 0) {
+		opcd_emu_fini(od);
+		free(od);
+		return;
+	}
+
+	lusb_ep_flush(od->ep_out, 1000);
+	lusb_close(od->hdl);
+	libusb_exit(od->ctx);
+	free(od);
 }
 
 int opcd_recv_reply(struct opcd_handle *od, char *buf, int len)
@@ -155,11 +277,11 @@ int opcd_recv_reply(struct opcd_handle *od, char *buf, int len)
 	int ret;
 	memset(buf, 0, sizeof(buf));
 
-	ret = ausb_bulk_read(od->hdl, OPCD_IN_EP, buf, len, 100000);
+	ret = opcd_read(od, OPCD_IN_EP, buf, len, 100000);
 
 	if (ret < 0) {
 		fprintf(stderr, "bulk_read returns %d(%s)\n", ret,
-			usb_strerror());
+			lusb_strerror(ret));
 		return ret;
 	}
 
@@ -170,6 +292,59 @@ int opcd_recv_reply(struct opcd_handle *od, char *buf, int len)
 	return ret;
 }
 
+/* wait for a single transfer on the interrupt endpoint */
+int opcd_recv_irq(struct opcd_handle *od, char *buf, int len, int timeout)
+{
+	int ret;
+
+	ret = opcd_read(od, OPCD_INT_EP, buf, len, timeout);
+	if (ret < 0) {
+		fprintf(stderr, "int_read returns %d(%s)\n", ret,
+			lusb_strerror(ret));
+		return ret;
+	}
+
+	if (od->verbose && ret >= sizeof(struct openpcd_hdr)) {
+		struct openpcd_hdr *ohdr = (struct openpcd_hdr *) buf;
+		int ofs = 0, count;
+
+		if (ohdr->cmd != OPENPCD_CMD_EVENTS) {
+			opcd_dump_hdr(ohdr);
+			return ret;
+		}
+		if (ohdr->reg)
+			printf("IRQ: %u events lost\n", ohdr->reg);
+		while ((ohdr = opcd_event_next((unsigned char *) buf, ret,
+					       &ofs, &count, NULL))) {
+			if (count > 1)
+				printf("%ux ", count);
+			opcd_dump_hdr(ohdr);
+		}
+	}
+
+	return ret;
+}
+
+/* queue an already assembled transfer (header + payload) on the OUT pipe.
+ * Errors of earlier, still asynchronous writes are reported here. */
+int opcd_send_raw(struct opcd_handle *od, const unsigned char *buf, int len)
+{
+	int ret;
+
+	if (od->verbose)
+		printf("TX: %s\n", opcd_hexdump(buf, len));
+
+	if (od->emu_fd >= 0)
+		ret = opcd_emu_write(od, buf, len);
+	else
+		ret = lusb_ep_write(od->ep_out, buf, len, 0);
+	if (ret < 0) {
+		fprintf(stderr, "bulk_write returns %d(%s)\n", ret,
+			lusb_strerror(ret));
+	}
+
+	return ret;
+}
 
 int opcd_send_command(struct opcd_handle *od, u_int8_t cmd, 
 		     u_int8_t reg, u_int8_t val, u_int16_t len,
@@ -178,7 +353,6 @@ int opcd_send_command(struct opcd_handle *od, u_int8_t cmd,
 	unsigned char buf[128];
 	struct openpcd_hdr *ohdr = (struct openpcd_hdr *)buf;
 	int cur = 0;
-	int ret;
 
 	memset(buf, 0, sizeof(buf));
 
@@ -191,15 +365,147 @@ int opcd_send_command(struct opcd_handle *od, u_int8_t cmd,
 	
 	cur = sizeof(*ohdr) + len;
 
-	printf("TX: %s\n", opcd_hexdump(buf, cur));
+	return opcd_send_raw(od, buf, cur);
+}
 
-	ret = ausb_bulk_write(od->hdl, OPCD_OUT_EP, buf, cur, 0);
-	if (ret < 0) {
-		fprintf(stderr, "bulk_write returns %d(%s)\n", ret,
-			usb_strerror());
-	}
+void opcd_batch_init(struct opcd_batch *b)
+{
+	struct openpcd_hdr *ohdr = (struct openpcd_hdr *) b->buf;
 
-	return ret;
+	memset(b, 0, sizeof(*b));
+	ohdr->cmd = OPENPCD_CMD_BATCH;
+	ohdr->flags = OPENPCD_FLAG_RESPOND;
+	b->len = sizeof(*ohdr);
+}
+
+/* append one command to a batch, returns -ENOSPC if it is full */
+int opcd_batch_add(struct opcd_batch *b, u_int8_t cmd, u_int8_t reg,
+		   u_int8_t val, u_int16_t len, const unsigned char *data)
+{
+	struct openpcd_hdr *ohdr;
+	int rec_len = sizeof(*ohdr) + len;
+
+	/* length of the record plus one byte of padding */
+	if (b->len + 2 + rec_len + 1 > sizeof(b->buf))
+		return -ENOSPC;
+
+	b->buf[b->len++] = rec_len & 0xff;
+	b->buf[b->len++] = rec_len >> 8;
+	ohdr = (struct openpcd_hdr *) (b->buf + b->len);
+	ohdr->cmd = cmd;
+	ohdr->flags = OPENPCD_FLAG_RESPOND;
+	ohdr->reg = reg;
+	ohdr->val = val;
+	if (data && len)
+		memcpy(ohdr->data, data, len);
+	b->len += rec_len;
+	b->num++;
+
+	return 0;
+}
+
+int opcd_batch_send(struct opcd_handle *od, struct opcd_batch *b)
+{
+	/* the firmware only ends a transfer on a short packet */
+	if ((b->len % 64) == 0)
+		b->buf[b->len++] = 0;
+
+	return opcd_send_raw(od, b->buf, b->len);
+}
+
+/* Collect all replies to a batch.  The response records are concatenated
+ * into buf without the padding of each reply, *num is set to the number
+ * of commands the device executed.  Returns the length of the records or
+ * a negative error */
+int opcd_batch_recv(struct opcd_handle *od, unsigned char *buf, int len,
+		    int *num)
+{
+	unsigned char rx[OPCD_BATCH_SIZE + 64];
+	struct openpcd_hdr *ohdr = (struct openpcd_hdr *) rx;
+	int ret, ofs, rlen, cur = 0;
+
+	do {
+		ret = opcd_recv_reply(od, (char *) rx, sizeof(rx));
+		if (ret < 0)
+			return ret;
+		if (ret < sizeof(*ohdr) || ohdr->cmd != OPENPCD_CMD_BATCH) {
+			fprintf(stderr, "unexpected reply to batch: %s\n",
+				opcd_hexdump(rx, ret));
+			return -EIO;
+		}
+
+		/* copy whole records, a pad byte or zero length ends them */
+		for (ofs = sizeof(*ohdr); ofs + 2 <= ret; ofs += 2 + rlen) {
+			rlen = rx[ofs] | rx[ofs + 1] << 8;
+			if (!rlen)
+				break;
+			if (ofs + 2 + rlen > ret) {
+				fprintf(stderr, "truncated batch record\n");
+				return -EIO;
+			}
+			if (cur + 2 + rlen > len)
+				return -ENOSPC;
+			memcpy(buf + cur, rx + ofs, 2 + rlen);
+			cur += 2 + rlen;
+		}
+
+		if (num)
+			*num = ohdr->val;
+		if (ohdr->flags & OPENPCD_FLAG_ERROR)
+			fprintf(stderr, "batch aborted after %u commands\n",
+				ohdr->val);
+	} while (ohdr->reg & OPENPCD_BATCH_MORE);
+
+	return cur;
+}
+
+/* iterate over the records returned by opcd_batch_recv() */
+struct openpcd_hdr *opcd_batch_next(unsigned char *buf, int len, int *ofs,
+				    int *rec_len)
+{
+	struct openpcd_hdr *ohdr;
+	int rlen;
+
+	if (*ofs + 2 > len)
+		return NULL;
+
+	rlen = buf[*ofs] | buf[*ofs + 1] << 8;
+	if (*ofs + 2 + rlen > len || rlen < sizeof(*ohdr))
+		return NULL;
+
+	ohdr = (struct openpcd_hdr *) (buf + *ofs + 2);
+	*ofs += 2 + rlen;
+	if (rec_len)
+		*rec_len = rlen;
+
+	return ohdr;
+}
+
+/* iterate over the records of an OPENPCD_CMD_EVENTS packet received by
+ * opcd_recv_irq(), *count is the number of merged occurrences */
+struct openpcd_hdr *opcd_event_next(unsigned char *buf, int len, int *ofs,
+				    int *count, int *rec_len)
+{
+	struct openpcd_hdr *ohdr;
+	int rlen;
+
+	if (*ofs == 0)
+		*ofs = sizeof(*ohdr);
+	if (*ofs + 2 > len)
+		return NULL;
+
+	rlen = buf[*ofs];
+	if (*ofs + 2 + rlen > len || rlen < sizeof(*ohdr))
+		return NULL;
+
+	ohdr = (struct openpcd_hdr *) (buf + *ofs + 2);
+	if (count)
+		*count = buf[*ofs + 1];
+	if (rec_len)
+		*rec_len = rlen;
+	*ofs += 2 + rlen;
+
+	return ohdr;
 }
 
 int opcd_usbperf(struct opcd_handle *od, unsigned int frames)
@@ -220,7 +526,7 @@ int opcd_usbperf(struct opcd_handle *od, unsigned int frames)
 
 		if (i < transfers - 1)
 			opcd_send_command(od, OPENPCD_CMD_USBTEST_IN, transfers, frames, 0, NULL);
-		ret = ausb_bulk_read(od->hdl, OPCD_IN_EP, buf, sizeof(buf), 0);
+		ret = opcd_read(od, OPCD_IN_EP, buf, sizeof(buf), 0);
 		if (ret < 0) {
 			fprintf(stderr, "error receiving data in transaction\n");
 			return ret;
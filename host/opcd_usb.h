@@ -1,13 +1,30 @@
 #ifndef _OPCD_USB_H
 #define _OPCD_USB_H
 
-#include "ausb/ausb.h"
+#include <sys/types.h>
+#include "lusb/lusb.h"
 
 #define OPCD_INTBUF_SIZE 64
 struct opcd_handle {
-	struct ausb_dev_handle *hdl;
-	struct usbdevfs_urb int_urb;
-	u_int8_t int_buf[OPCD_INTBUF_SIZE];
+	libusb_context *ctx;		/* for lusb_handle_events() */
+	struct lusb_dev *hdl;
+	struct lusb_ep *ep_out;
+	struct lusb_ep *ep_in;
+	struct lusb_ep *ep_int;
+	int verbose;
+
+	/* connection to opcd_emu instead of a USB device, see opcd_emu.h */
+	int emu_fd;
+	struct opcd_emu_msg *emu_q[2];	/* unread IN / INT transfers */
+};
+
+/* builder for OPENPCD_CMD_BATCH containers.  The firmware receives at
+ * most one req_ctx (960 bytes) per OUT transfer */
+#define OPCD_BATCH_SIZE	960
+struct opcd_batch {
+	unsigned char buf[OPCD_BATCH_SIZE];
+	int len;
+	int num;
 };
 
 extern const char *opcd_hexdump(const void *data, unsigned int len);
@@ -16,9 +33,27 @@ extern struct opcd_handle *opcd_init(int is_picc);
 extern void opcd_fini(struct opcd_handle *od);
 
 extern int opcd_recv_reply(struct opcd_handle *od, char *buf, int len);
+extern int opcd_recv_irq(struct opcd_handle *od, char *buf, int len,
+			 int timeout);
+extern int opcd_send_raw(struct opcd_handle *od, const unsigned char *buf,
+			 int len);
 extern int opcd_send_command(struct opcd_handle *od, u_int8_t cmd, 
 			     u_int8_t reg, u_int8_t val, u_int16_t len,
 			     const unsigned char *data);
+
+extern void opcd_batch_init(struct opcd_batch *b);
+extern int opcd_batch_add(struct opcd_batch *b, u_int8_t cmd, u_int8_t reg,
+			  u_int8_t val, u_int16_t len,
+			  const unsigned char *data);
+extern int opcd_batch_send(struct opcd_handle *od, struct opcd_batch *b);
+extern int opcd_batch_recv(struct opcd_handle *od, unsigned char *buf,
+			   int len, int *num);
+extern struct openpcd_hdr *opcd_batch_next(unsigned char *buf, int len,
+					   int *ofs, int *rec_len);
+
+extern struct openpcd_hdr *opcd_event_next(unsigned char *buf, int len,
+					   int *ofs, int *count, int *rec_len);
+
 extern int opcd_usbperf(struct opcd_handle *od, unsigned int frames);
 
 #endif